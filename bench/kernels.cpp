@@ -0,0 +1,332 @@
+// Times the intersection and shading kernels one at a time, away from the renderer. Each
+// kernel runs over a batch of inputs generated up front (rays aimed at a unit-sized object
+// from all around it, points, texture coordinates), so the loop measures the kernel and not
+// the random number generator:
+//
+//   aabb_hit             aabb::hit against the box [-1, 1]^3
+//   sphere_hit           Sphere::hit, unit sphere; the hit record is not finalized
+//   sphere_finalize      Sphere::hit followed by HitRecord::finalize on hits
+//   sphere_batch_hit     SphereBatch::hit against eight spheres in the unit box
+//   xy_rectangle_hit     XYRectangle::hit, the square [-1, 1]^2 at z = 0
+//   instance_hit         Instance::hit around a Box [-1, 1]^3, rotated 30 degrees about y
+//   perlin_turb          Perlin::turb at points in [-4, 4]^3
+//   image_texture_value  ImageTexture::value of earthmap.jpg at random (u, v)
+//   camera_get_ray       Camera::get_ray for given film, lens and time samples, with depth of field
+//   camera_get_rays      Camera::get_rays for the same samples, packet_width rays per call
+//
+// For every kernel the batch is passed over repeatedly for --time seconds, split into
+// --repeats measurements; the table shows the median time per call, the spread
+// (max - min) / median of the measurements and the calls per second at the median. With
+// --perf the hardware counters of the measurements are sampled through perf_event as well
+// and reported per call, where the system allows it.
+//
+//   bench_kernels [--count N] [--time S] [--repeats R] [--seed X] [--perf] [--kernel NAME]...
+//
+// Built by the bench_kernels CMake target; run it from the build directory so that
+// image_texture_value finds earthmap.jpg.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "aabb.h"
+#include "aarectangle.h"
+#include "box.h"
+#include "camera.h"
+#include "hittable.h"
+#include "instance.h"
+#include "material.h"
+#include "perf_counters.h"
+#include "perlin.h"
+#include "rng.h"
+#include "sphere.h"
+#include "sphere_batch.h"
+#include "texture.h"
+#include "timer.h"
+
+
+namespace {
+
+struct Options {
+	int count = 1 << 16;
+	int repeats = 7;
+	double seconds = 0.5;
+	uint64_t seed = 1;
+	bool perf = false;
+	std::vector<std::string> kernels;
+};
+
+// One kernel: pass() calls it once for every input of the batch and returns a checksum of
+// the results, so the compiler cannot drop the calls.
+struct Kernel {
+	const char* name;
+	std::function<double()> pass;
+};
+
+struct Inputs {
+	std::vector<Ray> rays;
+	std::vector<Point3> points;
+	std::vector<float> us;
+	std::vector<float> vs;
+};
+
+// Rays start between 2 and 4 units from the origin and aim at a random point of [-1.5, 1.5]^3,
+// so roughly half of them hit the unit-sized targets.
+Inputs make_inputs(int count, uint64_t seed) {
+	seed_thread_rng(0, 0, seed);
+
+	Inputs inputs;
+	inputs.rays.reserve(count);
+	inputs.points.reserve(count);
+	inputs.us.reserve(count);
+	inputs.vs.reserve(count);
+
+	for (int i = 0; i < count; ++i) {
+		const Point3 origin = random_float(2, 4) * random_unit_vector();
+		const Point3 target = Point3::random(-1.5, 1.5);
+		inputs.rays.emplace_back(origin, target - origin, random_float());
+		inputs.points.push_back(Point3::random(-4, 4));
+		inputs.us.push_back(random_float());
+		inputs.vs.push_back(random_float());
+	}
+	return inputs;
+}
+
+struct Measurement {
+	double ns_per_call = 0.0;
+	double spread = 0.0;
+	PerfSample counters; // per call
+};
+
+Measurement measure(const Kernel& kernel, const Options& options, PerfCounters* perf) {
+	volatile double sink = kernel.pass(); // warm-up
+
+	// Enough passes per measurement to fill the time budget.
+	const double budget = options.seconds / options.repeats;
+	long passes = 0;
+	const Timer calibration;
+	do {
+		sink = sink + kernel.pass();
+		++passes;
+	} while (calibration.seconds() < budget);
+
+	std::vector<double> ns_per_call;
+	double counter_sums[perf_counter_count] = {};
+	const double calls = static_cast<double>(passes) * options.count;
+
+	for (int repeat = 0; repeat < options.repeats; ++repeat) {
+		if (perf)
+			perf->start();
+		const Timer timer;
+		for (long pass = 0; pass < passes; ++pass)
+			sink = sink + kernel.pass();
+		const double seconds = timer.seconds();
+		const PerfSample sample = perf ? perf->stop() : PerfSample();
+
+		ns_per_call.push_back(1e9 * seconds / calls);
+		for (int i = 0; i < perf_counter_count; ++i)
+			counter_sums[i] = sample.values[i] < 0 || counter_sums[i] < 0
+				? -1 : counter_sums[i] + sample.values[i];
+	}
+
+	std::sort(ns_per_call.begin(), ns_per_call.end());
+	Measurement measurement;
+	measurement.ns_per_call = ns_per_call[ns_per_call.size() / 2];
+	measurement.spread = (ns_per_call.back() - ns_per_call.front()) / measurement.ns_per_call;
+	for (int i = 0; i < perf_counter_count; ++i)
+		measurement.counters.values[i] =
+			counter_sums[i] < 0 ? -1 : counter_sums[i] / (calls * options.repeats);
+	return measurement;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		const auto take = [&]() {
+			++i;
+			return value;
+		};
+
+		if (arg == "--perf") {
+			options.perf = true;
+		}
+		else if (value == nullptr) {
+			std::cerr << "Unknown or incomplete option " << arg << ".\n";
+			return false;
+		}
+		else if (arg == "--count") {
+			options.count = std::max(1, std::atoi(take()));
+		}
+		else if (arg == "--time") {
+			options.seconds = std::max(0.001, std::atof(take()));
+		}
+		else if (arg == "--repeats") {
+			options.repeats = std::max(1, std::atoi(take()));
+		}
+		else if (arg == "--seed") {
+			options.seed = std::strtoull(take(), nullptr, 10);
+		}
+		else if (arg == "--kernel") {
+			options.kernels.push_back(take());
+		}
+		else {
+			std::cerr << "Unknown option " << arg << ".\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse_options(argc, argv, options))
+		return 1;
+
+	const Inputs inputs = make_inputs(options.count, options.seed);
+	const int count = options.count;
+
+	const auto material = make_shared<Lambertian>(Color(.73, .73, .73));
+	const aabb box(Point3(-1, -1, -1), Point3(1, 1, 1));
+	const Sphere sphere(Point3(0, 0, 0), 1, material);
+	const XYRectangle rectangle(-1, 1, -1, 1, 0, material);
+	const Instance instance(make_shared<Box>(Point3(-1, -1, -1), Point3(1, 1, 1), material),
+		Transform::rotation_y(30));
+	const Perlin perlin;
+	const ImageTexture texture("earthmap.jpg");
+
+	const Camera camera(Point3(13, 2, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 20, 16.0 / 9.0, 0.1, 10,
+		0, 1);
+
+	SphereBatch batch;
+	for (int i = 0; i < 8; ++i)
+		batch.add(Point3::random(-1, 1), 0.4, material);
+
+	// Closest-hit kernels share one loop; the checksum is the sum of the hit distances.
+	const auto hit_pass = [&](const Hittable& object, bool finalize) {
+		return [&object, finalize, &inputs, count]() {
+			double sum = 0.0;
+			for (int i = 0; i < count; ++i) {
+				const Ray& r = inputs.rays[i];
+				HitRecord rec;
+				if (object.hit(r, 10e-3, infinity, rec)) {
+					if (finalize) {
+						rec.finalize(r);
+						sum += rec.normal.x();
+					}
+					sum += rec.t;
+				}
+			}
+			return sum;
+		};
+	};
+
+	const std::vector<Kernel> kernels = {
+		{"aabb_hit", [&]() {
+			double hits = 0.0;
+			for (int i = 0; i < count; ++i)
+				hits += box.hit(inputs.rays[i], 10e-3, infinity);
+			return hits;
+		}},
+		{"sphere_hit", hit_pass(sphere, false)},
+		{"sphere_finalize", hit_pass(sphere, true)},
+		{"sphere_batch_hit", hit_pass(batch, false)},
+		{"xy_rectangle_hit", hit_pass(rectangle, false)},
+		{"instance_hit", hit_pass(instance, false)},
+		{"perlin_turb", [&]() {
+			double sum = 0.0;
+			for (int i = 0; i < count; ++i)
+				sum += perlin.turb(inputs.points[i]);
+			return sum;
+		}},
+		{"image_texture_value", [&]() {
+			double sum = 0.0;
+			for (int i = 0; i < count; ++i)
+				sum += texture.value(inputs.us[i], inputs.vs[i], inputs.points[i]).x();
+			return sum;
+		}},
+		// The points double as film positions and, shifted into [0, 1), as lens and time
+		// samples; ns/call is per ray for both camera kernels.
+		{"camera_get_ray", [&]() {
+			double sum = 0.0;
+			for (int i = 0; i < count; ++i) {
+				const Point3& p = inputs.points[i];
+				const Ray r = camera.get_ray(inputs.us[i], inputs.vs[i],
+					Point2{p.x() / 8 + 0.5f, p.y() / 8 + 0.5f}, p.z() / 8 + 0.5f);
+				sum += r.direction().x();
+			}
+			return sum;
+		}},
+		{"camera_get_rays", [&]() {
+			double sum = 0.0;
+			CameraSamples samples;
+			RayPacket packet;
+			for (int i = 0; i + packet_width <= count; i += packet_width) {
+				for (int lane = 0; lane < packet_width; ++lane) {
+					const Point3& p = inputs.points[i + lane];
+					samples.s[lane] = inputs.us[i + lane];
+					samples.t[lane] = inputs.vs[i + lane];
+					samples.lens_x[lane] = p.x() / 8 + 0.5f;
+					samples.lens_y[lane] = p.y() / 8 + 0.5f;
+					samples.time[lane] = p.z() / 8 + 0.5f;
+				}
+				camera.get_rays(samples, packet);
+				for (int lane = 0; lane < packet_width; ++lane)
+					sum += packet.direction[0][lane];
+			}
+			return sum;
+		}},
+	};
+
+	PerfCounters counters;
+	PerfCounters* perf = nullptr;
+	if (options.perf) {
+		if (counters.available())
+			perf = &counters;
+		else
+			std::cerr << "Hardware counters are not available here; timing only.\n";
+	}
+
+	std::printf("%-20s %10s %8s %12s", "kernel", "ns/call", "spread", "calls/s");
+	if (perf)
+		std::printf(" %10s %6s %12s %13s", perf_counter_name(PerfCounter::cycles), "IPC",
+			perf_counter_name(PerfCounter::cache_misses),
+			perf_counter_name(PerfCounter::branch_misses));
+	std::printf("\n");
+
+	for (const Kernel& kernel : kernels) {
+		if (!options.kernels.empty() &&
+			std::find(options.kernels.begin(), options.kernels.end(), kernel.name) ==
+				options.kernels.end())
+			continue;
+
+		const Measurement m = measure(kernel, options, perf);
+		std::printf("%-20s %10.2f %7.1f%% %12.3e", kernel.name, m.ns_per_call, 100.0 * m.spread,
+			1e9 / m.ns_per_call);
+
+		if (perf) {
+			const PerfSample& c = m.counters;
+			const auto print_counter = [](double value, int width, int precision) {
+				if (value < 0)
+					std::printf(" %*s", width, "-");
+				else
+					std::printf(" %*.*f", width, precision, value);
+			};
+			print_counter(c[PerfCounter::cycles], 10, 1);
+			print_counter(c.has(PerfCounter::cycles) && c.has(PerfCounter::instructions)
+				? c[PerfCounter::instructions] / c[PerfCounter::cycles] : -1, 6, 2);
+			print_counter(c[PerfCounter::cache_misses], 12, 4);
+			print_counter(c[PerfCounter::branch_misses], 13, 4);
+		}
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+}
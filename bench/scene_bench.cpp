@@ -0,0 +1,343 @@
+// Renders every scene of world.h a number of times at a fixed resolution, sample count and
+// seed, and reports per scene the median, minimum and maximum of
+//
+//   scene build   constructing the objects of the scene, including any nested BVHs
+//   bvh build     the top-level WideBvh the renderer traces against
+//   render        the tiled render itself
+//   primary/s     camera rays per second of render time
+//   total/s       all path segments (camera rays and bounces) per second of render time
+//
+// together with the spread (max - min) / median. The scene generators and the renderer are
+// seeded explicitly, so two runs of the same build trace exactly the same rays; image_mean in
+// the JSON output changes only when the rendered image does. Pass --json to keep a result file
+// that can be compared against one from another commit. Built with RT_STATS, the file also
+// holds the hot-path counters of every scene.
+//
+//   bench_scene [--runs N] [--width W] [--spp S] [--depth D] [--threads T] [--seed X]
+//               [--scene ID]... [--scalar] [--adaptive THRESHOLD] [--sampler TYPE]
+//               [--no-light-sampling] [--mesh-cache DIR] [--label TEXT] [--json PATH]
+//
+// With --adaptive, --spp is the upper limit and primary/s counts the samples actually taken.
+// --sampler is one of independent, stratified, halton and sobol (the default). With
+// --mesh-cache, triangle meshes are kept with their BVHs in DIR: the first run writes them and
+// every later one maps them, which shows in the scene build time.
+//
+// Built by the bench_scene CMake target; run it from the build directory so that the earth
+// scene finds earthmap.jpg.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "renderer.h"
+#include "timer.h"
+#include "world.h"
+
+
+namespace {
+
+struct Summary {
+	double median = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+
+	double spread() const { return median > 0.0 ? (max - min) / median : 0.0; }
+};
+
+Summary summarize(std::vector<double> values) {
+	Summary summary;
+	if (values.empty())
+		return summary;
+
+	std::sort(values.begin(), values.end());
+	const size_t n = values.size();
+	summary.median = n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+	summary.min = values.front();
+	summary.max = values.back();
+	return summary;
+}
+
+struct SceneResult {
+	int id = 0;
+	std::string name;
+	int width = 0;
+	int height = 0;
+	uint64_t primary_rays = 0;
+	uint64_t total_rays = 0;
+	double image_mean = 0.0;
+	RenderStats render_stats; // of the last run, with RT_STATS
+	std::vector<double> scene_build_seconds;
+	std::vector<double> bvh_build_seconds;
+	std::vector<double> render_seconds;
+	std::vector<double> primary_rays_per_second;
+	std::vector<double> total_rays_per_second;
+};
+
+struct Options {
+	int runs = 5;
+	uint64_t seed = 1;
+	std::vector<int> scenes;
+	std::string label;
+	std::string json_path;
+	std::string mesh_cache_dir;
+	RenderSettings settings;
+};
+
+double image_mean(const Image& image) {
+	double sum = 0.0;
+	for (int y = 0; y < image.height(); ++y) {
+		const Color* row = image.row(y);
+		for (int x = 0; x < image.width(); ++x)
+			sum += row[x].x() + row[x].y() + row[x].z();
+	}
+	return sum / (3.0 * image.width() * image.height());
+}
+
+std::string compiler_version() {
+#if defined(__VERSION__)
+	return __VERSION__;
+#elif defined(_MSC_FULL_VER)
+	return "MSVC " + std::to_string(_MSC_FULL_VER);
+#else
+	return "unknown";
+#endif
+}
+
+std::string json_string(const std::string& text) {
+	std::string quoted = "\"";
+	for (const char c : text) {
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			quoted += c;
+	}
+	return quoted + '"';
+}
+
+void write_summary(std::ofstream& out, const char* key, const std::vector<double>& values) {
+	const Summary s = summarize(values);
+	out << "      " << json_string(key) << ": {\"median\": " << s.median << ", \"min\": " << s.min
+		<< ", \"max\": " << s.max << ", \"spread\": " << s.spread() << ", \"runs\": [";
+	for (size_t i = 0; i < values.size(); ++i)
+		out << (i ? ", " : "") << values[i];
+	out << "]}";
+}
+
+bool write_json(const std::string& path, const Options& options,
+	const std::vector<SceneResult>& results) {
+	std::ofstream out(path);
+	if (!out) {
+		std::cerr << "Could not open " << path << " for writing.\n";
+		return false;
+	}
+
+	const RenderSettings& settings = options.settings;
+	out.precision(9);
+	out << "{\n"
+		<< "  \"label\": " << json_string(options.label) << ",\n"
+		<< "  \"compiler\": " << json_string(compiler_version()) << ",\n"
+		<< "  \"packet_width\": " << packet_width << ",\n"
+		<< "  \"bvh_width\": " << default_bvh_width << ",\n"
+		<< "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+		<< "  \"settings\": {\"runs\": " << options.runs << ", \"width\": " << settings.image_width
+		<< ", \"samples_per_pixel\": " << settings.samples_per_pixel
+		<< ", \"max_depth\": " << settings.max_depth << ", \"threads\": " << settings.num_threads
+		<< ", \"seed\": " << options.seed
+		<< ", \"mesh_cache\": " << (options.mesh_cache_dir.empty() ? "false" : "true")
+		<< ", \"packets\": " << (settings.trace_packets ? "true" : "false")
+		<< ", \"sampler\": " << json_string(sampler_type_name(settings.sampler))
+		<< ", \"sample_lights\": " << (settings.sample_lights ? "true" : "false")
+		<< ", \"adaptive\": " << (settings.adaptive ? "true" : "false")
+		<< ", \"error_threshold\": " << settings.error_threshold << "},\n"
+		<< "  \"scenes\": [\n";
+
+	for (size_t i = 0; i < results.size(); ++i) {
+		const SceneResult& result = results[i];
+		out << "    {\n"
+			<< "      \"id\": " << result.id << ",\n"
+			<< "      \"name\": " << json_string(result.name) << ",\n"
+			<< "      \"width\": " << result.width << ",\n"
+			<< "      \"height\": " << result.height << ",\n"
+			<< "      \"primary_rays\": " << result.primary_rays << ",\n"
+			<< "      \"total_rays\": " << result.total_rays << ",\n"
+			<< "      \"image_mean\": " << result.image_mean << ",\n";
+		if (render_stats_enabled) {
+			out << "      \"counters\": {";
+			for (int c = 0; c < stat_counter_count; ++c) {
+				std::string name = stat_counter_name(static_cast<StatCounter>(c));
+				std::replace(name.begin(), name.end(), ' ', '_');
+				out << (c ? ", " : "") << json_string(name) << ": " << result.render_stats.counts[c];
+			}
+			out << "},\n";
+		}
+		write_summary(out, "scene_build_seconds", result.scene_build_seconds);
+		out << ",\n";
+		write_summary(out, "bvh_build_seconds", result.bvh_build_seconds);
+		out << ",\n";
+		write_summary(out, "render_seconds", result.render_seconds);
+		out << ",\n";
+		write_summary(out, "primary_rays_per_second", result.primary_rays_per_second);
+		out << ",\n";
+		write_summary(out, "total_rays_per_second", result.total_rays_per_second);
+		out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+	return static_cast<bool>(out.flush());
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+	RenderSettings& settings = options.settings;
+	settings.image_width = 200;
+	settings.samples_per_pixel = 16;
+	settings.verbose = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		const auto take = [&]() {
+			++i;
+			return value;
+		};
+
+		if (arg == "--scalar") {
+			settings.trace_packets = false;
+		}
+		else if (arg == "--no-light-sampling") {
+			settings.sample_lights = false;
+		}
+		else if (value == nullptr) {
+			std::cerr << "Unknown or incomplete option " << arg << ".\n";
+			return false;
+		}
+		else if (arg == "--runs") {
+			options.runs = std::max(1, std::atoi(take()));
+		}
+		else if (arg == "--width") {
+			settings.image_width = std::max(8, std::atoi(take()));
+		}
+		else if (arg == "--spp") {
+			settings.samples_per_pixel = std::max(1, std::atoi(take()));
+		}
+		else if (arg == "--depth") {
+			settings.max_depth = std::max(1, std::atoi(take()));
+		}
+		else if (arg == "--threads") {
+			settings.num_threads = std::max(0, std::atoi(take()));
+		}
+		else if (arg == "--adaptive") {
+			settings.adaptive = true;
+			settings.error_threshold = static_cast<float>(std::atof(take()));
+		}
+		else if (arg == "--sampler") {
+			const std::string name = take();
+			bool known = false;
+			for (const SamplerType type : {SamplerType::independent, SamplerType::stratified,
+					 SamplerType::halton, SamplerType::sobol}) {
+				if (name == sampler_type_name(type)) {
+					settings.sampler = type;
+					known = true;
+				}
+			}
+			if (!known) {
+				std::cerr << "Unknown sampler " << name << ".\n";
+				return false;
+			}
+		}
+		else if (arg == "--seed") {
+			options.seed = std::strtoull(take(), nullptr, 10);
+		}
+		else if (arg == "--scene") {
+			const int id = std::atoi(take());
+			if (id < 1 || id > scene_count) {
+				std::cerr << "Scene ids run from 1 to " << scene_count << ".\n";
+				return false;
+			}
+			options.scenes.push_back(id);
+		}
+		else if (arg == "--mesh-cache") {
+			options.mesh_cache_dir = take();
+		}
+		else if (arg == "--label") {
+			options.label = take();
+		}
+		else if (arg == "--json") {
+			options.json_path = take();
+		}
+		else {
+			std::cerr << "Unknown option " << arg << ".\n";
+			return false;
+		}
+	}
+
+	if (options.scenes.empty()) {
+		for (int id = 1; id <= scene_count; ++id)
+			options.scenes.push_back(id);
+	}
+	settings.seed = options.seed;
+	return true;
+}
+
+}
+
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse_options(argc, argv, options))
+		return 1;
+
+	const RenderSettings& settings = options.settings;
+	std::vector<SceneResult> results;
+
+	std::printf("%-20s %10s %10s %12s %8s %12s %12s\n", "scene", "build ms", "bvh ms",
+		"render ms", "spread", "primary/s", "total/s");
+
+	for (const int id : options.scenes) {
+		SceneResult result;
+		result.id = id;
+
+		for (int run = 0; run < options.runs; ++run) {
+			// The generators draw from the thread's generator, as does the camera's lens
+			// offset, so seed it identically before every build.
+			seed_thread_rng(id, 0, options.seed);
+
+			const Timer build_timer;
+			const Scene scene = make_scene(id, options.mesh_cache_dir);
+			result.scene_build_seconds.push_back(build_timer.seconds());
+
+			const RenderResult render = render_scene(scene, settings);
+			const double seconds = std::max(render.render_seconds, 1e-9);
+
+			result.name = scene.name;
+			result.width = render.image.width();
+			result.height = render.image.height();
+			result.primary_rays = render.primary_rays;
+			result.total_rays = render.path_stats.segments;
+			result.image_mean = image_mean(render.image);
+			result.render_stats = render.render_stats;
+			result.bvh_build_seconds.push_back(render.bvh_build_seconds);
+			result.render_seconds.push_back(seconds);
+			result.primary_rays_per_second.push_back(render.primary_rays / seconds);
+			result.total_rays_per_second.push_back(render.path_stats.segments / seconds);
+		}
+
+		const Summary render = summarize(result.render_seconds);
+		std::printf("%-20s %10.2f %10.2f %12.1f %7.1f%% %12.3e %12.3e\n", result.name.c_str(),
+			1000.0 * summarize(result.scene_build_seconds).median,
+			1000.0 * summarize(result.bvh_build_seconds).median, 1000.0 * render.median,
+			100.0 * render.spread(), summarize(result.primary_rays_per_second).median,
+			summarize(result.total_rays_per_second).median);
+		std::fflush(stdout);
+
+		results.push_back(std::move(result));
+	}
+
+	if (!options.json_path.empty() && !write_json(options.json_path, options, results))
+		return 1;
+}
@@ -1,8 +1,38 @@
 #ifndef AABB_H
 #define AABB_H
 
+#include "render_stats.h"
 #include "rtweekend.h"
 
+#include <limits>
+
+// Far slab distances are scaled by 1 + 2 * gamma(3), where gamma(n) = n * u / (1 - n * u) and
+// u is the unit roundoff of float. That bounds the rounding error of
+// (bound - origin) * inv_direction, so a ray through an edge or a corner shared by two boxes
+// cannot slip between them.
+constexpr float slab_rounding = std::numeric_limits<float>::epsilon() / 2;
+constexpr float slab_far_scale = 1 + 2 * (3 * slab_rounding / (1 - 3 * slab_rounding));
+
+// Clips [t_min, t_max] to the box and returns whether anything is left, with the entry
+// distance in t_near. Branchless: the sign bits of the ray pick the near and far plane of each
+// slab, and the comparisons are written so that a NaN slab distance leaves the interval
+// unchanged. NaN comes up for a ray that lies exactly in the plane of a slab it runs parallel
+// to, as 0 * infinity.
+inline bool slab_test(const float box_min[3], const float box_max[3], const Ray &r, float t_min,
+                      float t_max, float &t_near) {
+    const float *bounds[2] = {box_min, box_max};
+    for (int a = 0; a < 3; ++a) {
+        const int sign = r.sign(a);
+        const float t0 = (bounds[sign][a] - r.origin()[a]) * r.inv_direction()[a];
+        const float t1 =
+            (bounds[1 - sign][a] - r.origin()[a]) * r.inv_direction()[a] * slab_far_scale;
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+    }
+    t_near = t_min;
+    return t_min <= t_max;
+}
+
 class aabb {
 public:
     aabb() {}
@@ -15,18 +45,17 @@ public:
     Point3 aabb_min() const { return aabb_minimum; }
     Point3 aabb_max() const { return aabb_maximum; }
 
+    Point3 centroid() const { return 0.5 * (aabb_minimum + aabb_maximum); }
+
+    float surface_area() const {
+        const Vec3 extent = aabb_maximum - aabb_minimum;
+        return 2 * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+    }
+
     bool hit(const Ray &r, float t_min, float t_max) const {
-        for (int a = 0; a < 3; a++) {
-            auto t0 = fmin((aabb_minimum[a] - r.origin()[a]) / r.direction()[a],
-                           (aabb_maximum[a] - r.origin()[a]) / r.direction()[a]);
-            auto t1 = fmax((aabb_minimum[a] - r.origin()[a]) / r.direction()[a],
-                           (aabb_maximum[a] - r.origin()[a]) / r.direction()[a]);
-            t_min = fmax(t0, t_min);
-            t_max = fmin(t1, t_max);
-            if (t_max <= t_min)
-                return false;
-        }
-        return true;
+        RT_STAT(box_tests);
+        float t_near;
+        return slab_test(aabb_minimum.e, aabb_maximum.e, r, t_min, t_max, t_near);
     }
 
 public:
@@ -4,6 +4,7 @@
 #include "rtweekend.h"
 
 #include "hittable.h"
+#include "material.h"
 #include <memory>
 
 class XYRectangle : public Hittable {
@@ -11,10 +12,21 @@ public:
     XYRectangle() {}
 
     XYRectangle(float _x0, float _x1, float _y0, float _y1, float _k, shared_ptr<Material> mat)
-        : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {}
+        : mp(mat), x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k) {}
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    virtual bool is_light() const override { return mp->is_emissive(); }
+    virtual float light_pdf(const Point3 &origin, const Vec3 &direction) const override;
+    virtual Vec3 sample_light(const Point3 &origin, Point2 u) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the Z dimension
         // a small amount.
@@ -22,27 +34,84 @@ public:
         return true;
     }
 
+private:
+    // Ray distance to the rectangle, if the ray crosses it within [t_min, t_max].
+    bool find_distance(const Ray &r, float t_min, float t_max, float &t) const;
+    void set_hit_record(float t, HitRecord &rec) const;
+
 public:
     shared_ptr<Material> mp;
     float x0, x1, y0, y1, k;
 };
 
 inline bool XYRectangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    float t = (k - r.origin().z()) / r.direction().z();
-    if (t < t_min || t > t_max)
+    RT_STAT(rectangle_tests);
+    float t;
+    if (!find_distance(r, t_min, t_max, t))
+        return false;
+    set_hit_record(t, rec);
+    return true;
+}
+
+inline bool XYRectangle::occluded(const Ray &r, float t_min, float t_max) const {
+    RT_STAT(rectangle_tests);
+    float t;
+    return find_distance(r, t_min, t_max, t);
+}
+
+inline bool XYRectangle::find_distance(const Ray &r, float t_min, float t_max, float &t) const {
+    t = (k - r.origin().z()) / r.direction().z();
+    // Also rejects the NaN of a ray lying in the plane, 0 / 0.
+    if (!(t >= t_min && t <= t_max))
         return false;
     auto x = r.origin().x() + t * r.direction().x();
     auto y = r.origin().y() + t * r.direction().y();
     if (x < x0 || x > x1 || y < y0 || y > y1)
         return false;
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (y - y0) / (y1 - y0);
+    return true;
+}
+
+inline void XYRectangle::set_hit_record(float t, HitRecord &rec) const {
     rec.t = t;
+    rec.material_pointer = mp.get();
+    rec.object = this;
+}
+
+inline void XYRectangle::finalize_hit(const Ray &r, HitRecord &rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.x() - x0) / (x1 - x0);
+    rec.v = (rec.p.y() - y0) / (y1 - y0);
     auto outward_normal = Vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.material_pointer = mp;
-    rec.p = r.at(t);
-    return true;
+}
+
+inline PacketMask XYRectangle::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                          HitRecord *recs) const {
+    RT_STAT_ADD(rectangle_tests, std::popcount(mask));
+
+    // Same arithmetic as hit(), one lane per iteration so the loop vectorizes.
+    float ts[packet_width];
+    int valid[packet_width];
+
+    for (int i = 0; i < packet_width; ++i) {
+        const float t = (k - packet.origin[2][i]) / packet.direction[2][i];
+        const float x = packet.origin[0][i] + t * packet.direction[0][i];
+        const float y = packet.origin[1][i] + t * packet.direction[1][i];
+        ts[i] = t;
+        valid[i] = (t >= t_min && t <= packet.t_max[i]) && !(x < x0 || x > x1) &&
+                   !(y < y0 || y > y1);
+    }
+
+    PacketMask hits = 0;
+    for (int i = 0; i < packet_width; ++i) {
+        hits |= static_cast<PacketMask>(valid[i]) << i;
+    }
+    hits &= mask;
+    for_each_lane(hits, [&](int lane) {
+        set_hit_record(ts[lane], recs[lane]);
+        packet.t_max[lane] = ts[lane];
+    });
+    return hits;
 }
 
 class XZRectangle : public Hittable {
@@ -50,10 +119,21 @@ public:
     XZRectangle() {}
 
     XZRectangle(float _x0, float _x1, float _z0, float _z1, float _k, shared_ptr<Material> mat)
-        : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat){};
+        : mp(mat), x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k) {}
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    virtual bool is_light() const override { return mp->is_emissive(); }
+    virtual float light_pdf(const Point3 &origin, const Vec3 &direction) const override;
+    virtual Vec3 sample_light(const Point3 &origin, Point2 u) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the Y
         // dimension a small amount.
@@ -61,27 +141,84 @@ public:
         return true;
     }
 
+private:
+    // Ray distance to the rectangle, if the ray crosses it within [t_min, t_max].
+    bool find_distance(const Ray &r, float t_min, float t_max, float &t) const;
+    void set_hit_record(float t, HitRecord &rec) const;
+
 public:
     shared_ptr<Material> mp;
     float x0, x1, z0, z1, k;
 };
 
 inline bool XZRectangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    auto t = (k - r.origin().y()) / r.direction().y();
-    if (t < t_min || t > t_max)
+    RT_STAT(rectangle_tests);
+    float t;
+    if (!find_distance(r, t_min, t_max, t))
+        return false;
+    set_hit_record(t, rec);
+    return true;
+}
+
+inline bool XZRectangle::occluded(const Ray &r, float t_min, float t_max) const {
+    RT_STAT(rectangle_tests);
+    float t;
+    return find_distance(r, t_min, t_max, t);
+}
+
+inline bool XZRectangle::find_distance(const Ray &r, float t_min, float t_max, float &t) const {
+    t = (k - r.origin().y()) / r.direction().y();
+    // Also rejects the NaN of a ray lying in the plane, 0 / 0.
+    if (!(t >= t_min && t <= t_max))
         return false;
     auto x = r.origin().x() + t * r.direction().x();
     auto z = r.origin().z() + t * r.direction().z();
     if (x < x0 || x > x1 || z < z0 || z > z1)
         return false;
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (z - z0) / (z1 - z0);
+    return true;
+}
+
+inline void XZRectangle::set_hit_record(float t, HitRecord &rec) const {
     rec.t = t;
+    rec.material_pointer = mp.get();
+    rec.object = this;
+}
+
+inline void XZRectangle::finalize_hit(const Ray &r, HitRecord &rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.x() - x0) / (x1 - x0);
+    rec.v = (rec.p.z() - z0) / (z1 - z0);
     auto outward_normal = Vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.material_pointer = mp;
-    rec.p = r.at(t);
-    return true;
+}
+
+inline PacketMask XZRectangle::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                          HitRecord *recs) const {
+    RT_STAT_ADD(rectangle_tests, std::popcount(mask));
+
+    // Same arithmetic as hit(), one lane per iteration so the loop vectorizes.
+    float ts[packet_width];
+    int valid[packet_width];
+
+    for (int i = 0; i < packet_width; ++i) {
+        const float t = (k - packet.origin[1][i]) / packet.direction[1][i];
+        const float x = packet.origin[0][i] + t * packet.direction[0][i];
+        const float z = packet.origin[2][i] + t * packet.direction[2][i];
+        ts[i] = t;
+        valid[i] = (t >= t_min && t <= packet.t_max[i]) && !(x < x0 || x > x1) &&
+                   !(z < z0 || z > z1);
+    }
+
+    PacketMask hits = 0;
+    for (int i = 0; i < packet_width; ++i) {
+        hits |= static_cast<PacketMask>(valid[i]) << i;
+    }
+    hits &= mask;
+    for_each_lane(hits, [&](int lane) {
+        set_hit_record(ts[lane], recs[lane]);
+        packet.t_max[lane] = ts[lane];
+    });
+    return hits;
 }
 
 class YZRectangle : public Hittable {
@@ -89,10 +226,21 @@ public:
     YZRectangle() {}
 
     YZRectangle(float _y0, float _y1, float _z0, float _z1, float _k, shared_ptr<Material> mat)
-        : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat){};
+        : mp(mat), y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k) {}
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    virtual bool is_light() const override { return mp->is_emissive(); }
+    virtual float light_pdf(const Point3 &origin, const Vec3 &direction) const override;
+    virtual Vec3 sample_light(const Point3 &origin, Point2 u) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
         // The bounding box must have non-zero width in each dimension, so pad the X
         // dimension a small amount.
@@ -100,27 +248,117 @@ public:
         return true;
     }
 
+private:
+    // Ray distance to the rectangle, if the ray crosses it within [t_min, t_max].
+    bool find_distance(const Ray &r, float t_min, float t_max, float &t) const;
+    void set_hit_record(float t, HitRecord &rec) const;
+
 public:
     shared_ptr<Material> mp;
     float y0, y1, z0, z1, k;
 };
 
 inline bool YZRectangle::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    auto t = (k - r.origin().x()) / r.direction().x();
-    if (t < t_min || t > t_max)
+    RT_STAT(rectangle_tests);
+    float t;
+    if (!find_distance(r, t_min, t_max, t))
+        return false;
+    set_hit_record(t, rec);
+    return true;
+}
+
+inline bool YZRectangle::occluded(const Ray &r, float t_min, float t_max) const {
+    RT_STAT(rectangle_tests);
+    float t;
+    return find_distance(r, t_min, t_max, t);
+}
+
+inline bool YZRectangle::find_distance(const Ray &r, float t_min, float t_max, float &t) const {
+    t = (k - r.origin().x()) / r.direction().x();
+    // Also rejects the NaN of a ray lying in the plane, 0 / 0.
+    if (!(t >= t_min && t <= t_max))
         return false;
     auto y = r.origin().y() + t * r.direction().y();
     auto z = r.origin().z() + t * r.direction().z();
     if (y < y0 || y > y1 || z < z0 || z > z1)
         return false;
-    rec.u = (y - y0) / (y1 - y0);
-    rec.v = (z - z0) / (z1 - z0);
+    return true;
+}
+
+inline void YZRectangle::set_hit_record(float t, HitRecord &rec) const {
     rec.t = t;
+    rec.material_pointer = mp.get();
+    rec.object = this;
+}
+
+inline void YZRectangle::finalize_hit(const Ray &r, HitRecord &rec) const {
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p.y() - y0) / (y1 - y0);
+    rec.v = (rec.p.z() - z0) / (z1 - z0);
     auto outward_normal = Vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.material_pointer = mp;
-    rec.p = r.at(t);
-    return true;
+}
+
+inline PacketMask YZRectangle::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                          HitRecord *recs) const {
+    RT_STAT_ADD(rectangle_tests, std::popcount(mask));
+
+    // Same arithmetic as hit(), one lane per iteration so the loop vectorizes.
+    float ts[packet_width];
+    int valid[packet_width];
+
+    for (int i = 0; i < packet_width; ++i) {
+        const float t = (k - packet.origin[0][i]) / packet.direction[0][i];
+        const float y = packet.origin[1][i] + t * packet.direction[1][i];
+        const float z = packet.origin[2][i] + t * packet.direction[2][i];
+        ts[i] = t;
+        valid[i] = (t >= t_min && t <= packet.t_max[i]) && !(y < y0 || y > y1) &&
+                   !(z < z0 || z > z1);
+    }
+
+    PacketMask hits = 0;
+    for (int i = 0; i < packet_width; ++i) {
+        hits |= static_cast<PacketMask>(valid[i]) << i;
+    }
+    hits &= mask;
+    for_each_lane(hits, [&](int lane) {
+        set_hit_record(ts[lane], recs[lane]);
+        packet.t_max[lane] = ts[lane];
+    });
+    return hits;
+}
+
+inline float XYRectangle::light_pdf(const Point3 &origin, const Vec3 &direction) const {
+    float t;
+    if (!find_distance(Ray(origin, direction), 10e-3, infinity, t))
+        return 0;
+    return area_light_pdf(t, direction, direction.z(), (x1 - x0) * (y1 - y0));
+}
+
+inline Vec3 XYRectangle::sample_light(const Point3 &origin, Point2 u) const {
+    return Point3(x0 + u.x * (x1 - x0), y0 + u.y * (y1 - y0), k) - origin;
+}
+
+inline float XZRectangle::light_pdf(const Point3 &origin, const Vec3 &direction) const {
+    float t;
+    if (!find_distance(Ray(origin, direction), 10e-3, infinity, t))
+        return 0;
+    return area_light_pdf(t, direction, direction.y(), (x1 - x0) * (z1 - z0));
+}
+
+inline Vec3 XZRectangle::sample_light(const Point3 &origin, Point2 u) const {
+    return Point3(x0 + u.x * (x1 - x0), k, z0 + u.y * (z1 - z0)) - origin;
+}
+
+inline float YZRectangle::light_pdf(const Point3 &origin, const Vec3 &direction) const {
+    float t;
+    if (!find_distance(Ray(origin, direction), 10e-3, infinity, t))
+        return 0;
+    return area_light_pdf(t, direction, direction.x(), (y1 - y0) * (z1 - z0));
+}
+
+inline Vec3 YZRectangle::sample_light(const Point3 &origin, Point2 u) const {
+    return Point3(k, y0 + u.x * (y1 - y0), z0 + u.y * (z1 - z0)) - origin;
 }
 
 #endif
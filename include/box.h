@@ -4,7 +4,6 @@
 #include "rtweekend.h"
 
 #include "aarectangle.h"
-#include "hittable_list.h"
 
 class Box : public Hittable {
 public:
@@ -13,6 +12,8 @@ public:
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
         output_box = aabb(box_min, box_max);
         return true;
@@ -21,25 +22,54 @@ public:
 public:
     Point3 box_min;
     Point3 box_max;
-    HittableList sides;
+
+private:
+    // The sides live in the box itself, so a box is one allocation rather than a list and six
+    // rectangles, and the calls to them are direct.
+    XYRectangle xy_sides_[2];
+    XZRectangle xz_sides_[2];
+    YZRectangle yz_sides_[2];
 };
 
 inline Box::Box(const Point3 &p0, const Point3 &p1, shared_ptr<Material> ptr) {
     box_min = p0;
     box_max = p1;
 
-    sides.add(make_shared<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-    sides.add(make_shared<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
+    xy_sides_[0] = XYRectangle(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr);
+    xy_sides_[1] = XYRectangle(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr);
 
-    sides.add(make_shared<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-    sides.add(make_shared<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
+    xz_sides_[0] = XZRectangle(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr);
+    xz_sides_[1] = XZRectangle(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr);
 
-    sides.add(make_shared<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-    sides.add(make_shared<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
+    yz_sides_[0] = YZRectangle(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr);
+    yz_sides_[1] = YZRectangle(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr);
 }
 
 inline bool Box::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    return sides.hit(r, t_min, t_max, rec);
+    // Each side sees the closest hit so far, in the order the sides used to be listed.
+    bool hit_anything = false;
+    const auto test = [&](const auto &side) {
+        if (side.hit(r, t_min, t_max, rec)) {
+            hit_anything = true;
+            t_max = rec.t;
+        }
+    };
+    test(xy_sides_[0]);
+    test(xy_sides_[1]);
+    test(xz_sides_[0]);
+    test(xz_sides_[1]);
+    test(yz_sides_[0]);
+    test(yz_sides_[1]);
+    return hit_anything;
+}
+
+inline bool Box::occluded(const Ray &r, float t_min, float t_max) const {
+    for (int i = 0; i < 2; ++i) {
+        if (xy_sides_[i].occluded(r, t_min, t_max) || xz_sides_[i].occluded(r, t_min, t_max) ||
+            yz_sides_[i].occluded(r, t_min, t_max))
+            return true;
+    }
+    return false;
 }
 
-#endif
\ No newline at end of file
+#endif
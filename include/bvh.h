@@ -3,100 +3,151 @@
 
 #include "rtweekend.h"
 
+#include "bvh_builder.h"
 #include "hittable.h"
 #include "hittable_list.h"
 
+#include <vector>
+
 class bvh_node : public Hittable {
 public:
-    bvh_node();
+    bvh_node() {}
 
-    bvh_node(const HittableList &list, float time0, float time1)
-        : bvh_node(list.objects, 0, list.objects.size(), time0, time1) {}
+    bvh_node(const HittableList &list, float time0, float time1,
+             const BvhBuildOptions &options = BvhBuildOptions())
+        : bvh_node(list.objects, 0, list.objects.size(), time0, time1, options) {}
 
     bvh_node(const std::vector<std::shared_ptr<Hittable>> &src_objects, size_t start, size_t end,
-             float time0, float time1);
+             float time0, float time1, const BvhBuildOptions &options = BvhBuildOptions());
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
 
+    // Build time and tree quality; only filled in on the root of a tree.
+    const BvhStats &stats() const { return stats_; }
+
+private:
+    bvh_node(const std::vector<shared_ptr<Hittable>> &objects, const BvhBuild &build,
+             uint32_t node_index);
+
+    static shared_ptr<Hittable> make_child(const std::vector<shared_ptr<Hittable>> &objects,
+                                           const BvhBuild &build, uint32_t node_index);
+
+    void init_leaf(const std::vector<shared_ptr<Hittable>> &objects, const BvhBuild &build,
+                   const BvhBuildNode &node);
+
 public:
     shared_ptr<Hittable> left;
     shared_ptr<Hittable> right;
+    // A leaf holds its primitives directly instead of children.
+    std::vector<shared_ptr<Hittable>> leaf_objects;
     aabb box;
-};
 
-inline bool box_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b, int axis) {
-    aabb box_a;
-    aabb box_b;
-
-    if (!a->bounding_box(0, 0, box_a) || !b->bounding_box(0, 0, box_b))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
+private:
+    BvhStats stats_;
+};
 
-    return box_a.aabb_min().e[axis] < box_b.aabb_min().e[axis];
-}
+inline bvh_node::bvh_node(const std::vector<shared_ptr<Hittable>> &src_objects, size_t start,
+                          size_t end, float time0, float time1, const BvhBuildOptions &options) {
+    std::vector<shared_ptr<Hittable>> objects(src_objects.begin() + start,
+                                              src_objects.begin() + end);
+
+    std::vector<aabb> boxes(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (!objects[i]->bounding_box(time0, time1, boxes[i]))
+            std::cerr << "No bounding box in bvh_node constructor.\n";
+    }
 
-inline bool box_x_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) {
-    return box_compare(a, b, 0);
-}
+    const BvhBuild build = build_sah_bvh(boxes, options);
+    stats_ = build.stats;
 
-inline bool box_y_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) {
-    return box_compare(a, b, 1);
-}
+    if (build.nodes.empty())
+        return;
 
-inline bool box_z_compare(const shared_ptr<Hittable> a, const shared_ptr<Hittable> b) {
-    return box_compare(a, b, 2);
+    const BvhBuildNode &root = build.nodes[0];
+    box = root.box;
+    if (root.count > 0) {
+        init_leaf(objects, build, root);
+    } else {
+        left = make_child(objects, build, 1);
+        right = make_child(objects, build, root.offset);
+    }
 }
 
-inline bvh_node::bvh_node(const std::vector<shared_ptr<Hittable>> &src_objects, size_t start,
-                          size_t end, float time0, float time1) {
-    auto objects = src_objects; // Create a modifiable array of the source scene objects
-
-    int axis = random_int(0, 2);
-    auto comparator = (axis == 0) ? box_x_compare : (axis == 1) ? box_y_compare : box_z_compare;
-
-    size_t object_span = end - start;
-
-    if (object_span == 1) {
-        left = right = objects[start];
-    } else if (object_span == 2) {
-        if (comparator(objects[start], objects[start + 1])) {
-            left = objects[start];
-            right = objects[start + 1];
-        } else {
-            left = objects[start + 1];
-            right = objects[start];
-        }
+inline bvh_node::bvh_node(const std::vector<shared_ptr<Hittable>> &objects,
+                          const BvhBuild &build, uint32_t node_index) {
+    const BvhBuildNode &node = build.nodes[node_index];
+    box = node.box;
+    if (node.count > 0) {
+        init_leaf(objects, build, node);
     } else {
-        std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-        auto mid = start + object_span / 2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+        left = make_child(objects, build, node_index + 1);
+        right = make_child(objects, build, node.offset);
     }
+}
 
-    aabb box_left, box_right;
+inline shared_ptr<Hittable> bvh_node::make_child(const std::vector<shared_ptr<Hittable>> &objects,
+                                                 const BvhBuild &build, uint32_t node_index) {
+    // A single-primitive leaf is just the primitive; skip the extra virtual call.
+    const BvhBuildNode &node = build.nodes[node_index];
+    if (node.count == 1)
+        return objects[build.indices[node.offset]];
 
-    if (!left->bounding_box(time0, time1, box_left) ||
-        !right->bounding_box(time0, time1, box_right))
-        std::cerr << "No bounding box in bvh_node constructor.\n";
+    return shared_ptr<bvh_node>(new bvh_node(objects, build, node_index));
+}
 
-    box = surrounding_box(box_left, box_right);
+inline void bvh_node::init_leaf(const std::vector<shared_ptr<Hittable>> &objects,
+                                const BvhBuild &build, const BvhBuildNode &node) {
+    leaf_objects.reserve(node.count);
+    for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        leaf_objects.push_back(objects[build.indices[i]]);
+    }
 }
 
 inline bool bvh_node::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    RT_STAT(bvh_nodes);
     if (!box.hit(r, t_min, t_max))
         return false;
 
+    if (!leaf_objects.empty()) {
+        bool hit_anything = false;
+        for (const auto &object : leaf_objects) {
+            if (object->hit(r, t_min, t_max, rec)) {
+                hit_anything = true;
+                t_max = rec.t;
+            }
+        }
+        return hit_anything;
+    }
+
     bool hit_left = left->hit(r, t_min, t_max, rec);
     bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
 
     return hit_left || hit_right;
 }
 
+inline bool bvh_node::occluded(const Ray &r, float t_min, float t_max) const {
+    RT_STAT(bvh_nodes);
+    if (!box.hit(r, t_min, t_max))
+        return false;
+
+    if (!leaf_objects.empty()) {
+        for (const auto &object : leaf_objects) {
+            if (object->occluded(r, t_min, t_max))
+                return true;
+        }
+        return false;
+    }
+
+    return left->occluded(r, t_min, t_max) || right->occluded(r, t_min, t_max);
+}
+
 inline bool bvh_node::bounding_box(float time0, float time1, aabb &output_box) const {
     output_box = box;
     return true;
 }
 
-#endif
\ No newline at end of file
+#endif
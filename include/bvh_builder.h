@@ -0,0 +1,304 @@
+#ifndef BVH_BUILDER_H
+#define BVH_BUILDER_H
+
+#include "aabb.h"
+#include "rtweekend.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// No leaf of a built tree lies deeper than this, the root being at depth 1, so traversal
+// stacks sized by it cannot overflow.
+constexpr int bvh_max_depth = 64;
+
+struct BvhBuildOptions {
+    int max_leaf_size = 4;         // leaves never hold more primitives than this
+    int max_depth = bvh_max_depth; // at most bvh_max_depth, and raised to what n needs
+    int bin_count = 16;            // SAH candidates per axis are the bin boundaries
+    float traversal_cost = 1.0;    // cost of testing one node's box, relative to...
+    float intersection_cost = 1.0; // ...the cost of intersecting one primitive
+};
+
+// One node of a built tree, in depth-first order: the first child of an interior node is
+// always the node right after it, so only the second child's position is stored.
+struct BvhBuildNode {
+    aabb box;
+    uint32_t offset; // interior: index of the second child; leaf: first entry in indices
+    uint16_t count;  // number of primitives in a leaf, 0 for interior nodes
+    uint8_t axis;    // split axis of an interior node
+};
+
+struct BvhStats {
+    double build_ms = 0.0;
+    int primitive_count = 0;
+    int node_count = 0;
+    int leaf_count = 0;
+    int max_depth = 0;
+    int min_leaf_size = 0;
+    int max_leaf_size = 0;
+    float average_leaf_size = 0.0;
+    // Expected cost of a random ray against the tree, by the surface area heuristic.
+    float sah_cost = 0.0;
+
+    void print(std::ostream &out) const {
+        out << "BVH: " << primitive_count << " primitives, " << node_count << " nodes, "
+            << leaf_count << " leaves (size " << min_leaf_size << ".." << max_leaf_size
+            << ", avg " << average_leaf_size << "), depth " << max_depth << ", SAH cost "
+            << sah_cost << ", built in " << build_ms << " ms\n";
+    }
+};
+
+struct BvhBuild {
+    std::vector<BvhBuildNode> nodes;
+    std::vector<uint32_t> indices; // primitive indices, grouped by leaf
+    BvhStats stats;
+};
+
+// Binned surface-area-heuristic builder. Works on a single index array that is partitioned
+// in place, so no per-level copies of the primitive list are made.
+class SahBvhBuilder {
+public:
+    SahBvhBuilder(const std::vector<aabb> &boxes, const BvhBuildOptions &options)
+        : boxes_(boxes), options_(options) {
+        options_.max_leaf_size = std::clamp(options_.max_leaf_size, 1, 0xffff);
+        options_.bin_count = std::clamp(options_.bin_count, 2, max_bins);
+        // Halving the range at every level fits any count below 2^32 into 33 levels.
+        const int needed = 1 + levels_to_single(static_cast<uint32_t>(boxes_.size()));
+        options_.max_depth = std::clamp(options_.max_depth, needed, bvh_max_depth);
+    }
+
+    BvhBuild build();
+
+private:
+    static constexpr int max_bins = 64;
+
+    struct Bin {
+        aabb box;
+        int count = 0;
+    };
+
+    void build_recursive(uint32_t begin, uint32_t end, int depth);
+    void make_leaf(uint32_t node, uint32_t begin, uint32_t end, int depth);
+
+    // Median splits down to one primitive per leaf.
+    static int levels_to_single(uint32_t count) {
+        return count > 1 ? std::bit_width(count - 1) : 0;
+    }
+
+    static void grow(aabb &box, const aabb &other, bool &empty) {
+        box = empty ? other : surrounding_box(box, other);
+        empty = false;
+    }
+
+private:
+    const std::vector<aabb> &boxes_;
+    BvhBuildOptions options_;
+    std::vector<Point3> centroids_;
+    BvhBuild result_;
+    float leaf_area_sum_ = 0.0;     // sum of count * area over leaves
+    float interior_area_sum_ = 0.0; // sum of area over interior nodes
+};
+
+inline BvhBuild SahBvhBuilder::build() {
+    const auto start = std::chrono::steady_clock::now();
+
+    result_ = BvhBuild();
+    leaf_area_sum_ = interior_area_sum_ = 0.0;
+
+    const auto count = static_cast<uint32_t>(boxes_.size());
+    centroids_.resize(count);
+    result_.indices.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        centroids_[i] = boxes_[i].centroid();
+        result_.indices[i] = i;
+    }
+
+    // A binary tree with leaves of at least one primitive has at most 2n - 1 nodes.
+    result_.nodes.reserve(count > 0 ? 2 * count - 1 : 0);
+    result_.stats.min_leaf_size = count;
+
+    if (count > 0)
+        build_recursive(0, count, 1);
+
+    BvhStats &stats = result_.stats;
+    stats.primitive_count = count;
+    stats.node_count = static_cast<int>(result_.nodes.size());
+    if (stats.leaf_count > 0)
+        stats.average_leaf_size = static_cast<float>(count) / stats.leaf_count;
+
+    if (count > 0) {
+        const float root_area = result_.nodes[0].box.surface_area();
+        if (root_area > 0) {
+            stats.sah_cost = (options_.traversal_cost * interior_area_sum_ +
+                              options_.intersection_cost * leaf_area_sum_) /
+                             root_area;
+        }
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    stats.build_ms = elapsed.count();
+
+    return std::move(result_);
+}
+
+inline void SahBvhBuilder::make_leaf(uint32_t node, uint32_t begin, uint32_t end, int depth) {
+    const auto count = end - begin;
+    BvhBuildNode &leaf = result_.nodes[node];
+    leaf.offset = begin;
+    leaf.count = static_cast<uint16_t>(count);
+    leaf.axis = 0;
+
+    BvhStats &stats = result_.stats;
+    stats.leaf_count += 1;
+    stats.max_depth = std::max(stats.max_depth, depth);
+    stats.min_leaf_size = std::min(stats.min_leaf_size, static_cast<int>(count));
+    stats.max_leaf_size = std::max(stats.max_leaf_size, static_cast<int>(count));
+    leaf_area_sum_ += count * leaf.box.surface_area();
+}
+
+inline void SahBvhBuilder::build_recursive(uint32_t begin, uint32_t end, int depth) {
+    auto &indices = result_.indices;
+
+    const auto node = static_cast<uint32_t>(result_.nodes.size());
+    result_.nodes.push_back(BvhBuildNode());
+
+    aabb bounds, centroid_bounds;
+    bool empty = true, centroid_empty = true;
+    for (uint32_t i = begin; i < end; ++i) {
+        grow(bounds, boxes_[indices[i]], empty);
+        grow(centroid_bounds, aabb(centroids_[indices[i]], centroids_[indices[i]]),
+             centroid_empty);
+    }
+    result_.nodes[node].box = bounds;
+
+    const uint32_t count = end - begin;
+    if (count == 1) {
+        make_leaf(node, begin, end, depth);
+        return;
+    }
+
+    // Once the range could no longer be halved down to single primitives within
+    // options_.max_depth, the SAH is dropped and the range is split at the median centroid,
+    // which keeps that possible at every level below.
+    const bool median_split = depth + levels_to_single(count) >= options_.max_depth;
+
+    // Find the cheapest bin boundary over all three axes.
+    const int bin_count = options_.bin_count;
+    const float parent_area = bounds.surface_area();
+    float best_cost = infinity;
+    int best_axis = -1;
+    int best_split = 0;
+
+    for (int axis = 0; axis < 3 && !median_split; ++axis) {
+        const float lo = centroid_bounds.aabb_min()[axis];
+        const float extent = centroid_bounds.aabb_max()[axis] - lo;
+        if (!(extent > 0) || !std::isfinite(extent))
+            continue;
+
+        Bin bins[max_bins];
+        bool bin_empty[max_bins];
+        std::fill(bin_empty, bin_empty + bin_count, true);
+
+        const float scale = bin_count / extent;
+        for (uint32_t i = begin; i < end; ++i) {
+            const int b = std::min(bin_count - 1,
+                                   static_cast<int>((centroids_[indices[i]][axis] - lo) * scale));
+            grow(bins[b].box, boxes_[indices[i]], bin_empty[b]);
+            bins[b].count += 1;
+        }
+
+        // Sweep from the right to get the area and count to the right of every boundary.
+        float right_area[max_bins];
+        int right_count[max_bins];
+        aabb right_box;
+        bool right_empty = true;
+        int running = 0;
+        for (int b = bin_count - 1; b > 0; --b) {
+            if (!bin_empty[b])
+                grow(right_box, bins[b].box, right_empty);
+            running += bins[b].count;
+            right_count[b] = running;
+            right_area[b] = right_empty ? 0.0f : right_box.surface_area();
+        }
+
+        aabb left_box;
+        bool left_empty = true;
+        running = 0;
+        for (int b = 0; b < bin_count - 1; ++b) {
+            if (!bin_empty[b])
+                grow(left_box, bins[b].box, left_empty);
+            running += bins[b].count;
+            if (running == 0 || right_count[b + 1] == 0)
+                continue;
+
+            const float left_area = left_box.surface_area();
+            const float cost = options_.traversal_cost +
+                               options_.intersection_cost *
+                                   (left_area * running + right_area[b + 1] * right_count[b + 1]) /
+                                   parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = b;
+            }
+        }
+    }
+
+    const float leaf_cost = options_.intersection_cost * count;
+    if (count <= static_cast<uint32_t>(options_.max_leaf_size) &&
+        (best_axis < 0 || best_cost >= leaf_cost)) {
+        make_leaf(node, begin, end, depth);
+        return;
+    }
+
+    uint32_t mid = begin + count / 2;
+    if (median_split) {
+        const Vec3 extent = centroid_bounds.aabb_max() - centroid_bounds.aabb_min();
+        best_axis = 0;
+        for (int axis = 1; axis < 3; ++axis) {
+            if (extent[axis] > extent[best_axis])
+                best_axis = axis;
+        }
+        auto first = indices.begin();
+        std::nth_element(first + begin, first + mid, first + end, [&](uint32_t a, uint32_t b) {
+            return centroids_[a][best_axis] < centroids_[b][best_axis];
+        });
+    } else if (best_axis >= 0) {
+        const float lo = centroid_bounds.aabb_min()[best_axis];
+        const float scale = bin_count / (centroid_bounds.aabb_max()[best_axis] - lo);
+        auto first = indices.begin();
+        mid = static_cast<uint32_t>(
+            std::partition(first + begin, first + end,
+                           [&](uint32_t index) {
+                               const int b = std::min(
+                                   bin_count - 1,
+                                   static_cast<int>((centroids_[index][best_axis] - lo) * scale));
+                               return b <= best_split;
+                           }) -
+            first);
+    }
+    // Every centroid coincides (or the bins collapsed): any split is as good as another,
+    // so halve the range to keep leaves within max_leaf_size.
+    if (mid == begin || mid == end)
+        mid = begin + count / 2;
+
+    interior_area_sum_ += parent_area;
+    result_.nodes[node].count = 0;
+    result_.nodes[node].axis = static_cast<uint8_t>(best_axis < 0 ? 0 : best_axis);
+
+    build_recursive(begin, mid, depth + 1);
+    result_.nodes[node].offset = static_cast<uint32_t>(result_.nodes.size());
+    build_recursive(mid, end, depth + 1);
+}
+
+inline BvhBuild build_sah_bvh(const std::vector<aabb> &boxes,
+                              const BvhBuildOptions &options = BvhBuildOptions()) {
+    return SahBvhBuilder(boxes, options).build();
+}
+
+#endif
@@ -3,6 +3,30 @@
 
 #include "rtweekend.h"
 
+#include "ray_packet.h"
+#include "sampler.h"
+
+// The sample values of a batch of camera rays, one lane per ray: the film position, s from
+// left to right and t from bottom to top, and samples in [0, 1) for the lens and the time.
+struct CameraSamples {
+    float s[packet_width];
+    float t[packet_width];
+    float lens_x[packet_width];
+    float lens_y[packet_width];
+    float time[packet_width];
+
+    // Takes the lens and time samples of a lane from the calling thread's sampler, in the
+    // order get_ray() takes them.
+    void draw(int lane, float lane_s, float lane_t) {
+        s[lane] = lane_s;
+        t[lane] = lane_t;
+        const Point2 lens = sample_2d();
+        lens_x[lane] = lens.x;
+        lens_y[lane] = lens.y;
+        time[lane] = sample_1d();
+    }
+};
+
 // implements a simple camera using the axis-aligned camera
 class Camera {
 public:
@@ -31,17 +55,31 @@ public:
 
         viewport_height_ = viewport_height;
         viewport_width_ = viewport_width;
-        lens_offset_ = lens_radius_ * random_in_unit_disk();
     }
 
+    // The ray through film position (s, t), with the lens point and the time taken from the
+    // calling thread's sampler. Every ray samples the lens on its own, which is what blurs the
+    // parts of the scene away from the focus distance.
     Ray get_ray(float s, float t) const {
-        Vec3 offset = u * lens_offset_.x() + v * lens_offset_.y();
+        const Point2 lens = sample_2d();
+        return get_ray(s, t, lens, sample_1d());
+    }
 
+    Ray get_ray(float s, float t, Point2 lens_sample, float time_sample) const {
+        const Vec3 disk = lens_radius_ * square_to_disk(lens_sample);
+        const Vec3 offset = u * disk.x() + v * disk.y();
         return Ray(origin_ + offset,
                    lower_left_corner_ + s * horizontal_ + t * vertical_ - origin_ - offset,
-                   random_float(time0_, time1_));
+                   time0_ + (time1_ - time0_) * time_sample);
     }
 
+    // The rays of all lanes, written straight into the packet with t_max infinity. The lanes
+    // are computed side by side in plain loops the compiler vectorizes, and a pinhole camera
+    // skips the lens mapping. Each lane gets the ray get_ray() would return for the same
+    // samples, bit for bit. Lanes the caller has no samples for are computed from whatever
+    // samples holds, zero-initialized for the renderer, and are left out by its mask.
+    void get_rays(const CameraSamples &samples, RayPacket &packet) const;
+
 private:
     Point3 origin_;
     Point3 lower_left_corner_;
@@ -53,6 +91,45 @@ private:
     
     float viewport_height_;
     float viewport_width_;
-    Vec3 lens_offset_;
 };
+
+inline void Camera::get_rays(const CameraSamples &samples, RayPacket &packet) const {
+    // Full-width loops: they vectorize where loops over a mask of lanes would not.
+    float lens_u[packet_width] = {};
+    float lens_v[packet_width] = {};
+    if (lens_radius_ > 0) {
+        const float radius = lens_radius_;
+        for (int lane = 0; lane < packet_width; ++lane) {
+            float disk_x, disk_y;
+            concentric_disk(samples.lens_x[lane], samples.lens_y[lane], disk_x, disk_y);
+            lens_u[lane] = radius * disk_x;
+            lens_v[lane] = radius * disk_y;
+        }
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        // Loaded up front: the packet could alias the camera as far as the compiler knows.
+        const float origin = origin_[a];
+        const float corner = lower_left_corner_[a];
+        const float horizontal = horizontal_[a];
+        const float vertical = vertical_[a];
+        const float lens_axis_u = u[a];
+        const float lens_axis_v = v[a];
+        for (int lane = 0; lane < packet_width; ++lane) {
+            const float offset = lens_axis_u * lens_u[lane] + lens_axis_v * lens_v[lane];
+            const float direction = corner + samples.s[lane] * horizontal +
+                                    samples.t[lane] * vertical - origin - offset;
+            packet.origin[a][lane] = origin + offset;
+            packet.direction[a][lane] = direction;
+            packet.inv_dir[a][lane] = 1 / direction;
+        }
+    }
+
+    const float time0 = time0_;
+    const float time_span = time1_ - time0_;
+    for (int lane = 0; lane < packet_width; ++lane) {
+        packet.time[lane] = time0 + time_span * samples.time[lane];
+        packet.t_max[lane] = infinity;
+    }
+}
 #endif
\ No newline at end of file
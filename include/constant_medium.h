@@ -11,23 +11,34 @@ class ConstantMedium : public Hittable {
     public:
         ConstantMedium(shared_ptr<Hittable> b, float d, shared_ptr<Texture> a)
             : boundary(b),
-              neg_inv_density(-1/d),
-              phase_function(make_shared<Isotropic>(a))
+              phase_function(make_shared<Isotropic>(a)),
+              neg_inv_density(-1/d)
             {}
 
         ConstantMedium(shared_ptr<Hittable> b, float d, Color c)
             : boundary(b),
-              neg_inv_density(-1/d),
-              phase_function(make_shared<Isotropic>(c))
+              phase_function(make_shared<Isotropic>(c)),
+              neg_inv_density(-1/d)
             {}
 
         virtual bool hit(
             const Ray& r, float t_min, float t_max, HitRecord& rec) const override;
 
+        // Draws the scattering distance like hit() does, so a shadow ray is blocked by the
+        // medium with the probability that the light is attenuated.
+        virtual bool occluded(const Ray& r, float t_min, float t_max) const override;
+
         virtual bool bounding_box(float time0, float time1, aabb& output_box) const override {
             return boundary->bounding_box(time0, time1, output_box);
         }
 
+        // The scattering distance comes from the sampler.
+        virtual bool draws_samples() const override { return true; }
+
+    private:
+        // Samples where in [t_min, t_max] the ray scatters inside the medium, if it does.
+        bool sample_distance(const Ray& r, float t_min, float t_max, float& t) const;
+
     public:
         shared_ptr<Hittable> boundary;
         shared_ptr<Material> phase_function;
@@ -35,6 +46,29 @@ class ConstantMedium : public Hittable {
 };
 
 inline bool ConstantMedium::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
+    RT_STAT(medium_tests);
+
+    float t;
+    if (!sample_distance(r, t_min, t_max, t))
+        return false;
+
+    rec.t = t;
+    rec.p = r.at(rec.t);
+    rec.normal = Vec3(1,0,0);  // arbitrary
+    rec.front_face = true;     // also arbitrary
+    rec.material_pointer = phase_function.get();
+    rec.object = nullptr;      // nothing left to finalize
+
+    return true;
+}
+
+inline bool ConstantMedium::occluded(const Ray& r, float t_min, float t_max) const {
+    RT_STAT(medium_tests);
+    float t;
+    return sample_distance(r, t_min, t_max, t);
+}
+
+inline bool ConstantMedium::sample_distance(const Ray& r, float t_min, float t_max, float& t) const {
     // Print occasional samples when debugging. To enable, set enableDebug true.
     const bool enableDebug = false;
     const bool debugging = enableDebug && random_float() < 0.00001;
@@ -60,24 +94,19 @@ inline bool ConstantMedium::hit(const Ray& r, float t_min, float t_max, HitRecor
 
     const auto ray_length = r.direction().length();
     const auto distance_inside_boundary = (rec2.t - rec1.t) * ray_length;
-    const auto hit_distance = neg_inv_density * log(random_float());
+    const auto hit_distance = neg_inv_density * log(sample_1d());
 
     if (hit_distance > distance_inside_boundary)
         return false;
 
-    rec.t = rec1.t + hit_distance / ray_length;
-    rec.p = r.at(rec.t);
+    t = rec1.t + hit_distance / ray_length;
 
     if (debugging) {
         std::cerr << "hit_distance = " <<  hit_distance << '\n'
-                  << "rec.t = " <<  rec.t << '\n'
-                  << "rec.p = " <<  rec.p << '\n';
+                  << "t = " <<  t << '\n'
+                  << "p = " <<  r.at(t) << '\n';
     }
 
-    rec.normal = Vec3(1,0,0);  // arbitrary
-    rec.front_face = true;     // also arbitrary
-    rec.material_pointer = phase_function;
-
     return true;
 }
 
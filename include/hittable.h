@@ -2,15 +2,27 @@
 #define Hittable_H
 
 #include "aabb.h"
+#include "ray_packet.h"
+#include "render_stats.h"
 #include "rtweekend.h"
+#include "sampler.h"
 
 class Material;
 
+class Hittable;
+
 struct HitRecord {
     Point3 p;
     Vec3 normal;
-    // Hittables and materials need to know each other
-    shared_ptr<Material> material_pointer;
+    // Hittables and materials need to know each other. Not owning: the scene keeps its
+    // materials alive, and copying a pointer costs no atomic reference count update.
+    const Material *material_pointer = nullptr;
+    // Primitives only store t and the material while searching for the closest hit. The one
+    // that wins is recorded here and fills in p, normal and uv in finalize().
+    const Hittable *object = nullptr;
+    uint32_t primitive = 0; // which primitive of object, for objects holding several
+    // When object is an Instance, the object hit inside it, which it finalizes in its own space.
+    const Hittable *instanced = nullptr;
     float t;
     float u;
     float v;
@@ -20,6 +32,9 @@ struct HitRecord {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // Computes the surface data of the closest hit; call once the search is over.
+    void finalize(const Ray &r);
 };
 
 // an “abstract class” for anything a ray might hit
@@ -27,120 +42,66 @@ class Hittable {
 public:
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const = 0;
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const = 0;
-};
-
-class translate : public Hittable {
-public:
-    translate(shared_ptr<Hittable> p, const Vec3 &displacement) : ptr(p), offset(displacement) {}
 
-    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
-
-    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
-
-public:
-    shared_ptr<Hittable> ptr;
-    Vec3 offset;
+    // Whether anything is hit in [t_min, t_max]. Returns at the first hit found, whichever it
+    // is, and fills in no record, so shadow rays need not search for the closest hit. The
+    // default falls back to hit().
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const;
+
+    // Traces the lanes of packet set in mask. Returns the lanes that hit something closer than
+    // their packet.t_max, with the records in recs and t_max lowered to the hit distance.
+    // The default traces the lanes one by one.
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const;
+
+    // Fills in p, normal, front_face and uv of a hit whose record names this object.
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const {}
+
+    // Whether hit() draws from the thread's sampler, as a participating medium does. A packet
+    // is traversed under the sampler of one lane, so the renderer traces the first hits of a
+    // scene with such objects at its top level one ray at a time.
+    virtual bool draws_samples() const { return false; }
+
+    // Area light sampling, for emitting shapes that support it. sample_light() maps u to a
+    // uniformly distributed point of the shape and returns the direction from origin to it,
+    // long enough to reach it; light_pdf() is the solid angle density of direction under
+    // that sampling, 0 if the ray from origin misses the shape.
+    virtual bool is_light() const { return false; }
+    virtual float light_pdf(const Point3 &origin, const Vec3 &direction) const { return 0; }
+    virtual Vec3 sample_light(const Point3 &origin, Point2 u) const { return Vec3(0, 0, 0); }
 };
 
-inline bool translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    Ray moved_r(r.origin() - offset, r.direction(), r.time());
-    if (!ptr->hit(moved_r, t_min, t_max, rec))
-        return false;
-
-    rec.p += offset;
-    rec.set_face_normal(moved_r, rec.normal);
-
-    return true;
+// Solid angle density of a point sampled uniformly on a flat shape of the given area, seen
+// along direction at ray distance t; direction_normal is the component of direction along
+// the normal of the shape.
+inline float area_light_pdf(float t, const Vec3 &direction, float direction_normal, float area) {
+    const float distance_squared = t * t * direction.length_squared();
+    const float cosine = std::fabs(direction_normal) / direction.length();
+    return cosine > 0 ? distance_squared / (cosine * area) : 0.0f;
 }
 
-inline bool translate::bounding_box(float time0, float time1, aabb &output_box) const {
-    if (!ptr->bounding_box(time0, time1, output_box))
-        return false;
-
-    output_box = aabb(output_box.aabb_min() + offset, output_box.aabb_max() + offset);
-
-    return true;
-}
-
-class RotateY : public Hittable {
-public:
-    RotateY(shared_ptr<Hittable> p, float angle);
-
-    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
-
-    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
-        output_box = bbox;
-        return hasbox;
+inline void HitRecord::finalize(const Ray &r) {
+    if (object) {
+        object->finalize_hit(r, *this);
+        object = nullptr;
     }
-
-public:
-    shared_ptr<Hittable> ptr;
-    float sin_theta;
-    float cos_theta;
-    bool hasbox;
-    aabb bbox;
-};
-
-inline RotateY::RotateY(shared_ptr<Hittable> p, float angle) : ptr(p) {
-    auto radians = degrees_to_radians(angle);
-    sin_theta = sin(radians);
-    cos_theta = cos(radians);
-    hasbox = ptr->bounding_box(0, 1, bbox);
-
-    Point3 rotatey_min(infinity, infinity, infinity);
-    Point3 rotatey_max(-infinity, -infinity, -infinity);
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < 2; k++) {
-                auto x = i * bbox.aabb_max().x() + (1 - i) * bbox.aabb_min().x();
-                auto y = j * bbox.aabb_max().y() + (1 - j) * bbox.aabb_min().y();
-                auto z = k * bbox.aabb_max().z() + (1 - k) * bbox.aabb_min().z();
-
-                auto newx = cos_theta * x + sin_theta * z;
-                auto newz = -sin_theta * x + cos_theta * z;
-
-                Vec3 tester(newx, y, newz);
-
-                for (int c = 0; c < 3; c++) {
-                    rotatey_min[c] = fmin(rotatey_min[c], tester[c]);
-                    rotatey_max[c] = fmax(rotatey_max[c], tester[c]);
-                }
-            }
-        }
-    }
-
-    bbox = aabb(rotatey_min, rotatey_max);
 }
 
-inline bool RotateY::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    auto origin = r.origin();
-    auto direction = r.direction();
-
-    origin[0] = cos_theta * r.origin()[0] - sin_theta * r.origin()[2];
-    origin[2] = sin_theta * r.origin()[0] + cos_theta * r.origin()[2];
-
-    direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
-    direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
-
-    Ray rotated_r(origin, direction, r.time());
-
-    if (!ptr->hit(rotated_r, t_min, t_max, rec))
-        return false;
-
-    auto p = rec.p;
-    auto normal = rec.normal;
-
-    p[0] = cos_theta * rec.p[0] + sin_theta * rec.p[2];
-    p[2] = -sin_theta * rec.p[0] + cos_theta * rec.p[2];
-
-    normal[0] = cos_theta * rec.normal[0] + sin_theta * rec.normal[2];
-    normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
-
-    rec.p = p;
-    rec.set_face_normal(rotated_r, normal);
+inline bool Hittable::occluded(const Ray &r, float t_min, float t_max) const {
+    HitRecord rec;
+    return hit(r, t_min, t_max, rec);
+}
 
-    return true;
+inline PacketMask Hittable::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                       HitRecord *recs) const {
+    PacketMask hits = 0;
+    for_each_lane(mask, [&](int lane) {
+        if (hit(packet.ray(lane), t_min, packet.t_max[lane], recs[lane])) {
+            packet.t_max[lane] = recs[lane].t;
+            hits |= 1u << lane;
+        }
+    });
+    return hits;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -22,29 +22,51 @@ public:
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
 
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
 
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
 public:
     std::vector<std::shared_ptr<Hittable>> objects;
 };
 
 inline bool HittableList::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    HitRecord temp_rec;
     bool hit_anything = false;
     // z-buffer
     auto closest_so_far = t_max;
 
+    // Objects only write rec when they find a closer hit, so no temporary record is needed.
     for (const auto &object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
     return hit_anything;
 }
 
+inline bool HittableList::occluded(const Ray &r, float t_min, float t_max) const {
+    for (const auto &object : objects) {
+        if (object->occluded(r, t_min, t_max))
+            return true;
+    }
+    return false;
+}
+
+inline PacketMask HittableList::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                           HitRecord *recs) const {
+    // Every object sees the t_max left by the previous ones, like the z-buffer in hit().
+    PacketMask hits = 0;
+    for (const auto &object : objects) {
+        hits |= object->hit_packet(packet, mask, t_min, recs);
+    }
+    return hits;
+}
+
 inline bool HittableList::bounding_box(float time0, float time1, aabb &output_box) const {
     if (objects.empty())
         return false;
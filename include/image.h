@@ -0,0 +1,39 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "rtweekend.h"
+
+#include <vector>
+
+// A rendered frame in linear radiance, one Color per pixel. Row 0 is the bottom of the image,
+// the same orientation the renderer loops over.
+class Image {
+public:
+    Image() {}
+    Image(int width, int height) : width_(width), height_(height), pixels_(width * height) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    Color &at(int x, int y) { return pixels_[static_cast<size_t>(y) * width_ + x]; }
+    const Color &at(int x, int y) const { return pixels_[static_cast<size_t>(y) * width_ + x]; }
+
+    // The pixels of row y, left to right.
+    const Color *row(int y) const { return &pixels_[static_cast<size_t>(y) * width_]; }
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<Color> pixels_;
+};
+
+// Gamma 2 encoding of a linear value, quantized the way write_color() always has.
+inline unsigned char to_byte(float linear) {
+    return static_cast<unsigned char>(255.999 * clamp(sqrt(linear), 0.0, 0.999));
+}
+
+inline unsigned short to_word(float linear) {
+    return static_cast<unsigned short>(65535.0f * clamp(sqrt(linear), 0.0, 1.0) + 0.5f);
+}
+
+#endif
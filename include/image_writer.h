@@ -0,0 +1,359 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "image.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class ImageFormat {
+    ppm_ascii, // P3, 8 bits per channel as text
+    ppm,       // P6, 8 bits per channel
+    png16,     // 16 bits per channel
+    pfm,       // 32-bit linear floats, no gamma
+};
+
+// Encodes an Image into one file format. Writers build whole scanlines in memory and hand
+// each to the stream with a single write().
+class ImageWriter {
+public:
+    virtual ~ImageWriter() = default;
+
+    virtual bool write(const Image &image, std::ostream &out) const = 0;
+    virtual const char *extension() const = 0;
+};
+
+class PpmWriter : public ImageWriter {
+public:
+    explicit PpmWriter(bool binary = true) : binary_(binary) {}
+
+    virtual bool write(const Image &image, std::ostream &out) const override;
+    virtual const char *extension() const override { return ".ppm"; }
+
+private:
+    bool binary_;
+};
+
+// Plain 16-bit RGB PNG. The image data goes into stored (uncompressed) deflate blocks, so no
+// compression library is needed; the file is bigger than a compressed PNG but lossless.
+class Png16Writer : public ImageWriter {
+public:
+    virtual bool write(const Image &image, std::ostream &out) const override;
+    virtual const char *extension() const override { return ".png"; }
+
+private:
+    static void write_chunk(std::ostream &out, const char type[4], const uint8_t *data,
+                            size_t size);
+};
+
+// Portable float map: linear radiance, bottom row first, in the byte order of the host.
+class PfmWriter : public ImageWriter {
+public:
+    virtual bool write(const Image &image, std::ostream &out) const override;
+    virtual const char *extension() const override { return ".pfm"; }
+};
+
+inline std::unique_ptr<ImageWriter> make_image_writer(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::ppm_ascii:
+        return std::make_unique<PpmWriter>(false);
+    case ImageFormat::png16:
+        return std::make_unique<Png16Writer>();
+    case ImageFormat::pfm:
+        return std::make_unique<PfmWriter>();
+    case ImageFormat::ppm:
+    default:
+        return std::make_unique<PpmWriter>(true);
+    }
+}
+
+// Picks the format from the file extension; anything unknown is written as binary PPM.
+inline ImageFormat image_format_for_path(const std::string &path) {
+    const auto ends_with = [&](const char *suffix) {
+        const size_t n = std::strlen(suffix);
+        return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(".png"))
+        return ImageFormat::png16;
+    if (ends_with(".pfm"))
+        return ImageFormat::pfm;
+    return ImageFormat::ppm;
+}
+
+inline bool write_image(const Image &image, const std::string &path, const ImageWriter &writer) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not open " << path << " for writing.\n";
+        return false;
+    }
+    if (!writer.write(image, out) || !out.flush()) {
+        std::cerr << "Could not write " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+inline bool write_image(const Image &image, const std::string &path) {
+    return write_image(image, path, *make_image_writer(image_format_for_path(path)));
+}
+
+inline bool PpmWriter::write(const Image &image, std::ostream &out) const {
+    const int width = image.width();
+    out << (binary_ ? "P6\n" : "P3\n") << width << ' ' << image.height() << "\n255\n";
+
+    std::vector<char> line;
+    for (int y = image.height() - 1; y >= 0; --y) {
+        const Color *row = image.row(y);
+        line.clear();
+
+        if (binary_) {
+            line.resize(static_cast<size_t>(width) * 3);
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    line[3 * x + c] = static_cast<char>(to_byte(row[x][c]));
+                }
+            }
+        } else {
+            // "255 255 255\n" is the longest a pixel gets.
+            line.resize(static_cast<size_t>(width) * 12);
+            char *cursor = line.data();
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    cursor = std::to_chars(cursor, cursor + 3, unsigned{to_byte(row[x][c])}).ptr;
+                    *cursor++ = c < 2 ? ' ' : '\n';
+                }
+            }
+            line.resize(cursor - line.data());
+        }
+
+        out.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+    return static_cast<bool>(out);
+}
+
+namespace png_detail {
+
+inline const std::array<uint32_t, 256> &crc_table() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+inline uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    const auto &table = crc_table();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+inline void put_u32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+} // namespace png_detail
+
+inline void Png16Writer::write_chunk(std::ostream &out, const char type[4], const uint8_t *data,
+                                     size_t size) {
+    std::vector<uint8_t> header;
+    png_detail::put_u32(header, static_cast<uint32_t>(size));
+    header.insert(header.end(), type, type + 4);
+
+    uint32_t crc = png_detail::crc32(0xffffffffu, header.data() + 4, 4);
+    crc = png_detail::crc32(crc, data, size) ^ 0xffffffffu;
+
+    std::vector<uint8_t> trailer;
+    png_detail::put_u32(trailer, crc);
+
+    out.write(reinterpret_cast<const char *>(header.data()), header.size());
+    out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+    out.write(reinterpret_cast<const char *>(trailer.data()), trailer.size());
+}
+
+inline bool Png16Writer::write(const Image &image, std::ostream &out) const {
+    const int width = image.width();
+    const int height = image.height();
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<uint8_t> ihdr;
+    png_detail::put_u32(ihdr, width);
+    png_detail::put_u32(ihdr, height);
+    ihdr.push_back(16); // bit depth
+    ihdr.push_back(2);  // color type: RGB
+    ihdr.push_back(0);  // compression: deflate
+    ihdr.push_back(0);  // filter method
+    ihdr.push_back(0);  // no interlace
+    write_chunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+    // Raw scanlines, top row first, each led by filter type 0 and holding big-endian samples.
+    const size_t line_size = 1 + static_cast<size_t>(width) * 6;
+    std::vector<uint8_t> raw(line_size * height);
+    for (int y = height - 1, line = 0; y >= 0; --y, ++line) {
+        const Color *row = image.row(y);
+        uint8_t *dst = &raw[line * line_size];
+        *dst++ = 0;
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                const unsigned short value = to_word(row[x][c]);
+                *dst++ = static_cast<uint8_t>(value >> 8);
+                *dst++ = static_cast<uint8_t>(value);
+            }
+        }
+    }
+
+    // zlib stream: header, stored blocks of at most 65535 bytes, Adler-32 of the raw data.
+    constexpr size_t max_block = 65535;
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / max_block * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    for (size_t offset = 0; offset < raw.size() || offset == 0; offset += max_block) {
+        const size_t size = std::min(max_block, raw.size() - offset);
+        const bool last = offset + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        if (last)
+            break;
+    }
+
+    // Adler-32, reducing only every 5552 bytes: the most that cannot overflow 32 bits.
+    uint32_t a = 1, b = 0;
+    for (size_t begin = 0; begin < raw.size(); begin += 5552) {
+        const size_t end = std::min(raw.size(), begin + 5552);
+        for (size_t i = begin; i < end; ++i) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    png_detail::put_u32(zlib, (b << 16) | a);
+
+    write_chunk(out, "IDAT", zlib.data(), zlib.size());
+    write_chunk(out, "IEND", nullptr, 0);
+    return static_cast<bool>(out);
+}
+
+inline bool PfmWriter::write(const Image &image, std::ostream &out) const {
+    const int width = image.width();
+    // The floats are written as they are in memory; the sign of the scale tells readers the
+    // byte order, negative for little-endian.
+    const char *scale = std::endian::native == std::endian::little ? "-1.0" : "1.0";
+    out << "PF\n" << width << ' ' << image.height() << '\n' << scale << '\n';
+
+    std::vector<float> line(static_cast<size_t>(width) * 3);
+    for (int y = 0; y < image.height(); ++y) {
+        const Color *row = image.row(y);
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                line[3 * x + c] = row[x][c];
+            }
+        }
+        out.write(reinterpret_cast<const char *>(line.data()),
+                  static_cast<std::streamsize>(line.size() * sizeof(float)));
+    }
+    return static_cast<bool>(out);
+}
+
+// Writes images on a background thread, so the renderer can move on to the next frame while
+// the previous one is encoded. Jobs are written in submission order; the destructor finishes
+// all of them.
+class AsyncImageWriter {
+public:
+    AsyncImageWriter() : worker_([this] { run(); }) {}
+
+    ~AsyncImageWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        worker_.join();
+    }
+
+    AsyncImageWriter(const AsyncImageWriter &) = delete;
+    AsyncImageWriter &operator=(const AsyncImageWriter &) = delete;
+
+    // Takes ownership of the image; the format follows the extension of path.
+    void submit(Image image, std::string path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(Job{std::move(image), std::move(path)});
+        }
+        wake_.notify_all();
+    }
+
+    // Blocks until every submitted image has been written.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+    }
+
+private:
+    struct Job {
+        Image image;
+        std::string path;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                break;
+
+            Job job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            write_image(job.image, job.path);
+
+            lock.lock();
+            busy_ = false;
+            idle_.notify_all();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<Job> jobs_;
+    bool busy_ = false;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "transform.h"
+
+#include <bit>
+#include <iostream>
+#include <typeinfo>
+
+// A placement of a shared object, usually a BVH of its own, under an affine transform. Rays
+// are moved into the object's space by the cached inverse, one matrix per ray and instance,
+// and the object is traced there; only the closest hit is brought back to world space, in
+// finalize_hit. The direction is not renormalized, so hit distances are the same in both
+// spaces. Many instances of one object share its geometry and BVH, and the top-level BVH of
+// the scene is built over the instance boxes.
+class Instance final : public Hittable {
+public:
+    Instance(shared_ptr<Hittable> object, const Transform &object_to_world);
+
+    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    // The object's box for [time0, time1], transformed.
+    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
+
+    // Finalizes the object's hit in its space and transforms the surface data to world space.
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    const Transform &object_to_world() const { return object_to_world_; }
+
+private:
+    Ray to_object(const Ray &r) const {
+        return Ray(world_to_object_.point(r.origin()), world_to_object_.vector(r.direction()),
+                   r.time());
+    }
+
+    // The object finalizes its hit in its own space; the surface data is then transformed.
+    // The normal goes through the transpose of the inverse and keeps its side, since the
+    // direction was transformed by the same matrix.
+    void to_world(const Ray &object_ray, HitRecord &rec) const {
+        rec.finalize(object_ray);
+        rec.p = object_to_world_.point(rec.p);
+        rec.normal = unit_vector(world_to_object_.transposed_vector(rec.normal));
+    }
+
+    // Takes over a hit the object reported, leaving the work of to_world to finalize_hit. A
+    // record has room for one instance, so the hit of an instance nested in this one is
+    // brought to this one's space right away.
+    void defer(const Ray &object_ray, HitRecord &rec) const {
+        if (typeid(*rec.object) == typeid(Instance))
+            rec.finalize(object_ray);
+        rec.instanced = rec.object;
+        rec.object = this;
+    }
+
+private:
+    shared_ptr<Hittable> object_;
+    Transform object_to_world_;
+    Transform world_to_object_;
+};
+
+inline Instance::Instance(shared_ptr<Hittable> object, const Transform &object_to_world)
+    : object_(object), object_to_world_(object_to_world) {
+    if (!object_to_world_.invert(world_to_object_)) {
+        std::cerr << "Instance: the transform is not invertible; the instance is left empty.\n";
+        object_ = nullptr;
+    }
+}
+
+inline bool Instance::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (!object_)
+        return false;
+    RT_STAT(instance_tests);
+    const Ray object_ray = to_object(r);
+    if (!object_->hit(object_ray, t_min, t_max, rec))
+        return false;
+
+    defer(object_ray, rec);
+    return true;
+}
+
+inline bool Instance::occluded(const Ray &r, float t_min, float t_max) const {
+    if (!object_)
+        return false;
+    RT_STAT(instance_tests);
+    return object_->occluded(to_object(r), t_min, t_max);
+}
+
+inline PacketMask Instance::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                       HitRecord *recs) const {
+    if (!object_)
+        return 0;
+    RT_STAT_ADD(instance_tests, std::popcount(mask));
+
+    const Transform &m = world_to_object_;
+    RayPacket moved = packet;
+    for (int i = 0; i < 3; ++i) {
+        for (int lane = 0; lane < packet_width; ++lane) {
+            const float ox = packet.origin[0][lane], oy = packet.origin[1][lane],
+                        oz = packet.origin[2][lane];
+            const float dx = packet.direction[0][lane], dy = packet.direction[1][lane],
+                        dz = packet.direction[2][lane];
+            moved.origin[i][lane] = m(i, 0) * ox + m(i, 1) * oy + m(i, 2) * oz + m(i, 3);
+            moved.direction[i][lane] = m(i, 0) * dx + m(i, 1) * dy + m(i, 2) * dz;
+            moved.inv_dir[i][lane] = 1 / moved.direction[i][lane];
+        }
+    }
+
+    const PacketMask hits = object_->hit_packet(moved, mask, t_min, recs);
+    for_each_lane(hits, [&](int lane) {
+        defer(moved.ray(lane), recs[lane]);
+        packet.t_max[lane] = moved.t_max[lane];
+    });
+    return hits;
+}
+
+inline void Instance::finalize_hit(const Ray &r, HitRecord &rec) const {
+    rec.object = rec.instanced;
+    to_world(to_object(r), rec);
+}
+
+inline bool Instance::bounding_box(float time0, float time1, aabb &output_box) const {
+    if (!object_ || !object_->bounding_box(time0, time1, output_box))
+        return false;
+
+    output_box = object_to_world_.box(output_box);
+    return true;
+}
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "light_list.h"
+#include "material.h"
+#include "sampler.h"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+// Why a path stopped.
+enum class PathEnd : uint8_t {
+    escaped,   // left the scene and picked up the background
+    absorbed,  // hit a surface that does not scatter, such as a light
+    roulette,  // killed by Russian roulette
+    max_depth, // reached IntegratorOptions::max_depth
+    count
+};
+
+constexpr int path_end_count = static_cast<int>(PathEnd::count);
+
+inline const char *path_end_name(PathEnd end) {
+    switch (end) {
+    case PathEnd::escaped:
+        return "escaped";
+    case PathEnd::absorbed:
+        return "absorbed";
+    case PathEnd::roulette:
+        return "roulette";
+    case PathEnd::max_depth:
+        return "max depth";
+    default:
+        return "?";
+    }
+}
+
+// Path counts of one or more traced paths. Each thread keeps its own and merges them.
+struct PathStats {
+    uint64_t paths = 0;
+    uint64_t segments = 0; // rays traced, including the one that left the scene
+    uint64_t ends[path_end_count] = {};
+
+    void end_path(PathEnd end, int segment_count) {
+        paths += 1;
+        segments += segment_count;
+        ends[static_cast<int>(end)] += 1;
+    }
+
+    void merge(const PathStats &other) {
+        paths += other.paths;
+        segments += other.segments;
+        for (int i = 0; i < path_end_count; ++i) {
+            ends[i] += other.ends[i];
+        }
+    }
+
+    double average_length() const {
+        return paths > 0 ? static_cast<double>(segments) / paths : 0.0;
+    }
+
+    void print(std::ostream &out) const {
+        out << "paths: " << paths << ", average length " << std::fixed << std::setprecision(2)
+            << average_length() << " segments\n";
+        for (int i = 0; i < path_end_count; ++i) {
+            const double share = paths > 0 ? 100.0 * ends[i] / paths : 0.0;
+            out << "  " << std::setw(9) << std::left << path_end_name(static_cast<PathEnd>(i))
+                << std::right << std::setw(7) << std::setprecision(2) << share << " %\n";
+        }
+    }
+};
+
+// Hits closer than this along a ray are taken to be the surface the ray leaves, and skipped.
+constexpr float ray_t_min = 10e-3f;
+
+struct IntegratorOptions {
+    int max_depth = 64;     // hard limit on the number of segments of a path
+    int roulette_depth = 5; // segments traced before Russian roulette may stop a path
+    // Survival probability never drops below this, so bright caustic paths are not all lost.
+    float min_survival = 0.05f;
+};
+
+// Balance of two sampling strategies for multiple importance sampling, by Veach's power
+// heuristic: the weight of a sample taken with density pdf that other_pdf could also have
+// produced.
+inline float power_heuristic(float pdf, float other_pdf) {
+    const float pdf_squared = pdf * pdf;
+    const float sum = pdf_squared + other_pdf * other_pdf;
+    return sum > 0 ? pdf_squared / sum : 0.0f;
+}
+
+// Traces paths in a loop instead of recursing once per bounce. The path throughput is carried
+// along; after roulette_depth segments a path survives each further bounce with a probability
+// that follows its throughput, and survivors are reweighted so the estimate stays unbiased.
+//
+// Given lights, every bounce off a material that samples_lights() also sends a shadow ray
+// toward a point on one of them (next-event estimation). Emission found that way and emission
+// the scattered path runs into are both weighted by the power heuristic, so small lights are
+// found by the light samples and large or close ones by the scattered rays.
+class PathIntegrator {
+public:
+    PathIntegrator(const Hittable &world, const Color &background,
+                   const IntegratorOptions &options = IntegratorOptions(),
+                   const LightList *lights = nullptr)
+        : world_(world), background_(background), options_(options),
+          lights_(lights && !lights->empty() ? lights : nullptr) {}
+
+    // Radiance arriving along r.
+    Color trace(const Ray &r, PathStats &stats) const;
+
+    // Same as trace() for a ray whose closest hit is already known, as found by the packet
+    // tracer; first_hit is nullptr if the ray misses the scene.
+    Color trace(const Ray &r, HitRecord *first_hit, PathStats &stats) const;
+
+    const IntegratorOptions &options() const { return options_; }
+
+private:
+    // Emission reaching hit from a direction sampled toward the lights, weighted against the
+    // chance that scattering picks the same direction. attenuation is what scatter() reported.
+    Color sample_lights(const Ray &r, const HitRecord &hit, const Color &attenuation) const;
+
+    const Hittable &world_;
+    Color background_;
+    IntegratorOptions options_;
+    const LightList *lights_;
+};
+
+inline Color PathIntegrator::sample_lights(const Ray &r, const HitRecord &hit,
+                                           const Color &attenuation) const {
+    const LightSample sample = lights_->sample(hit.p);
+    const float light_pdf = lights_->pdf(hit.p, sample.direction);
+    if (light_pdf <= 0)
+        return Color(0, 0, 0);
+    const float scattering_pdf = hit.material_pointer->scattering_pdf(r, hit, sample.direction);
+    if (scattering_pdf <= 0)
+        return Color(0, 0, 0);
+
+    // The shadow ray leaves the surface and stops short of the sampled point by ray_t_min
+    // each, so neither the surface nor the light itself can block it.
+    const float distance = sample.direction.length();
+    const Ray shadow_ray(hit.p, sample.direction / distance, r.time());
+    RT_STAT(shadow_rays);
+    if (world_.occluded(shadow_ray, ray_t_min, distance - ray_t_min))
+        return Color(0, 0, 0);
+
+    // Unoccluded: the emission is the sampled light's own, at the sampled point.
+    HitRecord record;
+    if (!sample.light->hit(shadow_ray, ray_t_min, infinity, record))
+        return Color(0, 0, 0);
+    record.finalize(shadow_ray);
+    const Color emitted = record.material_pointer->emitted(record.u, record.v, record.p);
+
+    return emitted * attenuation *
+           (scattering_pdf / light_pdf * power_heuristic(light_pdf, scattering_pdf));
+}
+
+inline Color PathIntegrator::trace(const Ray &r, PathStats &stats) const {
+    if (options_.max_depth <= 0) {
+        stats.end_path(PathEnd::max_depth, 0);
+        return Color(0, 0, 0);
+    }
+
+    HitRecord record;
+    RT_STAT(rays);
+    const bool hit = world_.hit(r, ray_t_min, infinity, record);
+    return trace(r, hit ? &record : nullptr, stats);
+}
+
+inline Color PathIntegrator::trace(const Ray &r, HitRecord *first_hit, PathStats &stats) const {
+    Color radiance(0, 0, 0);
+    Color throughput(1, 1, 1);
+    Ray ray = r;
+    HitRecord record;
+    // Density with which the last bounce picked the direction of ray, if the lights were
+    // sampled there too; 0 after the camera and after mirrors and glass.
+    float scattering_pdf = 0;
+
+    for (int depth = 0;; ++depth) {
+        if (depth >= options_.max_depth) {
+            stats.end_path(PathEnd::max_depth, depth);
+            break;
+        }
+
+        HitRecord *hit = nullptr;
+        if (depth == 0) {
+            hit = first_hit;
+        } else {
+            RT_STAT(rays);
+            if (world_.hit(ray, ray_t_min, infinity, record))
+                hit = &record;
+        }
+
+        if (!hit) {
+            radiance += throughput * background_;
+            stats.end_path(PathEnd::escaped, depth + 1);
+            break;
+        }
+
+        // Emitters the lights cannot sample, such as ones inside instances, are only found
+        // this way and keep their full weight.
+        const bool sampled_light = scattering_pdf > 0 && lights_->contains(hit->object);
+        hit->finalize(ray);
+        const Material *material = hit->material_pointer;
+        const Color emitted = material->emitted(hit->u, hit->v, hit->p);
+        if (sampled_light) {
+            if (emitted.x() != 0 || emitted.y() != 0 || emitted.z() != 0)
+                radiance += throughput * emitted *
+                            power_heuristic(scattering_pdf,
+                                            lights_->pdf(ray.origin(), ray.direction()));
+        } else {
+            radiance += throughput * emitted;
+        }
+
+        Color attenuation;
+        Ray scattered;
+        if (!material->scatter(ray, *hit, attenuation, scattered)) {
+            stats.end_path(PathEnd::absorbed, depth + 1);
+            break;
+        }
+
+        scattering_pdf = 0;
+        if (lights_ && material->samples_lights()) {
+            radiance += throughput * sample_lights(ray, *hit, attenuation);
+            scattering_pdf = material->scattering_pdf(ray, *hit, scattered.direction());
+        }
+        throughput = throughput * attenuation;
+
+        if (depth + 1 >= options_.roulette_depth) {
+            const float max_component =
+                std::max(throughput.x(), std::max(throughput.y(), throughput.z()));
+            const float survival = clamp(max_component, options_.min_survival, 1.0f);
+            if (sample_1d() >= survival) {
+                stats.end_path(PathEnd::roulette, depth + 1);
+                break;
+            }
+            throughput /= survival;
+        }
+
+        ray = scattered;
+    }
+
+    return radiance;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+
+#include "rtweekend.h"
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "sampler.h"
+
+#include <algorithm>
+#include <vector>
+
+// A direction toward a point on a light; the point lies at ray distance 1 along direction.
+struct LightSample {
+    Vec3 direction;
+    const Hittable *light = nullptr;
+};
+
+// The emitting shapes of a scene that can be sampled directly, for next-event estimation.
+// Lights are picked uniformly, so sample() and pdf() describe the mixture of all of them.
+class LightList {
+public:
+    LightList() {}
+
+    // Collects the top-level objects of world that are lights. Lights inside nested lists,
+    // BVHs or instances are only found by the paths that happen to hit them.
+    explicit LightList(const HittableList &world) {
+        for (const auto &object : world.objects) {
+            if (object->is_light())
+                lights_.push_back(object.get());
+        }
+    }
+
+    bool empty() const { return lights_.empty(); }
+    size_t size() const { return lights_.size(); }
+
+    // Whether sample() can pick object, so that hitting it by chance competes with sampling.
+    bool contains(const Hittable *object) const {
+        return std::find(lights_.begin(), lights_.end(), object) != lights_.end();
+    }
+
+    // A point on one of the lights, seen from origin, drawn from the thread's sampler.
+    LightSample sample(const Point3 &origin) const {
+        const auto count = static_cast<int>(lights_.size());
+        const int index = std::min(static_cast<int>(sample_1d() * count), count - 1);
+        const Hittable *light = lights_[index];
+        return LightSample{light->sample_light(origin, sample_2d()), light};
+    }
+
+    // Solid angle density of sample() picking direction from origin. Occluders are ignored,
+    // as they are when sampling; a light behind another one counts as occluded by it.
+    float pdf(const Point3 &origin, const Vec3 &direction) const {
+        float sum = 0;
+        for (const Hittable *light : lights_) {
+            sum += light->light_pdf(origin, direction);
+        }
+        return sum / lights_.size();
+    }
+
+private:
+    std::vector<const Hittable *> lights_;
+};
+
+#endif
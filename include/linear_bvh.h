@@ -0,0 +1,186 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "rtweekend.h"
+
+#include "bvh_builder.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <cstdint>
+#include <vector>
+
+// 32 bytes, so two nodes share a cache line.
+struct LinearBvhNode {
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset; // interior: index of the second child; leaf: first primitive
+    uint16_t count;  // number of primitives in a leaf, 0 for interior nodes
+    uint8_t axis;    // split axis of an interior node
+    uint8_t pad;
+};
+
+static_assert(sizeof(LinearBvhNode) == 32, "LinearBvhNode should stay 32 bytes");
+
+// A BVH flattened into one contiguous array of nodes in depth-first order. The first child of
+// an interior node directly follows it, so the only links are the second-child offset and the
+// leaf primitive ranges. Traversal is a loop over a small fixed stack instead of one virtual
+// hit() per node. bvh_node builds the same tree and serves as the reference implementation.
+class LinearBvh : public Hittable {
+public:
+    LinearBvh() {}
+
+    LinearBvh(const HittableList &list, float time0, float time1,
+              const BvhBuildOptions &options = BvhBuildOptions());
+
+    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
+
+    const BvhStats &stats() const { return stats_; }
+    const std::vector<LinearBvhNode> &nodes() const { return nodes_; }
+
+private:
+    static bool hit_node(const LinearBvhNode &node, const Ray &r, float t_min, float t_max);
+
+    // A node on the stack is the second child of one on the current path, and the builder
+    // keeps every path within bvh_max_depth nodes.
+    static constexpr int stack_size = bvh_max_depth;
+
+private:
+    std::vector<LinearBvhNode> nodes_;
+    // Primitives reordered so that every leaf covers a contiguous range.
+    std::vector<shared_ptr<Hittable>> primitives_;
+    BvhStats stats_;
+};
+
+inline LinearBvh::LinearBvh(const HittableList &list, float time0, float time1,
+                            const BvhBuildOptions &options) {
+    const auto &objects = list.objects;
+
+    std::vector<aabb> boxes(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (!objects[i]->bounding_box(time0, time1, boxes[i]))
+            std::cerr << "No bounding box in LinearBvh constructor.\n";
+    }
+
+    const BvhBuild build = build_sah_bvh(boxes, options);
+    stats_ = build.stats;
+
+    primitives_.reserve(build.indices.size());
+    for (uint32_t index : build.indices) {
+        primitives_.push_back(objects[index]);
+    }
+
+    nodes_.resize(build.nodes.size());
+    for (size_t i = 0; i < build.nodes.size(); ++i) {
+        const BvhBuildNode &src = build.nodes[i];
+        LinearBvhNode &dst = nodes_[i];
+        for (int a = 0; a < 3; ++a) {
+            dst.bounds_min[a] = src.box.aabb_min()[a];
+            dst.bounds_max[a] = src.box.aabb_max()[a];
+        }
+        dst.offset = src.offset;
+        dst.count = src.count;
+        dst.axis = src.axis;
+        dst.pad = 0;
+    }
+}
+
+inline bool LinearBvh::hit_node(const LinearBvhNode &node, const Ray &r, float t_min,
+                                float t_max) {
+    float t_near;
+    return slab_test(node.bounds_min, node.bounds_max, r, t_min, t_max, t_near);
+}
+
+inline bool LinearBvh::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (nodes_.empty())
+        return false;
+
+    uint32_t stack[stack_size];
+    int stack_top = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const LinearBvhNode &node = nodes_[current];
+        RT_STAT(bvh_nodes);
+        RT_STAT(box_tests);
+
+        // t_max shrinks with every hit, so boxes behind the closest hit are skipped.
+        if (hit_node(node, r, t_min, t_max)) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    if (primitives_[i]->hit(r, t_min, t_max, rec)) {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                }
+                if (stack_top == 0)
+                    break;
+                current = stack[--stack_top];
+            } else if (r.sign(node.axis)) {
+                // Visit the child on the near side of the split first.
+                stack[stack_top++] = current + 1;
+                current = node.offset;
+            } else {
+                stack[stack_top++] = node.offset;
+                current = current + 1;
+            }
+        } else {
+            if (stack_top == 0)
+                break;
+            current = stack[--stack_top];
+        }
+    }
+
+    return hit_anything;
+}
+
+inline bool LinearBvh::occluded(const Ray &r, float t_min, float t_max) const {
+    if (nodes_.empty())
+        return false;
+
+    // Any hit will do, so children are taken in stored order and the first primitive in the
+    // way ends the search.
+    uint32_t stack[stack_size];
+    int stack_top = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const LinearBvhNode &node = nodes_[current];
+        RT_STAT(bvh_nodes);
+        RT_STAT(box_tests);
+
+        if (hit_node(node, r, t_min, t_max)) {
+            if (node.count == 0) {
+                stack[stack_top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (primitives_[i]->occluded(r, t_min, t_max))
+                    return true;
+            }
+        }
+        if (stack_top == 0)
+            break;
+        current = stack[--stack_top];
+    }
+
+    return false;
+}
+
+inline bool LinearBvh::bounding_box(float time0, float time1, aabb &output_box) const {
+    if (nodes_.empty())
+        return false;
+
+    const LinearBvhNode &root = nodes_[0];
+    output_box = aabb(Point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                      Point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+    return true;
+}
+
+#endif
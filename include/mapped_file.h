@@ -0,0 +1,167 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RT_HAVE_MMAP 1
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#define RT_HAVE_MMAP 1
+#else
+#define RT_HAVE_MMAP 0
+#endif
+
+// A whole file mapped read-only into memory, so its contents can be used in place. Pages are
+// read in by the operating system as they are touched, and stay shared with the page cache
+// for as long as the file is open. Without mmap the file is read into memory instead.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Reports failures to std::cerr unless quiet, as for a cache that may not exist yet.
+    bool open(const std::string &path, bool quiet = false);
+    void close();
+
+    bool is_open() const { return data_ != nullptr; }
+    const unsigned char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+#if defined(_WIN32)
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#elif !RT_HAVE_MMAP
+    std::vector<unsigned char> buffer_;
+#endif
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+
+inline bool MappedFile::open(const std::string &path, bool quiet) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (!quiet)
+            std::cerr << "Could not open " << path << ".\n";
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        if (!quiet)
+            std::cerr << "Could not map " << path << ": empty or unreadable.\n";
+        ::close(fd);
+        return false;
+    }
+
+    void *mapping =
+        mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive on its own.
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        if (!quiet)
+            std::cerr << "Could not map " << path << ".\n";
+        return false;
+    }
+
+    data_ = static_cast<const unsigned char *>(mapping);
+    size_ = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+inline void MappedFile::close() {
+    if (data_)
+        munmap(const_cast<unsigned char *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#elif defined(_WIN32)
+
+inline bool MappedFile::open(const std::string &path, bool quiet) {
+    close();
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+    LARGE_INTEGER file_size;
+    if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &file_size) ||
+        file_size.QuadPart <= 0) {
+        if (!quiet)
+            std::cerr << "Could not open " << path << ".\n";
+        close();
+        return false;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (!quiet)
+            std::cerr << "Could not map " << path << ".\n";
+        close();
+        return false;
+    }
+
+    data_ = static_cast<const unsigned char *>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+inline void MappedFile::close() {
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+    data_ = nullptr;
+    size_ = 0;
+    mapping_ = nullptr;
+    file_ = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+inline bool MappedFile::open(const std::string &path, bool quiet) {
+    close();
+    std::ifstream in(path, std::ios::binary);
+    if (in) {
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    if (buffer_.empty()) {
+        if (!quiet)
+            std::cerr << "Could not open " << path << ".\n";
+        return false;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return true;
+}
+
+inline void MappedFile::close() {
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
+
+#endif
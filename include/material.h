@@ -3,8 +3,12 @@
 
 #include "hittable.h"
 #include "rtweekend.h"
+#include "sampler.h"
 #include "texture.h"
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 struct HitRecord;
 
@@ -17,6 +21,18 @@ public:
 
     virtual bool scatter(const Ray &r_in, const HitRecord &rec, Color &attenuation,
                          Ray &scattered) const = 0;
+
+    virtual bool is_emissive() const { return false; }
+
+    // Next-event estimation, for materials that scatter into every direction with a known
+    // density, unlike mirrors and glass. scattering_pdf() is the solid angle density of the
+    // directions scatter() picks, and the attenuation scatter() reports times that density
+    // is the scattering function times the cosine factor.
+    virtual bool samples_lights() const { return false; }
+    virtual float scattering_pdf(const Ray &r_in, const HitRecord &rec,
+                                 const Vec3 &direction) const {
+        return 0;
+    }
 };
 
 class Lambertian : public Material {
@@ -26,7 +42,8 @@ public:
 
     virtual bool scatter(const Ray &_r_in, const HitRecord &_rec, Color &_attenuation,
                          Ray &_scattered) const override {
-        auto scatter_direction = _rec.normal + random_unit_vector();
+        RT_STAT(scatter_lambertian);
+        auto scatter_direction = _rec.normal + sample_unit_vector();
 
         // Catch degenerate scatter direction
         if (scatter_direction.near_zero())
@@ -37,6 +54,15 @@ public:
         return true;
     }
 
+    virtual bool samples_lights() const override { return true; }
+
+    // The normal plus a random unit vector is cosine distributed.
+    virtual float scattering_pdf(const Ray &r_in, const HitRecord &rec,
+                                 const Vec3 &direction) const override {
+        const float cosine = dot(rec.normal, unit_vector(direction));
+        return cosine > 0 ? cosine / PI : 0.0f;
+    }
+
 public:
     shared_ptr<Texture> albedo;
 };
@@ -47,8 +73,9 @@ public:
 
     virtual bool scatter(const Ray &ray_in, const HitRecord &record, Color &attenuation,
                          Ray &scattered) const override {
+        RT_STAT(scatter_metal);
         const Vec3 reflected = reflect(unit_vector(ray_in.direction()), record.normal);
-        scattered = Ray(record.p, reflected + fuzz_ * random_in_unit_shpere(), ray_in.time());
+        scattered = Ray(record.p, reflected + fuzz_ * sample_in_unit_sphere(), ray_in.time());
         attenuation = albedo_;
         return (dot(scattered.direction(), record.normal) > 0);
     }
@@ -64,6 +91,7 @@ public:
 
     virtual bool scatter(const Ray &ray_in, const HitRecord &record, Color &attenuation,
                          Ray &scattered) const override {
+        RT_STAT(scatter_dielectric);
         attenuation = Color(1.0, 1.0, 1.0);
         const float refraction_ratio =
             record.front_face ? (1.0 / refraction_index_) : refraction_index_;
@@ -75,7 +103,7 @@ public:
         const bool cannot_refract = refraction_ratio * sin_theta > 1.0;
         Vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_float())
+        if (cannot_refract || reflectance(cos_theta, refraction_ratio) > sample_1d())
             direction = reflect(unit_direction, record.normal);
         else
             direction = refract(unit_direction, record.normal, refraction_ratio);
@@ -111,6 +139,8 @@ public:
         return emit->value(u, v, p);
     }
 
+    virtual bool is_emissive() const override { return true; }
+
 public:
     shared_ptr<Texture> emit;
 };
@@ -123,16 +153,48 @@ class Isotropic : public Material {
         virtual bool scatter(
             const Ray& r_in, const HitRecord& rec, Color& attenuation, Ray& scattered
         ) const override {
-            scattered = Ray(rec.p, random_in_unit_shpere(), r_in.time());
+            RT_STAT(scatter_isotropic);
+            scattered = Ray(rec.p, sample_unit_vector(), r_in.time());
             attenuation = albedo->value(rec.u, rec.v, rec.p);
             return true;
         }
 
+        virtual bool samples_lights() const override { return true; }
+
+        virtual float scattering_pdf(
+            const Ray& r_in, const HitRecord& rec, const Vec3& direction
+        ) const override {
+            return 1 / (4 * PI);
+        }
+
     public:
         shared_ptr<Texture> albedo;
 };
 
+// Owns materials and hands out a 32-bit index for each, so objects that store many
+// primitives can refer to materials by index instead of holding a shared_ptr per primitive.
+// Adding the same material twice returns the same index.
+class MaterialRegistry {
+public:
+    uint32_t add(const shared_ptr<Material> &material) {
+        const auto found = indices_.find(material.get());
+        if (found != indices_.end())
+            return found->second;
+
+        const auto index = static_cast<uint32_t>(materials_.size());
+        materials_.push_back(material);
+        indices_.emplace(material.get(), index);
+        return index;
+    }
+
+    const Material *get(uint32_t index) const { return materials_[index].get(); }
+    const shared_ptr<Material> &shared(uint32_t index) const { return materials_[index]; }
 
+    size_t size() const { return materials_.size(); }
 
+private:
+    std::vector<shared_ptr<Material>> materials_;
+    std::unordered_map<const Material *, uint32_t> indices_;
+};
 
 #endif
\ No newline at end of file
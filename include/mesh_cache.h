@@ -0,0 +1,286 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "rtweekend.h"
+
+#include "mapped_file.h"
+#include "mesh_loader.h"
+#include "triangle_mesh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// A TriangleMesh saved with its BVH, so that the next run maps the file and starts tracing
+// without parsing or building anything. The file is a header followed by the vertex, normal,
+// uv, index and node arrays exactly as they are in memory, each aligned to 64 bytes; a mesh
+// opened from it reads the arrays in place from the mapping.
+//
+// The header records the version, the byte order and the sizes of the types, so a file from
+// another build or machine is rejected rather than misread, and a key chosen by the writer
+// that identifies what the mesh was made from, so a stale cache is rebuilt. The arrays
+// themselves are trusted: the file is only ever written by write_mesh_cache.
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t point_size;
+    uint32_t node_size;
+    uint64_t key;
+    uint64_t file_size;
+
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+    uint64_t node_count;
+    uint64_t positions_offset;
+    uint64_t normals_offset; // 0 if the mesh has no normals
+    uint64_t uvs_offset;     // 0 if the mesh has no texture coordinates
+    uint64_t indices_offset;
+    uint64_t nodes_offset;
+
+    // The BvhStats of the stored tree, other than its build time.
+    int32_t leaf_count;
+    int32_t max_depth;
+    int32_t min_leaf_size;
+    int32_t max_leaf_size;
+    float average_leaf_size;
+    float sah_cost;
+};
+
+constexpr char mesh_cache_magic[8] = {'R', 'T', 'M', 'E', 'S', 'H', 0, 0};
+constexpr uint32_t mesh_cache_version = 1;
+constexpr uint32_t mesh_cache_byte_order = 0x01020304;
+constexpr size_t mesh_cache_alignment = 64;
+
+// FNV-1a over size bytes, continuing from hash; for building cache keys.
+inline uint64_t mesh_cache_hash(const void *data, size_t size,
+                                uint64_t hash = 0xcbf29ce484222325ull) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Folds the build options into key, since they shape the stored tree.
+inline uint64_t mesh_cache_key(uint64_t key, const BvhBuildOptions &options) {
+    key = mesh_cache_hash(&options.max_leaf_size, sizeof(options.max_leaf_size), key);
+    key = mesh_cache_hash(&options.bin_count, sizeof(options.bin_count), key);
+    key = mesh_cache_hash(&options.max_depth, sizeof(options.max_depth), key);
+    key = mesh_cache_hash(&options.traversal_cost, sizeof(options.traversal_cost), key);
+    return mesh_cache_hash(&options.intersection_cost, sizeof(options.intersection_cost), key);
+}
+
+namespace mesh_cache_detail {
+
+inline uint64_t align(uint64_t offset) {
+    return (offset + mesh_cache_alignment - 1) / mesh_cache_alignment * mesh_cache_alignment;
+}
+
+// Whether count elements of size bytes at offset lie within the file and are aligned.
+inline bool section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t file_size) {
+    return offset % mesh_cache_alignment == 0 && offset <= file_size &&
+           count <= (file_size - offset) / size;
+}
+
+template <typename T>
+inline std::span<const T> section_view(const unsigned char *base, uint64_t offset,
+                                       uint64_t count) {
+    if (offset == 0)
+        return std::span<const T>();
+    return std::span<const T>(reinterpret_cast<const T *>(base + offset), count);
+}
+
+} // namespace mesh_cache_detail
+
+// Writes mesh to path under key. The file is written beside path and then renamed over it, so
+// a reader never maps a half-written cache.
+inline bool write_mesh_cache(const std::string &path, const TriangleMesh &mesh, uint64_t key) {
+    using mesh_cache_detail::align;
+    const MeshView &view = mesh.view();
+    const std::span<const LinearBvhNode> nodes = mesh.nodes();
+    const BvhStats &stats = mesh.stats();
+
+    MeshCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+    header.version = mesh_cache_version;
+    header.byte_order = mesh_cache_byte_order;
+    header.point_size = sizeof(Point3);
+    header.node_size = sizeof(LinearBvhNode);
+    header.key = key;
+    header.vertex_count = view.positions.size();
+    header.triangle_count = view.triangle_count();
+    header.node_count = nodes.size();
+    header.leaf_count = stats.leaf_count;
+    header.max_depth = stats.max_depth;
+    header.min_leaf_size = stats.min_leaf_size;
+    header.max_leaf_size = stats.max_leaf_size;
+    header.average_leaf_size = stats.average_leaf_size;
+    header.sah_cost = stats.sah_cost;
+
+    uint64_t offset = align(sizeof(header));
+    const auto place = [&](uint64_t &section, size_t bytes) {
+        section = bytes > 0 ? offset : 0;
+        offset = align(offset + bytes);
+    };
+    place(header.positions_offset, view.positions.size_bytes());
+    place(header.normals_offset, view.normals.size_bytes());
+    place(header.uvs_offset, view.uvs.size_bytes());
+    place(header.indices_offset, view.indices.size_bytes());
+    place(header.nodes_offset, nodes.size_bytes());
+    header.file_size = offset;
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        uint64_t written = 0;
+        // Pads with zeros up to position, then writes bytes from data.
+        const auto write_at = [&](uint64_t position, const void *data, size_t bytes) {
+            if (bytes == 0 && position < written)
+                return; // a section the mesh does not have
+            static const char zeros[mesh_cache_alignment] = {};
+            out.write(zeros, static_cast<std::streamsize>(position - written));
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+            written = position + bytes;
+        };
+        write_at(0, &header, sizeof(header));
+        write_at(header.positions_offset, view.positions.data(), view.positions.size_bytes());
+        write_at(header.normals_offset, view.normals.data(), view.normals.size_bytes());
+        write_at(header.uvs_offset, view.uvs.data(), view.uvs.size_bytes());
+        write_at(header.indices_offset, view.indices.data(), view.indices.size_bytes());
+        write_at(header.nodes_offset, nodes.data(), nodes.size_bytes());
+        write_at(header.file_size, nullptr, 0);
+        if (!out) {
+            std::cerr << "Could not write mesh cache " << temporary << ".\n";
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Could not write mesh cache " << path << ": " << error.message() << ".\n";
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The mesh stored at path, or nullptr if there is none or it was written under another key or
+// by an incompatible build. Only a damaged file is reported to std::cerr.
+inline shared_ptr<TriangleMesh> open_mesh_cache(const std::string &path, uint64_t key,
+                                                shared_ptr<Material> material) {
+    using namespace mesh_cache_detail;
+    auto file = make_shared<MappedFile>();
+    if (!file->open(path, true))
+        return nullptr;
+
+    MeshCacheHeader header;
+    if (file->size() < sizeof(header))
+        return nullptr;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != mesh_cache_version || header.byte_order != mesh_cache_byte_order ||
+        header.point_size != sizeof(Point3) || header.node_size != sizeof(LinearBvhNode) ||
+        header.key != key)
+        return nullptr;
+    // A tree deeper than the traversal stack, from a build without the depth limit, is made
+    // again.
+    if (header.max_depth < 1 || header.max_depth > bvh_max_depth)
+        return nullptr;
+
+    const uint64_t size = file->size();
+    const uint64_t vertices = header.vertex_count;
+    const bool intact =
+        header.file_size == size && header.node_count > 0 &&
+        section_fits(header.positions_offset, vertices, sizeof(Point3), size) &&
+        (header.normals_offset == 0 ||
+         section_fits(header.normals_offset, vertices, sizeof(Vec3), size)) &&
+        (header.uvs_offset == 0 ||
+         section_fits(header.uvs_offset, 2 * vertices, sizeof(float), size)) &&
+        section_fits(header.indices_offset, 3 * header.triangle_count, sizeof(uint32_t), size) &&
+        section_fits(header.nodes_offset, header.node_count, sizeof(LinearBvhNode), size);
+    if (!intact) {
+        std::cerr << "Mesh cache " << path << " is damaged; ignoring it.\n";
+        return nullptr;
+    }
+
+    // No copies: the views point into the mapping, which the mesh keeps open.
+    const unsigned char *base = file->data();
+    MeshView view;
+    view.positions = section_view<Point3>(base, header.positions_offset, vertices);
+    view.normals = section_view<Vec3>(base, header.normals_offset, vertices);
+    view.uvs = section_view<float>(base, header.uvs_offset, 2 * vertices);
+    view.indices =
+        section_view<uint32_t>(base, header.indices_offset, 3 * header.triangle_count);
+    const std::span<const LinearBvhNode> nodes =
+        section_view<LinearBvhNode>(base, header.nodes_offset, header.node_count);
+
+    BvhStats stats;
+    stats.primitive_count = static_cast<int>(header.triangle_count);
+    stats.node_count = static_cast<int>(header.node_count);
+    stats.leaf_count = header.leaf_count;
+    stats.max_depth = header.max_depth;
+    stats.min_leaf_size = header.min_leaf_size;
+    stats.max_leaf_size = header.max_leaf_size;
+    stats.average_leaf_size = header.average_leaf_size;
+    stats.sah_cost = header.sah_cost;
+
+    return make_shared<TriangleMesh>(std::move(file), view, nodes, stats, material);
+}
+
+// Opens the cache at path if it holds key; otherwise makes the mesh from build(), which
+// returns a MeshData, and writes the cache for the next run.
+template <typename Build>
+inline shared_ptr<TriangleMesh> cached_triangle_mesh(const std::string &path, uint64_t key,
+                                                     shared_ptr<Material> material,
+                                                     Build &&build,
+                                                     const BvhBuildOptions &options =
+                                                         BvhBuildOptions()) {
+    key = mesh_cache_key(key, options);
+    if (auto mesh = open_mesh_cache(path, key, material))
+        return mesh;
+
+    auto mesh = make_shared<TriangleMesh>(build(), material, options);
+    if (mesh->triangle_count() > 0)
+        write_mesh_cache(path, *mesh, key);
+    return mesh;
+}
+
+// load_triangle_mesh through a cache next to the mesh file, at path + ".rtmesh". The cache is
+// rebuilt when the mesh file changes size or modification time.
+inline shared_ptr<TriangleMesh> load_cached_triangle_mesh(const std::string &path,
+                                                          shared_ptr<Material> material,
+                                                          const BvhBuildOptions &options =
+                                                              BvhBuildOptions()) {
+    std::error_code error;
+    const uint64_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        std::cerr << "Could not open mesh " << path << ".\n";
+        return nullptr;
+    }
+    const int64_t modified =
+        std::filesystem::last_write_time(path, error).time_since_epoch().count();
+
+    uint64_t key = mesh_cache_hash(&size, sizeof(size));
+    key = mesh_cache_hash(&modified, sizeof(modified), key);
+    key = mesh_cache_key(key, options);
+    if (auto mesh = open_mesh_cache(path + ".rtmesh", key, material))
+        return mesh;
+
+    MeshData data;
+    if (!load_mesh(path, data))
+        return nullptr;
+    auto mesh = make_shared<TriangleMesh>(std::move(data), material, options);
+    if (mesh->triangle_count() > 0)
+        write_mesh_cache(path + ".rtmesh", *mesh, key);
+    return mesh;
+}
+
+#endif
@@ -0,0 +1,504 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include "rtweekend.h"
+
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Readers for triangle meshes in Wavefront OBJ and in PLY (ASCII and binary). Both stream the
+// file line by line or element by element straight into the buffers of a MeshData, so memory
+// stays at the size of the mesh itself. Polygons are split into triangle fans. Failures are
+// reported to std::cerr and leave mesh empty.
+
+namespace mesh_loader_detail {
+
+inline std::string_view next_token(std::string_view &line) {
+    size_t begin = 0;
+    while (begin < line.size() && (line[begin] == ' ' || line[begin] == '\t' ||
+                                   line[begin] == '\r'))
+        ++begin;
+    size_t end = begin;
+    while (end < line.size() && line[end] != ' ' && line[end] != '\t' && line[end] != '\r')
+        ++end;
+    const std::string_view token = line.substr(begin, end - begin);
+    line.remove_prefix(end);
+    return token;
+}
+
+template <typename T>
+inline bool parse_number(std::string_view token, T &value) {
+    if (!token.empty() && token.front() == '+')
+        token.remove_prefix(1);
+    const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+// Resolves a 1-based or negative (relative to the end) OBJ index into a 0-based one.
+inline bool resolve_obj_index(std::string_view token, size_t count, int64_t &index) {
+    if (!parse_number(token, index) || index == 0)
+        return false;
+    index = index > 0 ? index - 1 : static_cast<int64_t>(count) + index;
+    return index >= 0 && index < static_cast<int64_t>(count);
+}
+
+struct ObjVertexKey {
+    int64_t position, uv, normal; // -1 when absent
+
+    bool operator==(const ObjVertexKey &other) const {
+        return position == other.position && uv == other.uv && normal == other.normal;
+    }
+};
+
+struct ObjVertexKeyHash {
+    size_t operator()(const ObjVertexKey &key) const {
+        uint64_t h = static_cast<uint64_t>(key.position) * 0x9e3779b97f4a7c15ull;
+        h ^= static_cast<uint64_t>(key.uv) * 0xc2b2ae3d27d4eb4full + (h >> 29);
+        h ^= static_cast<uint64_t>(key.normal) * 0x165667b19e3779f9ull + (h >> 32);
+        return static_cast<size_t>(h);
+    }
+};
+
+} // namespace mesh_loader_detail
+
+// Wavefront OBJ: v, vt, vn and f lines, with 1-based or negative indices.
+inline bool load_obj(const std::string &path, MeshData &mesh) {
+    using namespace mesh_loader_detail;
+    mesh = MeshData();
+
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Could not open mesh " << path << ".\n";
+        return false;
+    }
+
+    // Positions, normals and texture coordinates are indexed separately in OBJ. Faces that
+    // only use positions refer to them directly; a face corner that also names a normal or a
+    // texture coordinate becomes a vertex of its own, shared by all corners with the same
+    // three indices.
+    std::vector<Point3> positions;
+    std::vector<Vec3> normals;
+    std::vector<float> uvs;
+    std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertices;
+    std::vector<ObjVertexKey> vertex_keys;
+    bool split_vertices = false;
+    std::vector<ObjVertexKey> corners;
+
+    std::string line;
+    size_t line_number = 0;
+    const auto fail = [&](const char *what) {
+        std::cerr << path << ":" << line_number << ": " << what << ".\n";
+        mesh = MeshData();
+        return false;
+    };
+
+    while (std::getline(in, line)) {
+        ++line_number;
+        std::string_view rest(line);
+        const std::string_view keyword = next_token(rest);
+
+        if (keyword == "v" || keyword == "vn") {
+            float xyz[3];
+            for (float &value : xyz) {
+                if (!parse_number(next_token(rest), value))
+                    return fail("malformed vertex");
+            }
+            if (keyword == "v")
+                positions.emplace_back(xyz[0], xyz[1], xyz[2]);
+            else
+                normals.emplace_back(xyz[0], xyz[1], xyz[2]);
+        } else if (keyword == "vt") {
+            float u, v = 0;
+            if (!parse_number(next_token(rest), u))
+                return fail("malformed texture coordinate");
+            const std::string_view v_token = next_token(rest);
+            if (!v_token.empty() && !parse_number(v_token, v))
+                return fail("malformed texture coordinate");
+            uvs.push_back(u);
+            uvs.push_back(v);
+        } else if (keyword == "f") {
+            corners.clear();
+            for (std::string_view corner = next_token(rest); !corner.empty();
+                 corner = next_token(rest)) {
+                // v, v/vt, v//vn or v/vt/vn
+                ObjVertexKey key{-1, -1, -1};
+                const size_t slash = corner.find('/');
+                if (!resolve_obj_index(corner.substr(0, slash), positions.size(), key.position))
+                    return fail("bad vertex index");
+                if (slash != std::string_view::npos) {
+                    std::string_view tail = corner.substr(slash + 1);
+                    const size_t second = tail.find('/');
+                    const std::string_view uv_token = tail.substr(0, second);
+                    if (!uv_token.empty() &&
+                        !resolve_obj_index(uv_token, uvs.size() / 2, key.uv))
+                        return fail("bad texture coordinate index");
+                    if (second != std::string_view::npos &&
+                        !resolve_obj_index(tail.substr(second + 1), normals.size(), key.normal))
+                        return fail("bad normal index");
+                }
+                corners.push_back(key);
+            }
+            if (corners.size() < 3)
+                return fail("face with fewer than three vertices");
+
+            for (const ObjVertexKey &key : corners) {
+                if (key.uv >= 0 || key.normal >= 0)
+                    split_vertices = true;
+            }
+            for (size_t k = 1; k + 1 < corners.size(); ++k) {
+                for (const ObjVertexKey &key : {corners[0], corners[k], corners[k + 1]}) {
+                    const auto found = vertices.try_emplace(
+                        key, static_cast<uint32_t>(vertex_keys.size()));
+                    if (found.second)
+                        vertex_keys.push_back(key);
+                    mesh.indices.push_back(found.first->second);
+                }
+            }
+        }
+        // Groups, objects, materials and smoothing groups carry nothing a MeshData holds.
+    }
+
+    if (mesh.indices.empty())
+        return fail("no faces");
+
+    if (!split_vertices) {
+        // Every corner is a plain position: index the positions themselves.
+        for (uint32_t &index : mesh.indices) {
+            index = static_cast<uint32_t>(vertex_keys[index].position);
+        }
+        mesh.positions = std::move(positions);
+        return true;
+    }
+
+    // Only keep normals and texture coordinates if every vertex has them.
+    const bool all_normals = std::all_of(vertex_keys.begin(), vertex_keys.end(),
+                                         [](const ObjVertexKey &key) { return key.normal >= 0; });
+    const bool all_uvs = std::all_of(vertex_keys.begin(), vertex_keys.end(),
+                                     [](const ObjVertexKey &key) { return key.uv >= 0; });
+    mesh.positions.reserve(vertex_keys.size());
+    for (const ObjVertexKey &key : vertex_keys) {
+        mesh.positions.push_back(positions[key.position]);
+        if (all_normals)
+            mesh.normals.push_back(normals[key.normal]);
+        if (all_uvs) {
+            mesh.uvs.push_back(uvs[2 * key.uv]);
+            mesh.uvs.push_back(uvs[2 * key.uv + 1]);
+        }
+    }
+    return true;
+}
+
+namespace mesh_loader_detail {
+
+enum class PlyFormat { ascii, binary_little_endian, binary_big_endian };
+
+enum class PlyType { int8, uint8, int16, uint16, int32, uint32, float32, float64, invalid };
+
+inline PlyType ply_type(std::string_view name) {
+    if (name == "char" || name == "int8")
+        return PlyType::int8;
+    if (name == "uchar" || name == "uint8")
+        return PlyType::uint8;
+    if (name == "short" || name == "int16")
+        return PlyType::int16;
+    if (name == "ushort" || name == "uint16")
+        return PlyType::uint16;
+    if (name == "int" || name == "int32")
+        return PlyType::int32;
+    if (name == "uint" || name == "uint32")
+        return PlyType::uint32;
+    if (name == "float" || name == "float32")
+        return PlyType::float32;
+    if (name == "double" || name == "float64")
+        return PlyType::float64;
+    return PlyType::invalid;
+}
+
+inline int ply_type_size(PlyType type) {
+    switch (type) {
+    case PlyType::int8:
+    case PlyType::uint8:
+        return 1;
+    case PlyType::int16:
+    case PlyType::uint16:
+        return 2;
+    case PlyType::int32:
+    case PlyType::uint32:
+    case PlyType::float32:
+        return 4;
+    case PlyType::float64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PlyType::invalid;
+    PlyType count_type = PlyType::invalid; // set for list properties
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+// Reads one value of the given type, from text or binary, as a double.
+class PlyReader {
+public:
+    PlyReader(std::istream &in, PlyFormat format) : in_(in), format_(format) {}
+
+    bool read(PlyType type, double &value) {
+        if (format_ == PlyFormat::ascii) {
+            if (line_.empty() && !next_line())
+                return false;
+            std::string_view token = next_token(line_);
+            while (token.empty()) {
+                if (!next_line())
+                    return false;
+                token = next_token(line_);
+            }
+            return parse_number(token, value);
+        }
+
+        unsigned char bytes[8];
+        const int size = ply_type_size(type);
+        if (!in_.read(reinterpret_cast<char *>(bytes), size))
+            return false;
+        if ((format_ == PlyFormat::binary_big_endian) != (std::endian::native == std::endian::big))
+            std::reverse(bytes, bytes + size);
+
+        switch (type) {
+        case PlyType::int8: value = load<int8_t>(bytes); break;
+        case PlyType::uint8: value = load<uint8_t>(bytes); break;
+        case PlyType::int16: value = load<int16_t>(bytes); break;
+        case PlyType::uint16: value = load<uint16_t>(bytes); break;
+        case PlyType::int32: value = load<int32_t>(bytes); break;
+        case PlyType::uint32: value = load<uint32_t>(bytes); break;
+        case PlyType::float32: value = load<float>(bytes); break;
+        case PlyType::float64: value = load<double>(bytes); break;
+        default: return false;
+        }
+        return true;
+    }
+
+    // ASCII elements are one per line; drops what is left of the current one.
+    void end_element() { line_ = std::string_view(); }
+
+private:
+    template <typename T>
+    static T load(const unsigned char *bytes) {
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    bool next_line() {
+        if (!std::getline(in_, buffer_))
+            return false;
+        line_ = buffer_;
+        return true;
+    }
+
+    std::istream &in_;
+    PlyFormat format_;
+    std::string buffer_;
+    std::string_view line_;
+};
+
+} // namespace mesh_loader_detail
+
+// PLY with a vertex element (x, y, z and optionally nx, ny, nz and u, v or s, t) and a face
+// element with a vertex_indices list; other elements and properties are read past.
+inline bool load_ply(const std::string &path, MeshData &mesh) {
+    using namespace mesh_loader_detail;
+    mesh = MeshData();
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "Could not open mesh " << path << ".\n";
+        return false;
+    }
+    const auto fail = [&](const std::string &what) {
+        std::cerr << path << ": " << what << ".\n";
+        mesh = MeshData();
+        return false;
+    };
+
+    std::string line;
+    if (!std::getline(in, line) || line.rfind("ply", 0) != 0)
+        return fail("not a PLY file");
+
+    PlyFormat format = PlyFormat::ascii;
+    std::vector<PlyElement> elements;
+    while (true) {
+        if (!std::getline(in, line))
+            return fail("header ends early");
+        std::string_view rest(line);
+        const std::string_view keyword = next_token(rest);
+        if (keyword == "end_header")
+            break;
+
+        if (keyword == "format") {
+            const std::string_view name = next_token(rest);
+            if (name == "ascii")
+                format = PlyFormat::ascii;
+            else if (name == "binary_little_endian")
+                format = PlyFormat::binary_little_endian;
+            else if (name == "binary_big_endian")
+                format = PlyFormat::binary_big_endian;
+            else
+                return fail("unknown format " + std::string(name));
+        } else if (keyword == "element") {
+            PlyElement element;
+            element.name = next_token(rest);
+            if (!parse_number(next_token(rest), element.count))
+                return fail("bad element count");
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty())
+                return fail("property outside an element");
+            PlyProperty property;
+            std::string_view type = next_token(rest);
+            if (type == "list") {
+                property.count_type = ply_type(next_token(rest));
+                type = next_token(rest);
+                if (property.count_type == PlyType::invalid)
+                    return fail("bad list count type");
+            }
+            property.type = ply_type(type);
+            if (property.type == PlyType::invalid)
+                return fail("unknown property type " + std::string(type));
+            property.name = next_token(rest);
+            elements.back().properties.push_back(property);
+        }
+        // comment and obj_info lines are skipped.
+    }
+
+    PlyReader reader(in, format);
+    std::vector<uint32_t> polygon;
+
+    for (const PlyElement &element : elements) {
+        const bool is_vertex = element.name == "vertex";
+        const bool is_face = element.name == "face";
+
+        // Where each property of a vertex goes: 0-2 position, 3-5 normal, 6-7 uv, -1 nowhere.
+        std::vector<int> slots(element.properties.size(), -1);
+        bool has_normals = false;
+        bool has_uvs = false;
+        if (is_vertex) {
+            static const char *const names[][2] = {{"x", ""},  {"y", ""},  {"z", ""},
+                                                   {"nx", ""}, {"ny", ""}, {"nz", ""},
+                                                   {"u", "s"}, {"v", "t"}};
+            for (size_t p = 0; p < element.properties.size(); ++p) {
+                for (int slot = 0; slot < 8; ++slot) {
+                    if (element.properties[p].name == names[slot][0] ||
+                        element.properties[p].name == names[slot][1])
+                        slots[p] = slot;
+                }
+                has_normals |= slots[p] >= 3 && slots[p] <= 5;
+                has_uvs |= slots[p] >= 6;
+            }
+            mesh.positions.reserve(element.count);
+            if (has_normals)
+                mesh.normals.reserve(element.count);
+            if (has_uvs)
+                mesh.uvs.reserve(2 * element.count);
+        }
+
+        for (size_t i = 0; i < element.count; ++i) {
+            float values[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            for (size_t p = 0; p < element.properties.size(); ++p) {
+                const PlyProperty &property = element.properties[p];
+                double value;
+                if (property.count_type == PlyType::invalid) {
+                    if (!reader.read(property.type, value))
+                        return fail("data ends early in element " + element.name);
+                    if (slots[p] >= 0)
+                        values[slots[p]] = static_cast<float>(value);
+                    continue;
+                }
+
+                double count;
+                if (!reader.read(property.count_type, count) || count < 0)
+                    return fail("bad list in element " + element.name);
+                const bool indices = is_face && (property.name == "vertex_indices" ||
+                                                 property.name == "vertex_index");
+                polygon.clear();
+                for (int k = 0; k < static_cast<int>(count); ++k) {
+                    if (!reader.read(property.type, value))
+                        return fail("data ends early in element " + element.name);
+                    if (indices) {
+                        if (value < 0 || value >= static_cast<double>(mesh.positions.size()))
+                            return fail("vertex index out of range");
+                        polygon.push_back(static_cast<uint32_t>(value));
+                    }
+                }
+                for (size_t k = 1; k + 1 < polygon.size(); ++k) {
+                    mesh.indices.push_back(polygon[0]);
+                    mesh.indices.push_back(polygon[k]);
+                    mesh.indices.push_back(polygon[k + 1]);
+                }
+            }
+            reader.end_element();
+
+            if (is_vertex) {
+                mesh.positions.emplace_back(values[0], values[1], values[2]);
+                if (has_normals)
+                    mesh.normals.emplace_back(values[3], values[4], values[5]);
+                if (has_uvs) {
+                    mesh.uvs.push_back(values[6]);
+                    mesh.uvs.push_back(values[7]);
+                }
+            }
+        }
+    }
+
+    if (mesh.indices.empty())
+        return fail("no faces");
+    return true;
+}
+
+// Picks the reader by the extension of path, .obj or .ply.
+inline bool load_mesh(const std::string &path, MeshData &mesh) {
+    const size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == "obj")
+        return load_obj(path, mesh);
+    if (extension == "ply")
+        return load_ply(path, mesh);
+
+    std::cerr << "Unknown mesh format of " << path << "; expected .obj or .ply.\n";
+    mesh = MeshData();
+    return false;
+}
+
+// A TriangleMesh of the file at path, or nullptr if it cannot be read.
+inline shared_ptr<TriangleMesh> load_triangle_mesh(const std::string &path,
+                                                   shared_ptr<Material> material,
+                                                   const BvhBuildOptions &options =
+                                                       BvhBuildOptions()) {
+    MeshData mesh;
+    if (!load_mesh(path, mesh))
+        return nullptr;
+    return make_shared<TriangleMesh>(std::move(mesh), material, options);
+}
+
+#endif
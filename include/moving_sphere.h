@@ -14,10 +14,21 @@ public:
         : center0(cen0), center1(cen1), time0(_time0), time1(_time1), radius(r), material_pointer(m){};
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     virtual bool bounding_box(float _time0, float _time1, aabb &output_box) const override;
 
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
     Point3 center(float time) const;
 
+private:
+    // The nearest root of r in [t_min, t_max], if there is one.
+    bool find_root(const Ray &r, float t_min, float t_max, float &root) const;
+    void set_hit_record(float root, HitRecord &rec) const;
+
 public:
     Point3 center0, center1;
     float time0, time1;
@@ -30,6 +41,22 @@ inline Point3 moving_sphere::center(float time) const {
 }
 
 inline bool moving_sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    RT_STAT(moving_sphere_tests);
+    float root;
+    if (!find_root(r, t_min, t_max, root))
+        return false;
+
+    set_hit_record(root, rec);
+    return true;
+}
+
+inline bool moving_sphere::occluded(const Ray &r, float t_min, float t_max) const {
+    RT_STAT(moving_sphere_tests);
+    float root;
+    return find_root(r, t_min, t_max, root);
+}
+
+inline bool moving_sphere::find_root(const Ray &r, float t_min, float t_max, float &root) const {
     Vec3 oc = r.origin() - center(r.time());
     auto a = r.direction().length_squared();
     auto half_b = dot(oc, r.direction());
@@ -41,20 +68,69 @@ inline bool moving_sphere::hit(const Ray &r, float t_min, float t_max, HitRecord
     auto sqrtd = sqrt(discriminant);
 
     // Find the nearest root that lies in the acceptable range.
-    auto root = (-half_b - sqrtd) / a;
+    root = (-half_b - sqrtd) / a;
     if (root < t_min || t_max < root) {
         root = (-half_b + sqrtd) / a;
         if (root < t_min || t_max < root)
             return false;
     }
+    return true;
+}
 
+inline void moving_sphere::set_hit_record(float root, HitRecord &rec) const {
     rec.t = root;
+    rec.material_pointer = material_pointer.get();
+    rec.object = this;
+}
+
+inline void moving_sphere::finalize_hit(const Ray &r, HitRecord &rec) const {
     rec.p = r.at(rec.t);
     auto outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.material_pointer = material_pointer;
+}
 
-    return true;
+inline PacketMask moving_sphere::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                            HitRecord *recs) const {
+    RT_STAT_ADD(moving_sphere_tests, std::popcount(mask));
+
+    // Same arithmetic as hit(), one lane per iteration so the loop vectorizes.
+    float roots[packet_width];
+    int valid[packet_width];
+
+    for (int i = 0; i < packet_width; ++i) {
+        const float s = (packet.time[i] - time0) / (time1 - time0);
+        const float ocx = packet.origin[0][i] - (center0.x() + s * (center1.x() - center0.x()));
+        const float ocy = packet.origin[1][i] - (center0.y() + s * (center1.y() - center0.y()));
+        const float ocz = packet.origin[2][i] - (center0.z() + s * (center1.z() - center0.z()));
+        const float dx = packet.direction[0][i];
+        const float dy = packet.direction[1][i];
+        const float dz = packet.direction[2][i];
+
+        const float a = dx * dx + dy * dy + dz * dz;
+        const float half_b = ocx * dx + ocy * dy + ocz * dz;
+        const float c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius * radius;
+        const float discriminant = half_b * half_b - a * c;
+        const float sqrtd = sqrt(discriminant < 0 ? 0.0f : discriminant);
+
+        const float near_root = (-half_b - sqrtd) / a;
+        const float far_root = (-half_b + sqrtd) / a;
+        const bool near_ok = near_root >= t_min && near_root <= packet.t_max[i];
+        const bool far_ok = far_root >= t_min && far_root <= packet.t_max[i];
+
+        roots[i] = near_ok ? near_root : far_root;
+        valid[i] = !(discriminant < 0) && (near_ok || far_ok);
+    }
+
+    PacketMask hits = 0;
+    for (int i = 0; i < packet_width; ++i) {
+        hits |= static_cast<PacketMask>(valid[i]) << i;
+    }
+    hits &= mask;
+    for_each_lane(hits, [&](int lane) {
+        set_hit_record(roots[lane], recs[lane]);
+        packet.t_max[lane] = roots[lane];
+    });
+    return hits;
 }
 
 inline bool moving_sphere::bounding_box(float _time0, float _time1, aabb &output_box) const {
@@ -62,7 +138,7 @@ inline bool moving_sphere::bounding_box(float _time0, float _time1, aabb &output
               center(_time0) + Vec3(radius, radius, radius));
     aabb box1(center(_time1) - Vec3(radius, radius, radius),
               center(_time1) + Vec3(radius, radius, radius));
-    output_box = surrounding_box(box0, box0);
+    output_box = surrounding_box(box0, box1);
     return true;
 }
 
@@ -0,0 +1,145 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define RT_HAVE_PERF_EVENT 1
+#else
+#define RT_HAVE_PERF_EVENT 0
+#endif
+
+enum class PerfCounter {
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses,
+};
+
+constexpr int perf_counter_count = 4;
+
+inline const char *perf_counter_name(PerfCounter counter) {
+    switch (counter) {
+    case PerfCounter::cycles:
+        return "cycles";
+    case PerfCounter::instructions:
+        return "instructions";
+    case PerfCounter::cache_misses:
+        return "cache-misses";
+    case PerfCounter::branch_misses:
+        return "branch-misses";
+    }
+    return "unknown";
+}
+
+// Counts of one measured region. A counter the kernel or the hardware refused is left at -1;
+// counts are scaled up when the kernel had to multiplex the counters.
+struct PerfSample {
+    double values[perf_counter_count] = {-1, -1, -1, -1};
+
+    double operator[](PerfCounter counter) const { return values[static_cast<int>(counter)]; }
+    bool has(PerfCounter counter) const { return (*this)[counter] >= 0; }
+};
+
+// Hardware counters of the calling thread through Linux perf_event, user-space events only.
+// Elsewhere, or when perf_event_paranoid or a container forbids them, available() is false
+// and stop() returns an empty sample, so callers need no special casing.
+class PerfCounters {
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const;
+
+    void start();
+    PerfSample stop();
+
+private:
+    int fds_[perf_counter_count] = {-1, -1, -1, -1};
+};
+
+#if RT_HAVE_PERF_EVENT
+
+inline PerfCounters::PerfCounters() {
+    static const uint64_t configs[perf_counter_count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    for (int i = 0; i < perf_counter_count; ++i) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+}
+
+inline PerfCounters::~PerfCounters() {
+    for (const int fd : fds_) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+inline bool PerfCounters::available() const {
+    for (const int fd : fds_) {
+        if (fd >= 0)
+            return true;
+    }
+    return false;
+}
+
+inline void PerfCounters::start() {
+    for (const int fd : fds_) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+inline PerfSample PerfCounters::stop() {
+    PerfSample sample;
+    for (int i = 0; i < perf_counter_count; ++i) {
+        if (fds_[i] >= 0)
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (int i = 0; i < perf_counter_count; ++i) {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        sample.values[i] = static_cast<double>(data[0]) * data[1] / data[2];
+    }
+    return sample;
+}
+
+#else
+
+inline PerfCounters::PerfCounters() {}
+inline PerfCounters::~PerfCounters() {}
+inline bool PerfCounters::available() const { return false; }
+inline void PerfCounters::start() {}
+inline PerfSample PerfCounters::stop() { return PerfSample(); }
+
+#endif
+
+#endif
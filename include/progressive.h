@@ -0,0 +1,299 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "rtweekend.h"
+
+#include "image.h"
+#include "image_writer.h"
+#include "renderer.h"
+#include "timer.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Sums of the samples of every pixel over any number of passes. The sums are kept in double:
+// after many thousand samples a float sum no longer takes in the small ones.
+class Accumulator {
+public:
+    Accumulator() {}
+    Accumulator(int width, int height)
+        : width_(width), height_(height), sums_(static_cast<size_t>(width) * height * 3) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int samples() const { return samples_; }
+
+    // Adds a pass of sample_count samples per pixel, given as their average.
+    void add(const Image &pass, int sample_count);
+
+    // The average of all samples so far.
+    Image image() const;
+
+    // Binary checkpoint of the sums, tagged with everything that decides the samples: the
+    // scene, the image size, the seed, the path depth, the sampler and the light sampling.
+    // Both report failures to std::cerr; load() leaves the accumulator unchanged when the
+    // file is missing, damaged, from another format version or belongs to another render.
+    //
+    // The strata of the stratified sampler are laid out for settings.samples_per_pixel
+    // samples, so its checkpoints also record that total and are only resumed towards the
+    // same one; the other samplers continue their sequences to any total.
+    bool save(const std::string &path, const Scene &scene, const RenderSettings &settings) const;
+    bool load(const std::string &path, const Scene &scene, const RenderSettings &settings);
+
+private:
+    static constexpr uint32_t format_version = 2;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        char scene[32];
+        int32_t width;
+        int32_t height;
+        int32_t max_depth;
+        int32_t samples;
+        uint64_t seed;
+        int32_t sampler;
+        int32_t strata_samples; // samples_per_pixel for the stratified sampler, 0 otherwise
+        uint8_t sample_lights;
+        uint8_t trace_packets;
+        uint8_t adaptive;
+        uint8_t pad[5];
+    };
+
+    static Header make_header(const Scene &scene, const RenderSettings &settings, int width,
+                              int height, int samples);
+
+    int width_ = 0;
+    int height_ = 0;
+    int samples_ = 0;
+    std::vector<double> sums_; // red, green and blue of each pixel, bottom row first
+};
+
+inline void Accumulator::add(const Image &pass, int sample_count) {
+    for (int y = 0; y < height_; ++y) {
+        const Color *row = pass.row(y);
+        double *sums = &sums_[static_cast<size_t>(y) * width_ * 3];
+        for (int x = 0; x < width_; ++x) {
+            sums[3 * x + 0] += static_cast<double>(row[x].x()) * sample_count;
+            sums[3 * x + 1] += static_cast<double>(row[x].y()) * sample_count;
+            sums[3 * x + 2] += static_cast<double>(row[x].z()) * sample_count;
+        }
+    }
+    samples_ += sample_count;
+}
+
+inline Image Accumulator::image() const {
+    Image image(width_, height_);
+    const double scale = samples_ > 0 ? 1.0 / samples_ : 0.0;
+    for (int y = 0; y < height_; ++y) {
+        const double *sums = &sums_[static_cast<size_t>(y) * width_ * 3];
+        for (int x = 0; x < width_; ++x) {
+            image.at(x, y) = Color(static_cast<float>(sums[3 * x + 0] * scale),
+                                   static_cast<float>(sums[3 * x + 1] * scale),
+                                   static_cast<float>(sums[3 * x + 2] * scale));
+        }
+    }
+    return image;
+}
+
+inline Accumulator::Header Accumulator::make_header(const Scene &scene,
+                                                    const RenderSettings &settings, int width,
+                                                    int height, int samples) {
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "RTACCUM", 8);
+    header.version = format_version;
+    std::strncpy(header.scene, scene.name, sizeof(header.scene) - 1);
+    header.width = width;
+    header.height = height;
+    header.max_depth = settings.max_depth;
+    header.samples = samples;
+    header.seed = settings.seed;
+    header.sampler = static_cast<int32_t>(settings.sampler);
+    header.strata_samples =
+        settings.sampler == SamplerType::stratified ? settings.samples_per_pixel : 0;
+    header.sample_lights = settings.sample_lights;
+    header.trace_packets = settings.trace_packets;
+    header.adaptive = settings.adaptive;
+    return header;
+}
+
+inline bool Accumulator::save(const std::string &path, const Scene &scene,
+                              const RenderSettings &settings) const {
+    // Written next to the old checkpoint and renamed over it, so an interrupted write never
+    // destroys the last good one.
+    const std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream out(temporary_path, std::ios::binary);
+        const Header header = make_header(scene, settings, width_, height_, samples_);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(sums_.data()),
+                  static_cast<std::streamsize>(sums_.size() * sizeof(double)));
+        if (!out) {
+            std::cerr << "Could not write checkpoint " << temporary_path << ".\n";
+            return false;
+        }
+    }
+    // Unlike std::rename, this replaces an existing checkpoint on every platform.
+    std::error_code error;
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::cerr << "Could not replace checkpoint " << path << ": " << error.message() << ".\n";
+        return false;
+    }
+    return true;
+}
+
+inline bool Accumulator::load(const std::string &path, const Scene &scene,
+                              const RenderSettings &settings) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    Header header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    const Header expected = make_header(scene, settings, width_, height_, 0);
+    if (!in || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        std::cerr << "Checkpoint " << path << " is not an accumulator checkpoint.\n";
+        return false;
+    }
+    if (header.version != expected.version) {
+        std::cerr << "Checkpoint " << path << " has format version " << header.version
+                  << ", expected " << expected.version << "; starting over.\n";
+        return false;
+    }
+    header.scene[sizeof(header.scene) - 1] = 0;
+    if (std::memcmp(header.scene, expected.scene, sizeof(header.scene)) != 0 ||
+        header.width != expected.width || header.height != expected.height ||
+        header.max_depth != expected.max_depth || header.seed != expected.seed ||
+        header.sampler != expected.sampler || header.sample_lights != expected.sample_lights ||
+        header.trace_packets != expected.trace_packets || header.adaptive != expected.adaptive ||
+        header.samples < 0) {
+        std::cerr << "Checkpoint " << path << " belongs to another render (" << header.scene
+                  << ", " << header.width << "x" << header.height << "); starting over.\n";
+        return false;
+    }
+    if (header.strata_samples != expected.strata_samples) {
+        std::cerr << "Checkpoint " << path << " holds stratified samples laid out for "
+                  << header.strata_samples << " per pixel, not " << expected.strata_samples
+                  << "; starting over.\n";
+        return false;
+    }
+
+    std::vector<double> sums(sums_.size());
+    in.read(reinterpret_cast<char *>(sums.data()),
+            static_cast<std::streamsize>(sums.size() * sizeof(double)));
+    if (!in) {
+        std::cerr << "Checkpoint " << path << " is truncated; starting over.\n";
+        return false;
+    }
+
+    sums_ = std::move(sums);
+    samples_ = header.samples;
+    return true;
+}
+
+struct ProgressiveSettings {
+    int pass_samples = 16; // samples per pixel added by each pass
+    // Preview image written after the first pass and then at most every preview_seconds; none
+    // when the path is empty.
+    std::string preview_path;
+    double preview_seconds = 10.0;
+    // Checkpoint of the accumulator, written at most every checkpoint_seconds and after the
+    // last pass; none when the path is empty.
+    std::string checkpoint_path;
+    double checkpoint_seconds = 60.0;
+    // Continue from the checkpoint if one of the same render exists. A render resumed with the
+    // same pass_samples gives exactly the image of an uninterrupted one; asking for more
+    // samples than the checkpoint holds extends it, except with the stratified sampler, whose
+    // strata depend on the total (see Accumulator::save).
+    bool resume = true;
+};
+
+// Renders scene in passes of pass_samples samples per pixel until every pixel has
+// settings.samples_per_pixel, accumulating the passes. The samples of each pass continue the
+// per-pixel sample sequence, so the passes add up to the same estimate as a single render.
+// Adaptive sampling is turned off: the accumulator assumes every pixel got every sample.
+inline RenderResult render_progressive(const Scene &scene, const RenderSettings &settings,
+                                       const ProgressiveSettings &progressive,
+                                       AsyncImageWriter &image_writer) {
+    RenderSettings pass_settings = settings;
+    pass_settings.adaptive = false;
+    pass_settings.verbose = false;
+
+    const Renderer renderer(scene, pass_settings);
+    Accumulator accumulator(renderer.width(), renderer.height());
+
+    if (progressive.resume && !progressive.checkpoint_path.empty() &&
+        accumulator.load(progressive.checkpoint_path, scene, pass_settings) && settings.verbose) {
+        std::cerr << "Resuming from " << progressive.checkpoint_path << " at "
+                  << accumulator.samples() << " samples per pixel.\n";
+    }
+
+    RenderResult result;
+    result.bvh_build_seconds = renderer.bvh_build_seconds();
+
+    const int target = settings.samples_per_pixel;
+    const int pass_samples = std::max(1, progressive.pass_samples);
+    const Timer render_timer;
+    Timer preview_timer;
+    Timer checkpoint_timer;
+    bool previewed = false;
+
+    while (accumulator.samples() < target) {
+        const int first_sample = accumulator.samples();
+        const int count = std::min(pass_samples, target - first_sample);
+
+        const RenderResult pass = renderer.render(first_sample, count);
+        accumulator.add(pass.image, count);
+        result.path_stats.merge(pass.path_stats);
+        result.render_stats.merge(pass.render_stats);
+
+        if (settings.verbose) {
+            std::cerr << "\rSamples " << accumulator.samples() << " / " << target << " ("
+                      << std::fixed << std::setprecision(2) << pass.render_seconds
+                      << " s for the last pass)   " << std::flush;
+        }
+
+        const bool done = accumulator.samples() >= target;
+        if (!done && !progressive.preview_path.empty() &&
+            (!previewed || preview_timer.seconds() >= progressive.preview_seconds)) {
+            image_writer.submit(accumulator.image(), progressive.preview_path);
+            preview_timer.restart();
+            previewed = true;
+        }
+        if (!done && !progressive.checkpoint_path.empty() &&
+            checkpoint_timer.seconds() >= progressive.checkpoint_seconds) {
+            accumulator.save(progressive.checkpoint_path, scene, pass_settings);
+            checkpoint_timer.restart();
+        }
+    }
+
+    // The final checkpoint lets a later run extend the render to more samples.
+    if (!progressive.checkpoint_path.empty())
+        accumulator.save(progressive.checkpoint_path, scene, pass_settings);
+
+    result.render_seconds = render_timer.seconds();
+    if (settings.verbose) {
+        std::cerr << '\n';
+        result.path_stats.print(std::cerr);
+        if constexpr (render_stats_enabled)
+            result.render_stats.print(std::cerr,
+                                      static_cast<uint64_t>(accumulator.width()) *
+                                          accumulator.height());
+    }
+
+    result.image = accumulator.image();
+    result.primary_rays = result.path_stats.paths;
+    return result;
+}
+
+#endif
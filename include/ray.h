@@ -3,20 +3,42 @@
 
 #include "vec3.h"
 
+#include <cstdint>
+
+// Besides origin, direction and time, a ray carries what box tests need: the inverse of its
+// direction and, per axis, whether the direction is negative. Both are computed once when the
+// ray is made, so a traversal that tests many boxes does no divisions.
 class Ray {
 public:
     Ray() {
     }
     Ray(const Point3 &origin, const Vec3 &direction, float time = 0.0)
-        : origin_(origin), direction_(direction), time_(time) {
+        : Ray(origin, direction,
+              Vec3(1 / direction.x(), 1 / direction.y(), 1 / direction.z()), time) {
+    }
+    // For a direction whose inverse is already known, as with a moved ray or a packet lane.
+    Ray(const Point3 &origin, const Vec3 &direction, const Vec3 &inv_direction, float time)
+        : origin_(origin), direction_(direction), inv_direction_(inv_direction), time_(time) {
+        for (int a = 0; a < 3; ++a) {
+            sign_[a] = inv_direction[a] < 0 ? 1 : 0;
+        }
     }
 
-    Point3 origin() const {
+    const Point3 &origin() const {
         return origin_;
     }
-    Vec3 direction() const {
+    const Vec3 &direction() const {
         return direction_;
     }
+    // 1 / direction per axis; +-infinity along axes the ray runs parallel to.
+    const Vec3 &inv_direction() const {
+        return inv_direction_;
+    }
+    // 1 if the ray travels towards -axis, so it enters a box through its maximum plane on
+    // that axis; 0 otherwise.
+    int sign(int axis) const {
+        return sign_[axis];
+    }
     float time() const {
         return time_;
     }
@@ -25,10 +47,12 @@ public:
         return origin_ + t * direction_;
     }
 
-public:
+private:
     Point3 origin_;
     Vec3 direction_;
+    Vec3 inv_direction_;
     float time_;
+    uint8_t sign_[3];
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "ray.h"
+
+#include <bit>
+#include <cstdint>
+
+// Number of rays traced together by the packet path. 4 matches SSE, 8 AVX and 16 AVX-512;
+// the per-lane loops are written so the compiler can vectorize them for any of these.
+#ifndef RT_PACKET_WIDTH
+#define RT_PACKET_WIDTH 8
+#endif
+
+constexpr int packet_width = RT_PACKET_WIDTH;
+
+static_assert(packet_width == 4 || packet_width == 8 || packet_width == 16,
+              "RT_PACKET_WIDTH must be 4, 8 or 16");
+
+// One bit per lane.
+using PacketMask = uint32_t;
+
+constexpr PacketMask full_packet_mask = (1u << packet_width) - 1;
+
+// Calls f(lane) for every lane set in mask, lowest lane first.
+template <typename F>
+inline void for_each_lane(PacketMask mask, F &&f) {
+    while (mask) {
+        const int lane = std::countr_zero(mask);
+        mask &= mask - 1;
+        f(lane);
+    }
+}
+
+// A bundle of coherent rays stored as structure of arrays, so a primitive or a BVH node can
+// be tested against every lane in one pass. t_max holds each lane's closest hit so far and
+// shrinks as the packet is traced.
+struct alignas(64) RayPacket {
+    float origin[3][packet_width];
+    float direction[3][packet_width];
+    float inv_dir[3][packet_width];
+    float time[packet_width];
+    float t_max[packet_width];
+
+    void set(int lane, const Ray &r, float lane_t_max) {
+        for (int a = 0; a < 3; ++a) {
+            origin[a][lane] = r.origin()[a];
+            direction[a][lane] = r.direction()[a];
+            inv_dir[a][lane] = r.inv_direction()[a];
+        }
+        time[lane] = r.time();
+        t_max[lane] = lane_t_max;
+    }
+
+    Ray ray(int lane) const {
+        return Ray(Point3(origin[0][lane], origin[1][lane], origin[2][lane]),
+                   Vec3(direction[0][lane], direction[1][lane], direction[2][lane]),
+                   Vec3(inv_dir[0][lane], inv_dir[1][lane], inv_dir[2][lane]), time[lane]);
+    }
+};
+
+#endif
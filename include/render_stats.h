@@ -0,0 +1,141 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+// Counters on the hot paths, for finding out why one scene renders slower than another. Each
+// count is a thread-local increment, so they are compiled out unless RT_STATS is defined to 1
+// (CMake option RT_STATS); RT_STAT then expands to nothing and costs nothing.
+#ifndef RT_STATS
+#define RT_STATS 0
+#endif
+
+constexpr bool render_stats_enabled = RT_STATS != 0;
+
+enum class StatCounter {
+    rays,                // closest-hit queries against the scene, packet lanes included
+    packet_rays,         // the part of rays traced as packet lanes
+    shadow_rays,         // any-hit queries, which only ask whether something is in the way
+    bvh_nodes,           // inner nodes visited, any BVH
+    box_tests,           // bounding boxes tested; a wide node tests all of its children
+    sphere_tests,
+    moving_sphere_tests,
+    sphere_batch_tests,  // spheres tested by SphereBatch, eight per step
+    rectangle_tests,
+    triangle_tests,
+    medium_tests,
+    instance_tests,      // Instance, which transforms the ray and recurses
+    scatter_lambertian,
+    scatter_metal,
+    scatter_dielectric,
+    scatter_isotropic,
+};
+
+constexpr int stat_counter_count = 16;
+
+inline const char *stat_counter_name(StatCounter counter) {
+    switch (counter) {
+    case StatCounter::rays:
+        return "rays";
+    case StatCounter::packet_rays:
+        return "packet rays";
+    case StatCounter::shadow_rays:
+        return "shadow rays";
+    case StatCounter::bvh_nodes:
+        return "bvh nodes";
+    case StatCounter::box_tests:
+        return "box tests";
+    case StatCounter::sphere_tests:
+        return "sphere tests";
+    case StatCounter::moving_sphere_tests:
+        return "moving sphere tests";
+    case StatCounter::sphere_batch_tests:
+        return "sphere batch tests";
+    case StatCounter::rectangle_tests:
+        return "rectangle tests";
+    case StatCounter::triangle_tests:
+        return "triangle tests";
+    case StatCounter::medium_tests:
+        return "medium tests";
+    case StatCounter::instance_tests:
+        return "instance tests";
+    case StatCounter::scatter_lambertian:
+        return "lambertian scatters";
+    case StatCounter::scatter_metal:
+        return "metal scatters";
+    case StatCounter::scatter_dielectric:
+        return "dielectric scatters";
+    case StatCounter::scatter_isotropic:
+        return "isotropic scatters";
+    }
+    return "unknown";
+}
+
+struct RenderStats {
+    uint64_t counts[stat_counter_count] = {};
+
+    uint64_t &operator[](StatCounter counter) { return counts[static_cast<int>(counter)]; }
+    uint64_t operator[](StatCounter counter) const { return counts[static_cast<int>(counter)]; }
+
+    // Box and primitive tests: the work of finding hits, which the cost heatmap shows.
+    uint64_t cost() const {
+        uint64_t total = 0;
+        for (int i = static_cast<int>(StatCounter::box_tests);
+             i <= static_cast<int>(StatCounter::instance_tests); ++i) {
+            total += counts[i];
+        }
+        return total;
+    }
+
+    void merge(const RenderStats &other) {
+        for (int i = 0; i < stat_counter_count; ++i) {
+            counts[i] += other.counts[i];
+        }
+    }
+
+    // Totals, and per pixel when pixels is not zero.
+    void print(std::ostream &out, uint64_t pixels = 0) const {
+        out << std::setw(24) << std::left << "counters:" << std::right << std::setw(16) << "total";
+        if (pixels > 0)
+            out << std::setw(14) << "per pixel";
+        out << '\n';
+
+        for (int i = 0; i < stat_counter_count; ++i) {
+            out << "  " << std::setw(22) << std::left
+                << stat_counter_name(static_cast<StatCounter>(i)) << std::right
+                << std::setw(16) << counts[i];
+            if (pixels > 0)
+                out << std::setw(14) << std::fixed << std::setprecision(1)
+                    << static_cast<double>(counts[i]) / pixels;
+            out << '\n';
+        }
+    }
+};
+
+// The counters of the calling thread. The renderer clears them when a worker starts a tile
+// and merges them into the render's totals when it finishes.
+inline RenderStats &thread_render_stats() {
+    thread_local RenderStats stats;
+    return stats;
+}
+
+// thread_render_stats().cost(), or a constant 0 without RT_STATS so that code measuring costs
+// folds away.
+inline uint64_t thread_render_cost() {
+    if constexpr (render_stats_enabled)
+        return thread_render_stats().cost();
+    else
+        return 0;
+}
+
+#if RT_STATS
+#define RT_STAT_ADD(counter, n) (thread_render_stats()[StatCounter::counter] += (n))
+#else
+#define RT_STAT_ADD(counter, n) ((void)0)
+#endif
+
+#define RT_STAT(counter) RT_STAT_ADD(counter, 1)
+
+#endif
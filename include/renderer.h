@@ -0,0 +1,376 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "rtweekend.h"
+
+#include "camera.h"
+#include "image.h"
+#include "integrator.h"
+#include "ray_packet.h"
+#include "render_stats.h"
+#include "rng.h"
+#include "sampler.h"
+#include "tile_scheduler.h"
+#include "timer.h"
+#include "wide_bvh.h"
+#include "world.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+struct RenderSettings {
+    int image_width = 400;
+    int samples_per_pixel = 200;
+    int max_depth = 64;
+    int tile_size = 16;
+    int num_threads = 0; // 0: one per hardware thread
+    uint64_t seed = 0;   // mixed into the per-sample generator seeds
+    // Where the pixel, lens, time and scattering samples come from. The sequences spread the
+    // samples of a pixel more evenly than independent random numbers, so noise falls faster.
+    SamplerType sampler = SamplerType::sobol;
+    // Next-event estimation: diffuse bounces also sample the emitting rectangles of the scene
+    // directly, combined with the scattered rays by multiple importance sampling.
+    bool sample_lights = true;
+    // Trace the coherent primary rays of packet_width neighbouring pixels together; bounces
+    // after the first hit fall back to single rays. Ignored for scenes whose top-level
+    // objects draw samples in hit(), such as media.
+    bool trace_packets = true;
+    // Print progress, the tile timings and the path statistics to std::cerr.
+    bool verbose = true;
+
+    // Adaptive sampling. After min_samples, and again every adaptive_step samples, a pixel
+    // stops once the standard error of its displayed (gamma 2) luminance, and that of its
+    // neighbours in the row, is below error_threshold; samples_per_pixel becomes the limit.
+    bool adaptive = false;
+    int min_samples = 32;
+    int adaptive_step = 8;
+    float error_threshold = 0.01f;
+};
+
+struct RenderResult {
+    Image image; // linear, averaged over the samples of each pixel
+    PathStats path_stats;
+    double bvh_build_seconds = 0.0;
+    double render_seconds = 0.0;
+    uint64_t primary_rays = 0;
+    // With adaptive sampling only: the samples taken for every pixel, in all three channels.
+    Image sample_counts;
+    // With RT_STATS only: the merged hot-path counters, and the box and primitive tests per
+    // sample of every pixel in all three channels of cost.
+    RenderStats render_stats;
+    Image cost;
+};
+
+// False-colour rendering of a per-pixel quantity such as a cost or sample count image, black
+// through blue, green and yellow to red at top. Without a top the scale ends at the 99th
+// percentile, so a handful of extreme pixels do not wash out the rest. The colours are
+// squared because the image writers apply gamma 2.
+inline Image heatmap_image(const Image &values, float top = 0) {
+    const int width = values.width();
+    const int height = values.height();
+    Image heatmap(width, height);
+    if (width == 0 || height == 0)
+        return heatmap;
+
+    if (top <= 0) {
+        std::vector<float> sorted;
+        sorted.reserve(static_cast<size_t>(width) * height);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                sorted.push_back(values.at(x, y).x());
+            }
+        }
+        const size_t rank = sorted.size() * 99 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        top = sorted[rank];
+    }
+    const float scale = top > 0 ? 1 / top : 0.0f;
+
+    static const Color ramp[] = {Color(0, 0, 0), Color(0, 0, 1), Color(0, 1, 0), Color(1, 1, 0),
+                                 Color(1, 0, 0)};
+    constexpr int segments = static_cast<int>(sizeof(ramp) / sizeof(ramp[0])) - 1;
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float t = clamp(values.at(x, y).x() * scale, 0.0f, 1.0f) * segments;
+            const int i = std::min(static_cast<int>(t), segments - 1);
+            const Color c = ramp[i] + (t - i) * (ramp[i + 1] - ramp[i]);
+            heatmap.at(x, y) = c * c;
+        }
+    }
+    return heatmap;
+}
+
+// Running mean and variance of the luminance of one pixel's samples, by Welford's method,
+// next to the plain sum of the samples.
+class PixelEstimate {
+public:
+    void add(const Color &sample) {
+        sum_ += sample;
+        ++count_;
+        const double luminance = 0.2126 * sample.x() + 0.7152 * sample.y() + 0.0722 * sample.z();
+        const double delta = luminance - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (luminance - mean_);
+    }
+
+    int count() const { return count_; }
+
+    Color value() const {
+        const float scale = 1.0 / count_;
+        return scale * sum_;
+    }
+
+    // Standard error of the mean luminance after gamma 2 encoding, carried over from the
+    // linear standard error by the derivative of the square root.
+    double display_error() const {
+        if (count_ < 2)
+            return infinity;
+        const double standard_error = std::sqrt(m2_ / (count_ - 1) / count_);
+        return standard_error / (2 * std::sqrt(std::max(mean_, 1e-4)));
+    }
+
+private:
+    Color sum_;
+    int count_ = 0;
+    double mean_ = 0.0;
+    double m2_ = 0.0;
+};
+
+// The lanes of a group of neighbouring pixels, each holding count samples, that may stop
+// sampling: from min_samples on, every adaptive_step samples, a pixel stops once its own
+// error and the root mean square error of the whole group are below the threshold. Looking at
+// the neighbours keeps a pixel whose first samples all happened to miss the light, and so
+// show no variance, from stopping early with a too dark estimate.
+inline PacketMask converged_lanes(const PixelEstimate *estimates, int lanes, int count,
+                                  const RenderSettings &settings) {
+    if (count < settings.min_samples ||
+        (count - settings.min_samples) % std::max(1, settings.adaptive_step) != 0)
+        return 0;
+
+    double squared_errors = 0.0;
+    for (int lane = 0; lane < lanes; ++lane) {
+        const double error = estimates[lane].display_error();
+        squared_errors += error * error;
+    }
+    if (std::sqrt(squared_errors / lanes) >= settings.error_threshold)
+        return 0;
+
+    PacketMask converged = 0;
+    for (int lane = 0; lane < lanes; ++lane) {
+        if (estimates[lane].display_error() < settings.error_threshold)
+            converged |= 1u << lane;
+    }
+    return converged;
+}
+
+// Renders a scene with a WideBvh over its top-level objects, tiles handed out by a
+// work-stealing scheduler and the path integrator. The camera and the BVH are set up once, so
+// the samples of a pixel can be taken over several calls to render(). Every sample reseeds the
+// thread's generator from its pixel and index, so the image depends neither on the thread
+// count nor on how the samples are split up between calls.
+class Renderer {
+public:
+    Renderer(const Scene &scene, const RenderSettings &settings);
+
+    Renderer(const Renderer &) = delete;
+    Renderer &operator=(const Renderer &) = delete;
+
+    // Takes the samples first_sample to first_sample + sample_count - 1 of every pixel and
+    // returns their average. With adaptive sampling, sample_count is the limit.
+    RenderResult render(int first_sample, int sample_count) const;
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    double bvh_build_seconds() const { return bvh_build_seconds_; }
+
+private:
+    RenderSettings settings_;
+    int width_;
+    int height_;
+    Camera camera_;
+    WideBvh<> bvh_;
+    double bvh_build_seconds_ = 0.0;
+    bool trace_packets_;
+    LightList lights_;
+    PathIntegrator integrator_;
+};
+
+inline Renderer::Renderer(const Scene &scene, const RenderSettings &settings)
+    : settings_(settings), width_(settings.image_width),
+      height_(static_cast<int>(settings.image_width / scene.aspect_ratio)),
+      camera_(scene.look_from, scene.look_at, Vec3(0, 1, 0), scene.vertical_view_field,
+              scene.aspect_ratio, scene.aperture, 10.0, 0.0, 1.0),
+      trace_packets_(settings.trace_packets &&
+                     std::none_of(scene.world.objects.begin(), scene.world.objects.end(),
+                                  [](const auto &object) { return object->draws_samples(); })),
+      lights_(settings.sample_lights ? LightList(scene.world) : LightList()),
+      // Paths are traced iteratively; past a few bounces Russian roulette ends the dim ones.
+      integrator_(bvh_, scene.background,
+                  [&] {
+                      IntegratorOptions options;
+                      options.max_depth = settings.max_depth;
+                      return options;
+                  }(),
+                  &lights_) {
+    // Built here rather than in the initializer list, so the timing covers exactly the build.
+    // integrator_ holds a reference to bvh_, which stays the same object.
+    const Timer build_timer;
+    bvh_ = WideBvh<>(scene.world, 0.0, 1.0);
+    bvh_build_seconds_ = build_timer.seconds();
+}
+
+inline RenderResult Renderer::render(int first_sample, int sample_count) const {
+    RenderResult result;
+    result.bvh_build_seconds = bvh_build_seconds_;
+
+    const RenderSettings &settings = settings_;
+    const Sampler sampler(settings.sampler, settings.samples_per_pixel);
+    const int image_width = width_;
+    const int image_height = height_;
+    Image image(image_width, image_height);
+    Image cost(render_stats_enabled ? image_width : 0, render_stats_enabled ? image_height : 0);
+    Image sample_counts(settings.adaptive ? image_width : 0, settings.adaptive ? image_height : 0);
+
+    // Seeds the thread's generator and starts its sampler for one sample of a pixel.
+    auto start_sample = [&](uint64_t pixel, int sample) {
+        seed_thread_rng(pixel, sample, settings.seed);
+        thread_sampler() = sampler;
+        thread_sampler().start(pixel, sample, settings.seed);
+    };
+
+    auto store_pixel = [&](int x, int y, const PixelEstimate &estimate, uint64_t pixel_cost) {
+        image.at(x, y) = estimate.value();
+        if constexpr (render_stats_enabled)
+            cost.at(x, y) = Color(1, 1, 1) * (static_cast<float>(pixel_cost) / estimate.count());
+        if (settings.adaptive)
+            sample_counts.at(x, y) = Color(1, 1, 1) * static_cast<float>(estimate.count());
+    };
+
+    PathStats path_stats;
+    RenderStats render_stats;
+    std::mutex path_stats_mutex;
+
+    TileScheduler scheduler(image_width, image_height, settings.tile_size, settings.num_threads);
+    scheduler.set_progress(settings.verbose);
+
+    // Renders the pixels x0 to x1 - 1 of row y, at most packet_width of them, one sample of
+    // every pixel at a time. Pixels that converge drop out of the group.
+    auto render_pixels = [&](int x0, int x1, int y, PathStats &stats) {
+        const int lanes = x1 - x0;
+        PacketMask active = full_packet_mask >> (packet_width - lanes);
+        PixelEstimate estimates[packet_width];
+        uint64_t pixel_costs[packet_width] = {};
+
+        for (int s = 0; s < sample_count && active != 0; ++s) {
+            const int sample = first_sample + s;
+            CameraSamples camera_samples{};
+            Pcg32 lane_rngs[packet_width];
+            Sampler lane_samplers[packet_width];
+
+            // Every lane seeds its generator and sampler and draws its camera samples; the
+            // rays of the group are then set up together, and each lane later resumes its own
+            // generator and sampler, so packets and single rays render the same image. That
+            // holds as long as nothing draws samples during the packet traversal, which runs
+            // under the last lane's sampler; trace_packets_ is off for scenes where it would.
+            for_each_lane(active, [&](int lane) {
+                const int x = x0 + lane;
+                start_sample(y * image_width + x, sample);
+
+                const Point2 jitter = sample_2d();
+                camera_samples.draw(lane, (x + jitter.x) / (image_width - 1),
+                                    (y + jitter.y) / (image_height - 1));
+                lane_rngs[lane] = thread_rng();
+                lane_samplers[lane] = thread_sampler();
+            });
+
+            RayPacket packet;
+            camera_.get_rays(camera_samples, packet);
+
+            if (!trace_packets_) {
+                for_each_lane(active, [&](int lane) {
+                    const uint64_t lane_cost = thread_render_cost();
+                    thread_rng() = lane_rngs[lane];
+                    thread_sampler() = lane_samplers[lane];
+                    estimates[lane].add(integrator_.trace(packet.ray(lane), stats));
+                    pixel_costs[lane] += thread_render_cost() - lane_cost;
+                });
+            } else {
+                const int active_lanes = std::popcount(active);
+                RT_STAT_ADD(rays, active_lanes);
+                RT_STAT_ADD(packet_rays, active_lanes);
+                const uint64_t packet_cost = thread_render_cost();
+
+                HitRecord records[packet_width];
+                const PacketMask hits = bvh_.hit_packet(packet, active, ray_t_min, records);
+
+                // The packet traversal is shared out evenly over its lanes.
+                const uint64_t lane_share = (thread_render_cost() - packet_cost) / active_lanes;
+
+                for_each_lane(active, [&](int lane) {
+                    const uint64_t lane_cost = thread_render_cost();
+                    thread_rng() = lane_rngs[lane];
+                    thread_sampler() = lane_samplers[lane];
+                    HitRecord *first_hit = (hits >> lane) & 1u ? &records[lane] : nullptr;
+                    estimates[lane].add(integrator_.trace(packet.ray(lane), first_hit, stats));
+                    pixel_costs[lane] += lane_share + thread_render_cost() - lane_cost;
+                });
+            }
+
+            if (settings.adaptive)
+                active &= ~converged_lanes(estimates, lanes, s + 1, settings);
+        }
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            store_pixel(x0 + lane, y, estimates[lane], pixel_costs[lane]);
+        }
+    };
+
+    const Timer render_timer;
+
+    scheduler.run([&](const Tile &tile) {
+        PathStats tile_stats;
+        if constexpr (render_stats_enabled)
+            thread_render_stats() = RenderStats();
+
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x0 = tile.x0; x0 < tile.x1; x0 += packet_width) {
+                render_pixels(x0, std::min(x0 + packet_width, tile.x1), y, tile_stats);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(path_stats_mutex);
+        path_stats.merge(tile_stats);
+        if constexpr (render_stats_enabled)
+            render_stats.merge(thread_render_stats());
+    });
+
+    result.render_seconds = render_timer.seconds();
+
+    if (settings.verbose) {
+        scheduler.report(std::cerr);
+        path_stats.print(std::cerr);
+        if constexpr (render_stats_enabled)
+            render_stats.print(std::cerr, static_cast<uint64_t>(image_width) * image_height);
+    }
+
+    result.image = std::move(image);
+    result.path_stats = path_stats;
+    result.render_stats = render_stats;
+    result.cost = std::move(cost);
+    result.sample_counts = std::move(sample_counts);
+    result.primary_rays = path_stats.paths; // one path per camera sample
+    return result;
+}
+
+// Renders all samples_per_pixel samples of scene in one go.
+inline RenderResult render_scene(const Scene &scene, const RenderSettings &settings) {
+    const Renderer renderer(scene, settings);
+    return renderer.render(0, settings.samples_per_pixel);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// PCG32 (XSH-RR) generator: 16 bytes of state, no locks, no heap, and much cheaper to step
+// than std::mt19937. See https://www.pcg-random.org.
+class Pcg32 {
+public:
+    constexpr Pcg32() : state_(0x853c49e6748fea9bULL), inc_(0xda3e39cb94b95bdbULL) {}
+    constexpr Pcg32(uint64_t seed, uint64_t stream) : state_(0), inc_(0) { reseed(seed, stream); }
+
+    constexpr void reseed(uint64_t seed, uint64_t stream) {
+        // Every stream value selects a different sequence of the same period.
+        state_ = 0;
+        inc_ = (stream << 1u) | 1u;
+        next_uint();
+        state_ += seed;
+        next_uint();
+    }
+
+    constexpr uint32_t next_uint() {
+        const uint64_t old_state = state_;
+        state_ = old_state * 6364136223846793005ULL + inc_;
+        const uint32_t xorshifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        const uint32_t rot = static_cast<uint32_t>(old_state >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // Returns a random real in [0,1). Uses the top 24 bits so the result is exactly
+    // representable and never rounds up to 1.
+    constexpr float next_float() {
+        return static_cast<float>(next_uint() >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint64_t state_;
+    uint64_t inc_;
+};
+
+// SplitMix64 finalizer, used to turn structured seeds (pixel and sample indices) into
+// well-distributed generator states.
+constexpr uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 30;
+    v *= 0xbf58476d1ce4e5b9ULL;
+    v ^= v >> 27;
+    v *= 0x94d049bb133111ebULL;
+    v ^= v >> 31;
+    return v;
+}
+
+// The calling thread's generator. Each thread owns its state, so render threads never share
+// a cache line or race on it.
+inline Pcg32 &thread_rng() {
+    thread_local Pcg32 rng;
+    return rng;
+}
+
+// Restarts the calling thread's generator for one camera sample. The sequence depends only on
+// the pixel, the sample index and the frame seed, so a render is bit-reproducible no matter
+// how many threads run or which thread picks up which pixel.
+inline void seed_thread_rng(uint64_t pixel, uint64_t sample, uint64_t seed = 0) {
+    thread_rng().reseed(mix_bits(seed ^ mix_bits(pixel * 0x9e3779b97f4a7c15ULL + sample)), pixel);
+}
+
+#endif
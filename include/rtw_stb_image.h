@@ -7,7 +7,7 @@
     #pragma warning (push, 0)
 #endif
 
-#define STB_IMAGE_IMPLEMENTATION
+// The implementation is compiled once, in source/stb_image.cpp.
 #include "stb_image.h"
 
 // Restore warning levels.
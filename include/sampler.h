@@ -0,0 +1,353 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rtweekend.h"
+
+#include "rng.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+// How the random numbers of a camera sample are chosen.
+enum class SamplerType {
+    independent, // every number straight from the thread's generator
+    stratified,  // jittered strata per dimension, in an order shuffled per pixel and dimension
+    halton,      // scrambled Halton sequence, one prime base per dimension
+    sobol,       // Owen-scrambled Sobol (0,2) sequence, padded: a scramble per 1D or 2D sample
+};
+
+inline const char *sampler_type_name(SamplerType type) {
+    switch (type) {
+    case SamplerType::independent:
+        return "independent";
+    case SamplerType::stratified:
+        return "stratified";
+    case SamplerType::halton:
+        return "halton";
+    case SamplerType::sobol:
+        return "sobol";
+    }
+    return "unknown";
+}
+
+struct Point2 {
+    float x = 0;
+    float y = 0;
+};
+
+// The largest float below 1, so that mapped samples stay in [0, 1).
+constexpr float one_minus_epsilon = 0x1.fffffep-1f;
+
+// Kensler's hashed permutation: element i of a pseudo-random permutation of 0 to n - 1
+// picked by seed, without storing the permutation.
+inline uint32_t permutation_element(uint32_t i, uint32_t n, uint32_t seed) {
+    uint32_t w = n - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= n);
+    return (i + seed) % n;
+}
+
+constexpr uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Owen scrambling of bit-reversed values by Burley's hash ("Practical Hash-based Owen
+// Scrambling", JCGT 2020): every bit is flipped depending on the bits below it, which are the
+// more significant ones before the reversal.
+inline uint32_t owen_scramble_reversed(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline float bits_to_float(uint32_t bits) {
+    return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Direction numbers of the first two Sobol dimensions, the van der Corput sequence and the
+// one of the primitive polynomial x + 1; together they are a (0,2) sequence. They are folded
+// into tables of the XOR of the numbers selected by each nibble of the index, so a point
+// takes eight lookups instead of a branch per index bit. Index and point are both
+// bit-reversed, the form the Owen scramble works in.
+struct SobolTables {
+    uint32_t nibbles[2][8][16] = {};
+
+    constexpr SobolTables() {
+        for (int d = 0; d < 2; ++d) {
+            uint32_t v[32] = {};
+            for (int k = 0; k < 32; ++k) {
+                if (d == 0 || k == 0)
+                    v[k] = 1u << (31 - k);
+                else
+                    v[k] = v[k - 1] ^ (v[k - 1] >> 1);
+            }
+
+            for (int nibble = 0; nibble < 8; ++nibble) {
+                for (uint32_t value = 0; value < 16; ++value) {
+                    uint32_t bits = 0;
+                    for (int b = 0; b < 4; ++b) {
+                        if ((value >> b) & 1u)
+                            bits ^= v[31 - 4 * nibble - b];
+                    }
+                    nibbles[d][nibble][value] = reverse_bits(bits);
+                }
+            }
+        }
+    }
+};
+
+// The bit-reversed point of the bit-reversed index.
+inline uint32_t sobol_reversed(uint32_t reversed_index, int dimension) {
+    static constexpr SobolTables tables;
+    const auto &nibbles = tables.nibbles[dimension];
+    uint32_t bits = 0;
+    for (int nibble = 0; nibble < 8; ++nibble) {
+        bits ^= nibbles[nibble][(reversed_index >> (4 * nibble)) & 15u];
+    }
+    return bits;
+}
+
+// Radical inverse of index in base, with every digit shifted by an amount hashed from the
+// digits below it: a nested random digit scramble, the cheap relative of Owen scrambling.
+inline float scrambled_radical_inverse(uint32_t base, uint32_t index, uint32_t seed) {
+    const float inverse_base = 1.0f / base;
+    float inverse_base_power = 1.0f;
+    uint32_t reversed = 0;
+    uint32_t prefix_hash = seed;
+    // 24 bits, as many as a float holds.
+    while (inverse_base_power > 0x1p-24f) {
+        const uint32_t next = index / base;
+        const uint32_t digit = index - next * base;
+        const uint32_t shift = static_cast<uint32_t>((uint64_t(prefix_hash >> 8) * base) >> 24);
+        const uint32_t scrambled = digit + shift < base ? digit + shift : digit + shift - base;
+        reversed = reversed * base + scrambled;
+        prefix_hash = (prefix_hash ^ scrambled) * 0x9e3779b9u;
+        prefix_hash ^= prefix_hash >> 15;
+        inverse_base_power *= inverse_base;
+        index = next;
+    }
+    return std::min(reversed * inverse_base_power, one_minus_epsilon);
+}
+
+// Hands out the random numbers of one camera sample, dimension after dimension: the pixel
+// position first, then the lens and the time, then whatever each bounce asks for. The same
+// dimension of the samples of a pixel is well spread over [0, 1) for the sequence types;
+// dimensions the sequence does not cover come from the thread's generator. Sampler is a small
+// value, so a packet can keep one per lane like it keeps their generators.
+class Sampler {
+public:
+    Sampler() {}
+    Sampler(SamplerType type, int samples_per_pixel)
+        : type_(type), samples_per_pixel_(std::max(1, samples_per_pixel)) {}
+
+    SamplerType type() const { return type_; }
+
+    // Starts sample number sample of pixel. The scrambles depend on pixel and seed only, so
+    // the samples of a pixel form one sequence.
+    void start(uint64_t pixel, uint32_t sample, uint64_t seed) {
+        pixel_seed_ = mix_bits(seed ^ mix_bits(pixel * 0x9e3779b97f4a7c15ULL + 0x5bd1e995));
+        sample_ = sample;
+        dimension_ = 0;
+    }
+
+    float next_1d();
+    Point2 next_2d();
+
+private:
+    uint32_t dimension_seed(uint32_t dimension) const {
+        return static_cast<uint32_t>(mix_bits(pixel_seed_ ^ (dimension * 0x9e3779b97f4a7c15ULL)));
+    }
+
+    // The bit-reversed index of the current sample, shuffled by the seed of one Sobol sample.
+    uint32_t sobol_index(uint32_t seed) const {
+        return owen_scramble_reversed(reverse_bits(sample_), seed);
+    }
+    static float sobol(uint32_t index, int component, uint32_t seed);
+
+    static constexpr uint32_t halton_primes[16] = {2,  3,  5,  7,  11, 13, 17, 19,
+                                                   23, 29, 31, 37, 41, 43, 47, 53};
+
+    SamplerType type_ = SamplerType::independent;
+    int samples_per_pixel_ = 1;
+    uint64_t pixel_seed_ = 0;
+    uint32_t sample_ = 0;
+    uint32_t dimension_ = 0;
+};
+
+// Burley's padding: every 1D sample is the first Sobol dimension and every 2D sample the
+// first two, each with a scramble and a shuffle of the sample order of its own, so the 2D
+// samples of a pixel are all (0,2) sequences however many dimensions come before them.
+inline float Sampler::sobol(uint32_t index, int component, uint32_t seed) {
+    const uint32_t component_seed =
+        seed ^ (component + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+    return bits_to_float(reverse_bits(
+        owen_scramble_reversed(sobol_reversed(index, component), component_seed)));
+}
+
+inline float Sampler::next_1d() {
+    const uint32_t dimension = dimension_++;
+
+    switch (type_) {
+    case SamplerType::stratified: {
+        const auto n = static_cast<uint32_t>(samples_per_pixel_);
+        const uint32_t round = sample_ / n;
+        const uint32_t stratum =
+            permutation_element(sample_ % n, n, dimension_seed(dimension) ^ round * 0x2c1b3c6du);
+        return std::min((stratum + thread_rng().next_float()) / n, one_minus_epsilon);
+    }
+    case SamplerType::halton:
+        if (dimension < std::size(halton_primes))
+            return scrambled_radical_inverse(halton_primes[dimension], sample_,
+                                             dimension_seed(dimension));
+        break;
+    case SamplerType::sobol: {
+        const uint32_t seed = dimension_seed(dimension);
+        return sobol(sobol_index(seed), 0, seed);
+    }
+    case SamplerType::independent:
+        break;
+    }
+    return thread_rng().next_float();
+}
+
+inline Point2 Sampler::next_2d() {
+    switch (type_) {
+    case SamplerType::stratified: {
+        // A k by k grid, the largest that the samples of a pixel fill.
+        const auto k = std::max(1u, static_cast<uint32_t>(std::sqrt(samples_per_pixel_)));
+        const uint32_t n = k * k;
+        const uint32_t dimension = dimension_;
+        dimension_ += 2;
+        const uint32_t round = sample_ / n;
+        const uint32_t stratum =
+            permutation_element(sample_ % n, n, dimension_seed(dimension) ^ round * 0x2c1b3c6du);
+        Point2 p;
+        p.x = std::min((stratum % k + thread_rng().next_float()) / k, one_minus_epsilon);
+        p.y = std::min((stratum / k + thread_rng().next_float()) / k, one_minus_epsilon);
+        return p;
+    }
+    case SamplerType::sobol: {
+        const uint32_t seed = dimension_seed(dimension_);
+        dimension_ += 2;
+        const uint32_t index = sobol_index(seed);
+        Point2 p;
+        p.x = sobol(index, 0, seed);
+        p.y = sobol(index, 1, seed);
+        return p;
+    }
+    default:
+        break;
+    }
+
+    Point2 p;
+    p.x = next_1d();
+    p.y = next_1d();
+    return p;
+}
+
+// The calling thread's sampler. The renderer starts it for every camera sample, right after
+// seeding the thread's generator; elsewhere it is an independent sampler.
+inline Sampler &thread_sampler() {
+    thread_local Sampler sampler;
+    return sampler;
+}
+
+inline float sample_1d() { return thread_sampler().next_1d(); }
+inline Point2 sample_2d() { return thread_sampler().next_2d(); }
+
+// Closed-form mappings of the unit square, which use exactly one 2D sample where rejection
+// sampling draws an unknown number of them and breaks up the stratification.
+
+// Shirley and Chiu's concentric mapping of (x, y) in the unit square onto the unit disk. The
+// angle never leaves [-pi/4, pi/4] around an axis, where short Taylor polynomials are accurate
+// to float precision, and the branches are selects, so loops over many samples vectorize.
+inline void concentric_disk(float x, float y, float &disk_x, float &disk_y) {
+    x = 2 * x - 1;
+    y = 2 * y - 1;
+    const bool x_major = std::fabs(x) > std::fabs(y);
+    const float r = x_major ? x : y;
+    const float minor = x_major ? y : x;
+    // |minor| <= |r|, so the centre, where both are 0, gets angle 0.
+    const float angle = (PI / 4) * (minor / (r != 0 ? r : 1.0f));
+
+    const float a2 = angle * angle;
+    const float sine = angle * (1 + a2 * (-1.0f / 6 + a2 * (1.0f / 120 + a2 * (-1.0f / 5040))));
+    const float cosine =
+        1 + a2 * (-1.0f / 2 + a2 * (1.0f / 24 + a2 * (-1.0f / 720 + a2 * (1.0f / 40320))));
+    disk_x = r * (x_major ? cosine : sine);
+    disk_y = r * (x_major ? sine : cosine);
+}
+
+// The same in the xy plane.
+inline Vec3 square_to_disk(Point2 p) {
+    float x, y;
+    concentric_disk(p.x, p.y, x, y);
+    return Vec3(x, y, 0);
+}
+
+// Uniform on the unit sphere.
+inline Vec3 square_to_sphere(Point2 p) {
+    const float z = 1 - 2 * p.x;
+    const float r = std::sqrt(std::max(0.0f, 1 - z * z));
+    const float phi = 2 * PI * p.y;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Uniform on the hemisphere around +z.
+inline Vec3 square_to_hemisphere(Point2 p) {
+    const float z = p.x;
+    const float r = std::sqrt(std::max(0.0f, 1 - z * z));
+    const float phi = 2 * PI * p.y;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Cosine-weighted on the hemisphere around +z, by projecting the disk up (Malley's method).
+inline Vec3 square_to_cosine_hemisphere(Point2 p) {
+    const Vec3 d = square_to_disk(p);
+    return Vec3(d.x(), d.y(), std::sqrt(std::max(0.0f, 1 - d.x() * d.x() - d.y() * d.y())));
+}
+
+// The sampler counterparts of the random_ functions in vec3.h.
+inline Vec3 sample_unit_vector() { return square_to_sphere(sample_2d()); }
+
+inline Vec3 sample_in_unit_disk() { return square_to_disk(sample_2d()); }
+
+inline Vec3 sample_in_unit_sphere() {
+    const Vec3 direction = square_to_sphere(sample_2d());
+    return std::cbrt(sample_1d()) * direction;
+}
+
+#endif
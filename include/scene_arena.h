@@ -0,0 +1,63 @@
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+#include "rtweekend.h"
+
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+
+// Allocator over a shared monotonic resource. Every copy holds a reference to the resource,
+// so the memory stays valid for as long as any object placed in it, wherever the shared_ptrs
+// to those objects end up. deallocate() does nothing: the memory is returned all at once when
+// the last reference goes.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(shared_ptr<std::pmr::monotonic_buffer_resource> resource)
+        : resource_(std::move(resource)) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : resource_(other.resource()) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T *, size_t) {}
+
+    const shared_ptr<std::pmr::monotonic_buffer_resource> &resource() const { return resource_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return resource_ == other.resource();
+    }
+
+private:
+    shared_ptr<std::pmr::monotonic_buffer_resource> resource_;
+};
+
+// Memory for the objects of one scene: primitives, materials, textures and nested BVHs are
+// placed one after another in large blocks, in the order the scene builds them, instead of
+// each getting its own heap allocation. Objects are still handed out as shared_ptrs, with the
+// reference count beside the object in the block; their destructors run as usual, and the
+// blocks are freed together once the arena and every object in it are gone.
+//
+// Building a scene is single threaded; make() must not be called from several threads at
+// once.
+class SceneArena {
+public:
+    explicit SceneArena(size_t initial_block_size = 1 << 16)
+        : resource_(make_shared<std::pmr::monotonic_buffer_resource>(initial_block_size)) {}
+
+    template <typename T, typename... Args>
+    shared_ptr<T> make(Args &&...args) {
+        return std::allocate_shared<T>(ArenaAllocator<T>(resource_), std::forward<Args>(args)...);
+    }
+
+private:
+    shared_ptr<std::pmr::monotonic_buffer_resource> resource_;
+};
+
+#endif
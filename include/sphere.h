@@ -14,9 +14,19 @@ public:
         : center_(center), radius_(radius), material_pointer_(material_pointer){};
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
 
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual void finalize_hit(const Ray &ray, HitRecord &record) const override;
+
 private:
+    // The nearest root of the ray in [t_min, t_max], if there is one.
+    bool find_root(const Ray &ray, float t_min, float t_max, float &root) const;
+    void set_hit_record(float root, HitRecord &record) const;
+
     static void get_sphere_uv(const Point3 &point, float &u, float &v) {
         // p: a given point on the sphere of radius one, centered at the origin.
         // u: returned value [0,1] of angle around the Y axis from X=-1.
@@ -38,6 +48,22 @@ public:
 };
 
 inline bool Sphere::hit(const Ray &ray, float t_min, float t_max, HitRecord &record) const {
+    RT_STAT(sphere_tests);
+    float root;
+    if (!find_root(ray, t_min, t_max, root))
+        return false;
+
+    set_hit_record(root, record);
+    return true;
+}
+
+inline bool Sphere::occluded(const Ray &ray, float t_min, float t_max) const {
+    RT_STAT(sphere_tests);
+    float root;
+    return find_root(ray, t_min, t_max, root);
+}
+
+inline bool Sphere::find_root(const Ray &ray, float t_min, float t_max, float &root) const {
     // t^2 b⋅b + 2tb⋅(A - C) + (A - C)⋅(A - C) - r^2 = 0
     Vec3 oc = ray.origin() - center_;
     const float a = ray.direction().length_squared();
@@ -50,22 +76,69 @@ inline bool Sphere::hit(const Ray &ray, float t_min, float t_max, HitRecord &rec
     const float sqrtd = sqrt(discriminant);
 
     // Find the nearest root that lies in the acceptable range.
-    float root = (-half_b - sqrtd) / a;
+    root = (-half_b - sqrtd) / a;
     if (root < t_min || t_max < root) {
         root = (-half_b + sqrtd) / a;
         if (root < t_min || t_max < root)
             return false;
     }
+    return true;
+}
 
-    // record
+inline void Sphere::set_hit_record(float root, HitRecord &record) const {
     record.t = root;
+    record.material_pointer = material_pointer_.get();
+    record.object = this;
+}
+
+inline void Sphere::finalize_hit(const Ray &ray, HitRecord &record) const {
     record.p = ray.at(record.t);
     Vec3 outward_normal = (record.p - center_) / radius_;
     record.set_face_normal(ray, outward_normal);
     get_sphere_uv(outward_normal, record.u, record.v);
-    record.material_pointer = material_pointer_;
+}
 
-    return true;
+inline PacketMask Sphere::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                     HitRecord *recs) const {
+    RT_STAT_ADD(sphere_tests, std::popcount(mask));
+
+    // Same arithmetic as hit(), one lane per iteration so the loop vectorizes.
+    float roots[packet_width];
+    int valid[packet_width];
+
+    for (int i = 0; i < packet_width; ++i) {
+        const float ocx = packet.origin[0][i] - center_.x();
+        const float ocy = packet.origin[1][i] - center_.y();
+        const float ocz = packet.origin[2][i] - center_.z();
+        const float dx = packet.direction[0][i];
+        const float dy = packet.direction[1][i];
+        const float dz = packet.direction[2][i];
+
+        const float a = dx * dx + dy * dy + dz * dz;
+        const float half_b = ocx * dx + ocy * dy + ocz * dz;
+        const float c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius_ * radius_;
+        const float discriminant = half_b * half_b - a * c;
+        const float sqrtd = sqrt(discriminant < 0 ? 0.0f : discriminant);
+
+        const float near_root = (-half_b - sqrtd) / a;
+        const float far_root = (-half_b + sqrtd) / a;
+        const bool near_ok = near_root >= t_min && near_root <= packet.t_max[i];
+        const bool far_ok = far_root >= t_min && far_root <= packet.t_max[i];
+
+        roots[i] = near_ok ? near_root : far_root;
+        valid[i] = !(discriminant < 10e-3) && (near_ok || far_ok);
+    }
+
+    PacketMask hits = 0;
+    for (int i = 0; i < packet_width; ++i) {
+        hits |= static_cast<PacketMask>(valid[i]) << i;
+    }
+    hits &= mask;
+    for_each_lane(hits, [&](int lane) {
+        set_hit_record(roots[lane], recs[lane]);
+        packet.t_max[lane] = roots[lane];
+    });
+    return hits;
 }
 
 inline bool Sphere::bounding_box(float time0, float time1, aabb &output_box) const {
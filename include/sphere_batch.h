@@ -0,0 +1,362 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include "rtweekend.h"
+
+#include "bvh_builder.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "moving_sphere.h"
+#include "sphere.h"
+
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#define RT_SPHERE_BATCH_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_SPHERE_BATCH_SSE 1
+#endif
+
+#if defined(RT_SPHERE_BATCH_AVX) || defined(RT_SPHERE_BATCH_SSE)
+#include <immintrin.h>
+#endif
+
+// Many static and moving spheres stored as structure of arrays, so one ray is tested against
+// eight of them per step (one AVX register or two SSE registers) and through a single virtual
+// call. Only the closest hit fills the HitRecord.
+class SphereBatch : public Hittable {
+public:
+    static constexpr int lane_count = 8;
+
+    SphereBatch() {}
+
+    void add(const Point3 &center, float radius, shared_ptr<Material> material);
+    void add(const Point3 &center0, const Point3 &center1, float time0, float time1, float radius,
+             shared_ptr<Material> material);
+
+    void add(const Sphere &sphere) {
+        add(sphere.center_, sphere.radius_, sphere.material_pointer_);
+    }
+    void add(const moving_sphere &sphere) {
+        add(sphere.center0, sphere.center1, sphere.time0, sphere.time1, sphere.radius,
+            sphere.material_pointer);
+    }
+
+    size_t size() const { return count_; }
+
+    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
+
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    // Bounds of sphere i over [time0, time1].
+    aabb sphere_box(size_t i, float time0, float time1) const;
+
+    // Copies sphere i into another batch.
+    void copy_sphere(size_t i, SphereBatch &target) const;
+
+private:
+    // Tests the eight spheres starting at base. Returns a bit mask of those with a root in
+    // [t_min, t_max] and stores the roots.
+    int hit_lanes(size_t base, const Ray &r, float t_min, float t_max, float *roots) const;
+
+    Point3 center(size_t i, float time) const;
+
+private:
+    size_t count_ = 0;
+    // Padded to a multiple of lane_count; padding lanes never report a hit.
+    std::vector<float> center_x_, center_y_, center_z_;
+    std::vector<float> motion_x_, motion_y_, motion_z_; // center1 - center0, zero when static
+    std::vector<float> time0_, time1_;
+    std::vector<float> radius_;
+    // Sphere rejects grazing hits below 10e-3, moving_sphere only negative discriminants.
+    std::vector<float> min_discriminant_;
+    std::vector<uint32_t> material_;
+    MaterialRegistry materials_;
+};
+
+inline void SphereBatch::add(const Point3 &center, float radius, shared_ptr<Material> material) {
+    add(center, center, 0, 1, radius, material);
+    min_discriminant_[count_ - 1] = 10e-3;
+}
+
+inline void SphereBatch::add(const Point3 &center0, const Point3 &center1, float time0,
+                             float time1, float radius, shared_ptr<Material> material) {
+    if (count_ % lane_count == 0) {
+        const size_t padded = count_ + lane_count;
+        for (auto *v : {&center_x_, &center_y_, &center_z_, &motion_x_, &motion_y_, &motion_z_,
+                        &time0_, &radius_}) {
+            v->resize(padded, 0.0f);
+        }
+        time1_.resize(padded, 1.0f);
+        min_discriminant_.resize(padded, infinity);
+        material_.resize(padded, 0);
+    }
+
+    const size_t i = count_++;
+    center_x_[i] = center0.x();
+    center_y_[i] = center0.y();
+    center_z_[i] = center0.z();
+    motion_x_[i] = center1.x() - center0.x();
+    motion_y_[i] = center1.y() - center0.y();
+    motion_z_[i] = center1.z() - center0.z();
+    time0_[i] = time0;
+    time1_[i] = time1;
+    radius_[i] = radius;
+    min_discriminant_[i] = 0.0f;
+    material_[i] = materials_.add(material);
+}
+
+inline Point3 SphereBatch::center(size_t i, float time) const {
+    const float s = (time - time0_[i]) / (time1_[i] - time0_[i]);
+    return Point3(center_x_[i] + s * motion_x_[i], center_y_[i] + s * motion_y_[i],
+                  center_z_[i] + s * motion_z_[i]);
+}
+
+inline int SphereBatch::hit_lanes(size_t base, const Ray &r, float t_min, float t_max,
+                                  float *roots) const {
+    // The arithmetic follows Sphere::hit and moving_sphere::hit step by step, so a batch finds
+    // exactly the hits the individual spheres would.
+    const float time = r.time();
+    const Vec3 &direction = r.direction();
+    const float a = direction.length_squared();
+
+#if defined(RT_SPHERE_BATCH_AVX)
+    const __m256 time_v = _mm256_set1_ps(time);
+    const __m256 s = _mm256_div_ps(
+        _mm256_sub_ps(time_v, _mm256_loadu_ps(&time0_[base])),
+        _mm256_sub_ps(_mm256_loadu_ps(&time1_[base]), _mm256_loadu_ps(&time0_[base])));
+
+    const __m256 ocx = _mm256_sub_ps(
+        _mm256_set1_ps(r.origin().x()),
+        _mm256_add_ps(_mm256_loadu_ps(&center_x_[base]),
+                      _mm256_mul_ps(s, _mm256_loadu_ps(&motion_x_[base]))));
+    const __m256 ocy = _mm256_sub_ps(
+        _mm256_set1_ps(r.origin().y()),
+        _mm256_add_ps(_mm256_loadu_ps(&center_y_[base]),
+                      _mm256_mul_ps(s, _mm256_loadu_ps(&motion_y_[base]))));
+    const __m256 ocz = _mm256_sub_ps(
+        _mm256_set1_ps(r.origin().z()),
+        _mm256_add_ps(_mm256_loadu_ps(&center_z_[base]),
+                      _mm256_mul_ps(s, _mm256_loadu_ps(&motion_z_[base]))));
+
+    const __m256 dx = _mm256_set1_ps(direction.x());
+    const __m256 dy = _mm256_set1_ps(direction.y());
+    const __m256 dz = _mm256_set1_ps(direction.z());
+    const __m256 a_v = _mm256_set1_ps(a);
+
+    const __m256 half_b = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+    const __m256 radius = _mm256_loadu_ps(&radius_[base]);
+    const __m256 c = _mm256_sub_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                      _mm256_mul_ps(ocz, ocz)),
+        _mm256_mul_ps(radius, radius));
+    const __m256 discriminant =
+        _mm256_sub_ps(_mm256_mul_ps(half_b, half_b), _mm256_mul_ps(a_v, c));
+    const __m256 grazing =
+        _mm256_cmp_ps(discriminant, _mm256_loadu_ps(&min_discriminant_[base]), _CMP_LT_OQ);
+    // Most batches miss entirely; skip the square root and divisions for them.
+    if (_mm256_movemask_ps(grazing) == 0xff)
+        return 0;
+
+    const __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+
+    const __m256 neg_half_b = _mm256_sub_ps(_mm256_setzero_ps(), half_b);
+    const __m256 near_root = _mm256_div_ps(_mm256_sub_ps(neg_half_b, sqrtd), a_v);
+    const __m256 far_root = _mm256_div_ps(_mm256_add_ps(neg_half_b, sqrtd), a_v);
+
+    const __m256 t_min_v = _mm256_set1_ps(t_min);
+    const __m256 t_max_v = _mm256_set1_ps(t_max);
+    const __m256 near_ok = _mm256_and_ps(_mm256_cmp_ps(near_root, t_min_v, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(near_root, t_max_v, _CMP_LE_OQ));
+    const __m256 far_ok = _mm256_and_ps(_mm256_cmp_ps(far_root, t_min_v, _CMP_GE_OQ),
+                                        _mm256_cmp_ps(far_root, t_max_v, _CMP_LE_OQ));
+
+    _mm256_storeu_ps(roots, _mm256_blendv_ps(far_root, near_root, near_ok));
+    return _mm256_movemask_ps(_mm256_andnot_ps(grazing, _mm256_or_ps(near_ok, far_ok)));
+#elif defined(RT_SPHERE_BATCH_SSE)
+    int mask = 0;
+    for (int half = 0; half < lane_count; half += 4) {
+        const size_t i = base + half;
+        const __m128 s =
+            _mm_div_ps(_mm_sub_ps(_mm_set1_ps(time), _mm_loadu_ps(&time0_[i])),
+                       _mm_sub_ps(_mm_loadu_ps(&time1_[i]), _mm_loadu_ps(&time0_[i])));
+
+        const __m128 ocx = _mm_sub_ps(
+            _mm_set1_ps(r.origin().x()),
+            _mm_add_ps(_mm_loadu_ps(&center_x_[i]), _mm_mul_ps(s, _mm_loadu_ps(&motion_x_[i]))));
+        const __m128 ocy = _mm_sub_ps(
+            _mm_set1_ps(r.origin().y()),
+            _mm_add_ps(_mm_loadu_ps(&center_y_[i]), _mm_mul_ps(s, _mm_loadu_ps(&motion_y_[i]))));
+        const __m128 ocz = _mm_sub_ps(
+            _mm_set1_ps(r.origin().z()),
+            _mm_add_ps(_mm_loadu_ps(&center_z_[i]), _mm_mul_ps(s, _mm_loadu_ps(&motion_z_[i]))));
+
+        const __m128 a_v = _mm_set1_ps(a);
+        const __m128 half_b =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, _mm_set1_ps(direction.x())),
+                                  _mm_mul_ps(ocy, _mm_set1_ps(direction.y()))),
+                       _mm_mul_ps(ocz, _mm_set1_ps(direction.z())));
+        const __m128 radius = _mm_loadu_ps(&radius_[i]);
+        const __m128 c = _mm_sub_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)),
+                       _mm_mul_ps(ocz, ocz)),
+            _mm_mul_ps(radius, radius));
+        const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(a_v, c));
+        const __m128 grazing = _mm_cmplt_ps(discriminant, _mm_loadu_ps(&min_discriminant_[i]));
+        if (_mm_movemask_ps(grazing) == 0xf)
+            continue;
+
+        const __m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(discriminant, _mm_setzero_ps()));
+        const __m128 neg_half_b = _mm_sub_ps(_mm_setzero_ps(), half_b);
+        const __m128 near_root = _mm_div_ps(_mm_sub_ps(neg_half_b, sqrtd), a_v);
+        const __m128 far_root = _mm_div_ps(_mm_add_ps(neg_half_b, sqrtd), a_v);
+
+        const __m128 t_min_v = _mm_set1_ps(t_min);
+        const __m128 t_max_v = _mm_set1_ps(t_max);
+        const __m128 near_ok =
+            _mm_and_ps(_mm_cmpge_ps(near_root, t_min_v), _mm_cmple_ps(near_root, t_max_v));
+        const __m128 far_ok =
+            _mm_and_ps(_mm_cmpge_ps(far_root, t_min_v), _mm_cmple_ps(far_root, t_max_v));
+
+        _mm_storeu_ps(roots + half, _mm_or_ps(_mm_and_ps(near_ok, near_root),
+                                              _mm_andnot_ps(near_ok, far_root)));
+        mask |= _mm_movemask_ps(_mm_andnot_ps(grazing, _mm_or_ps(near_ok, far_ok))) << half;
+    }
+    return mask;
+#else
+    int mask = 0;
+    for (int l = 0; l < lane_count; ++l) {
+        const size_t i = base + l;
+        const float s = (time - time0_[i]) / (time1_[i] - time0_[i]);
+        const float ocx = r.origin().x() - (center_x_[i] + s * motion_x_[i]);
+        const float ocy = r.origin().y() - (center_y_[i] + s * motion_y_[i]);
+        const float ocz = r.origin().z() - (center_z_[i] + s * motion_z_[i]);
+
+        const float half_b = ocx * direction.x() + ocy * direction.y() + ocz * direction.z();
+        const float c = (ocx * ocx + ocy * ocy + ocz * ocz) - radius_[i] * radius_[i];
+        const float discriminant = half_b * half_b - a * c;
+        const float sqrtd = sqrt(discriminant < 0 ? 0.0f : discriminant);
+
+        const float near_root = (-half_b - sqrtd) / a;
+        const float far_root = (-half_b + sqrtd) / a;
+        const bool near_ok = near_root >= t_min && near_root <= t_max;
+        const bool far_ok = far_root >= t_min && far_root <= t_max;
+
+        roots[l] = near_ok ? near_root : far_root;
+        mask |= (!(discriminant < min_discriminant_[i]) && (near_ok || far_ok)) << l;
+    }
+    return mask;
+#endif
+}
+
+inline bool SphereBatch::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    size_t closest = count_;
+    float roots[lane_count];
+
+    for (size_t base = 0; base < count_; base += lane_count) {
+        RT_STAT_ADD(sphere_batch_tests, lane_count);
+        int mask = hit_lanes(base, r, t_min, t_max, roots);
+        while (mask) {
+            const int lane = std::countr_zero(static_cast<unsigned>(mask));
+            mask &= mask - 1;
+            // <= so that, as with a list of spheres, the later of two equal hits wins.
+            if (roots[lane] <= t_max) {
+                t_max = roots[lane];
+                closest = base + lane;
+            }
+        }
+    }
+
+    if (closest == count_)
+        return false;
+
+    rec.t = t_max;
+    rec.material_pointer = materials_.get(material_[closest]);
+    rec.object = this;
+    rec.primitive = static_cast<uint32_t>(closest);
+    return true;
+}
+
+inline bool SphereBatch::occluded(const Ray &r, float t_min, float t_max) const {
+    float roots[lane_count];
+    for (size_t base = 0; base < count_; base += lane_count) {
+        RT_STAT_ADD(sphere_batch_tests, lane_count);
+        if (hit_lanes(base, r, t_min, t_max, roots) != 0)
+            return true;
+    }
+    return false;
+}
+
+inline void SphereBatch::finalize_hit(const Ray &r, HitRecord &rec) const {
+    const size_t i = rec.primitive;
+    const Point3 sphere_center = center(i, r.time());
+    rec.p = r.at(rec.t);
+    const Vec3 outward_normal = (rec.p - sphere_center) / radius_[i];
+    rec.set_face_normal(r, outward_normal);
+    const float theta = acos(-outward_normal.y());
+    const float phi = std::atan2(-outward_normal.z(), outward_normal.x()) + PI;
+    rec.u = phi / (2 * PI);
+    rec.v = theta / PI;
+}
+
+inline aabb SphereBatch::sphere_box(size_t i, float time0, float time1) const {
+    const Vec3 extent(radius_[i], radius_[i], radius_[i]);
+    const Point3 c0 = center(i, time0);
+    const Point3 c1 = center(i, time1);
+    return surrounding_box(aabb(c0 - extent, c0 + extent), aabb(c1 - extent, c1 + extent));
+}
+
+inline bool SphereBatch::bounding_box(float time0, float time1, aabb &output_box) const {
+    if (count_ == 0)
+        return false;
+
+    output_box = sphere_box(0, time0, time1);
+    for (size_t i = 1; i < count_; ++i) {
+        output_box = surrounding_box(output_box, sphere_box(i, time0, time1));
+    }
+    return true;
+}
+
+inline void SphereBatch::copy_sphere(size_t i, SphereBatch &target) const {
+    const Point3 center0(center_x_[i], center_y_[i], center_z_[i]);
+    const Point3 center1 = center0 + Vec3(motion_x_[i], motion_y_[i], motion_z_[i]);
+    target.add(center0, center1, time0_[i], time1_[i], radius_[i], materials_.shared(material_[i]));
+    target.min_discriminant_[target.count_ - 1] = min_discriminant_[i];
+}
+
+// Groups the spheres into SAH leaves of up to lane_count spheres each, one batch per leaf, so
+// a BVH over the returned list holds spatially coherent batches in its leaves.
+inline HittableList make_sphere_batches(const SphereBatch &spheres, float time0, float time1) {
+    std::vector<aabb> boxes(spheres.size());
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        boxes[i] = spheres.sphere_box(i, time0, time1);
+    }
+
+    // Up to lane_count spheres cost about as much as one, so leaves are filled up.
+    BvhBuildOptions options;
+    options.max_leaf_size = SphereBatch::lane_count;
+    options.intersection_cost = 1.0f / SphereBatch::lane_count;
+    const BvhBuild build = build_sah_bvh(boxes, options);
+
+    HittableList batches;
+    for (const BvhBuildNode &node : build.nodes) {
+        if (node.count == 0)
+            continue;
+        auto batch = make_shared<SphereBatch>();
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            spheres.copy_sphere(build.indices[i], *batch);
+        }
+        batches.add(batch);
+    }
+    return batches;
+}
+
+#endif
@@ -28,10 +28,10 @@ class CheckerTexture : public Texture {
 public:
     CheckerTexture() {}
 
-    CheckerTexture(shared_ptr<Texture> even, shared_ptr<Texture> odd) : even_(even), odd_(odd) {}
+    CheckerTexture(shared_ptr<Texture> even, shared_ptr<Texture> odd) : odd_(odd), even_(even) {}
 
     CheckerTexture(Color c1, Color c2)
-        : even_(make_shared<SolidColor>(c1)), odd_(make_shared<SolidColor>(c2)) {}
+        : odd_(make_shared<SolidColor>(c2)), even_(make_shared<SolidColor>(c1)) {}
 
     virtual Color value(const float u, const float v, const Point3 &p) const {
         const float sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
@@ -0,0 +1,246 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a block of pixels covering [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+    int index;
+};
+
+struct TileTiming {
+    Tile tile;
+    int thread;
+    bool stolen;
+    double seconds;
+};
+
+// Hands out small image tiles from per-thread deques. Every worker pops tiles from the front
+// of its own deque; once it runs dry it steals from the back of another worker's deque, so a
+// slow region of the image (glass, fog) no longer leaves the other cores idle at the end.
+class TileScheduler {
+public:
+    TileScheduler(int image_width, int image_height, int tile_size = 16, int num_threads = 0);
+
+    // Calls render_tile once for every tile, from num_threads() worker threads.
+    void run(const std::function<void(const Tile &)> &render_tile);
+
+    int num_threads() const { return num_threads_; }
+    int tile_count() const { return static_cast<int>(tiles_.size()); }
+    const std::vector<TileTiming> &timings() const { return timings_; }
+
+    // Whether run() prints the percentage of finished tiles to std::cerr as it goes, once per
+    // whole percent.
+    void set_progress(bool show) { show_progress_ = show; }
+
+    // Per-tile timing summary of the last run(): totals per thread and the slowest tiles.
+    void report(std::ostream &out, int slowest = 8) const;
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+    };
+
+    bool pop_local(int thread, Tile &tile);
+    bool steal(int thread, Tile &tile);
+
+private:
+    int tile_size_;
+    int num_threads_;
+    std::vector<Tile> tiles_;
+    std::vector<WorkQueue> queues_;
+    std::vector<TileTiming> timings_;
+    double wall_seconds_ = 0.0;
+    bool show_progress_ = true;
+};
+
+inline TileScheduler::TileScheduler(int image_width, int image_height, int tile_size,
+                                    int num_threads)
+    : tile_size_(std::max(1, tile_size)) {
+    num_threads_ = num_threads > 0 ? num_threads
+                                   : static_cast<int>(std::thread::hardware_concurrency());
+    num_threads_ = std::max(1, num_threads_);
+
+    // Top rows first, so the image fills in the same order it is written out.
+    for (int y1 = image_height; y1 > 0; y1 -= tile_size_) {
+        for (int x0 = 0; x0 < image_width; x0 += tile_size_) {
+            const int y0 = std::max(0, y1 - tile_size_);
+            const int x1 = std::min(image_width, x0 + tile_size_);
+            tiles_.push_back(Tile{x0, y0, x1, y1, static_cast<int>(tiles_.size())});
+        }
+    }
+
+    queues_ = std::vector<WorkQueue>(num_threads_);
+}
+
+inline bool TileScheduler::pop_local(int thread, Tile &tile) {
+    WorkQueue &queue = queues_[thread];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty())
+        return false;
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+inline bool TileScheduler::steal(int thread, Tile &tile) {
+    // Tiles are never added during a run, so one empty sweep over every victim means the
+    // whole frame has been handed out.
+    for (int i = 1; i < num_threads_; ++i) {
+        WorkQueue &victim = queues_[(thread + i) % num_threads_];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tiles.empty())
+            continue;
+        tile = victim.tiles.back();
+        victim.tiles.pop_back();
+        return true;
+    }
+    return false;
+}
+
+inline void TileScheduler::run(const std::function<void(const Tile &)> &render_tile) {
+    using clock = std::chrono::steady_clock;
+
+    // Give every thread a contiguous band of tiles up front; neighbouring tiles share
+    // texture and BVH data, and stealing from the far end keeps the bands mostly intact.
+    const int count = tile_count();
+    for (int i = 0; i < num_threads_; ++i) {
+        const int begin = i * count / num_threads_;
+        const int end = (i + 1) * count / num_threads_;
+        queues_[i].tiles.assign(tiles_.begin() + begin, tiles_.begin() + end);
+    }
+
+    std::vector<std::vector<TileTiming>> thread_timings(num_threads_);
+    std::atomic<int> finished(0);
+    std::atomic<int> shown_percent(-1);
+    std::mutex progress_mutex;
+
+    auto worker = [&](int thread) {
+        Tile tile;
+        while (true) {
+            bool stolen = false;
+            if (!pop_local(thread, tile)) {
+                if (!steal(thread, tile))
+                    break;
+                stolen = true;
+            }
+
+            const auto start = clock::now();
+            render_tile(tile);
+            const std::chrono::duration<double> elapsed = clock::now() - start;
+
+            thread_timings[thread].push_back(TileTiming{tile, thread, stolen, elapsed.count()});
+            const int done = ++finished;
+            if (!show_progress_)
+                continue;
+
+            // Only the thread that moves the counter to a new percent prints, so a frame
+            // writes at most about a hundred lines however small the tiles are.
+            const int percent = static_cast<int>(100LL * done / count);
+            int shown = shown_percent.load(std::memory_order_relaxed);
+            bool claimed = false;
+            while (percent > shown && !claimed) {
+                claimed = shown_percent.compare_exchange_weak(shown, percent,
+                                                              std::memory_order_relaxed);
+            }
+            if (!claimed)
+                continue;
+
+            // A later percent may have been claimed meanwhile; then that one is printed instead.
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            if (percent != shown_percent.load(std::memory_order_relaxed))
+                continue;
+
+            // Unformatted write: formatted << on a shared stream mutates its width state.
+            const std::string progress = "\rTiles done: " + std::to_string(percent) + "%   ";
+            std::cerr.write(progress.data(), progress.size()).flush();
+        }
+    };
+
+    const auto start = clock::now();
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads_);
+    for (int i = 0; i < num_threads_; ++i) {
+        threads.emplace_back(worker, i);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    const std::chrono::duration<double> elapsed = clock::now() - start;
+    wall_seconds_ = elapsed.count();
+
+    timings_.clear();
+    for (auto &timings : thread_timings) {
+        timings_.insert(timings_.end(), timings.begin(), timings.end());
+    }
+}
+
+inline void TileScheduler::report(std::ostream &out, int slowest) const {
+    if (timings_.empty())
+        return;
+
+    std::vector<double> busy(num_threads_, 0.0);
+    std::vector<int> rendered(num_threads_, 0);
+    std::vector<int> stolen(num_threads_, 0);
+    double total = 0.0;
+
+    for (const auto &timing : timings_) {
+        busy[timing.thread] += timing.seconds;
+        rendered[timing.thread] += 1;
+        stolen[timing.thread] += timing.stolen ? 1 : 0;
+        total += timing.seconds;
+    }
+
+    const auto fastest_slowest = std::minmax_element(
+        timings_.begin(), timings_.end(),
+        [](const TileTiming &a, const TileTiming &b) { return a.seconds < b.seconds; });
+
+    out << std::fixed << std::setprecision(3);
+    out << "\n" << timings_.size() << " tiles of " << tile_size_ << "x" << tile_size_ << " on "
+        << num_threads_ << " threads, wall " << wall_seconds_ << " s\n";
+    out << "tile time: mean " << 1000.0 * total / timings_.size() << " ms, min "
+        << 1000.0 * fastest_slowest.first->seconds << " ms, max "
+        << 1000.0 * fastest_slowest.second->seconds << " ms\n";
+
+    // Busy / wall close to 1 for every thread means the load was balanced.
+    for (int i = 0; i < num_threads_; ++i) {
+        out << "  thread " << std::setw(3) << i << ": " << std::setw(5) << rendered[i]
+            << " tiles (" << std::setw(4) << stolen[i] << " stolen), busy " << busy[i]
+            << " s, utilization "
+            << (wall_seconds_ > 0.0 ? 100.0 * busy[i] / wall_seconds_ : 0.0) << "%\n";
+    }
+
+    std::vector<TileTiming> sorted = timings_;
+    const int shown = std::min(slowest, static_cast<int>(sorted.size()));
+    std::partial_sort(
+        sorted.begin(), sorted.begin() + shown, sorted.end(),
+        [](const TileTiming &a, const TileTiming &b) { return a.seconds > b.seconds; });
+
+    out << "slowest tiles:\n";
+    for (int i = 0; i < shown; ++i) {
+        const Tile &tile = sorted[i].tile;
+        out << "  [" << tile.x0 << ", " << tile.x1 << ") x [" << tile.y0 << ", " << tile.y1
+            << "): " << 1000.0 * sorted[i].seconds << " ms\n";
+    }
+
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+#endif
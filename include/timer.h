@@ -0,0 +1,25 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+
+// Wall-clock stopwatch on std::chrono::steady_clock, started on construction.
+class Timer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    Timer() : start_(clock::now()) {}
+
+    void restart() { start_ = clock::now(); }
+
+    double seconds() const {
+        return std::chrono::duration<double>(clock::now() - start_).count();
+    }
+
+    double milliseconds() const { return seconds() * 1000.0; }
+
+private:
+    clock::time_point start_;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "rtweekend.h"
+
+#include "aabb.h"
+
+#include <algorithm>
+#include <cmath>
+
+// An affine transform p -> M p + t, stored as the three rows of the matrix [M | t]. Transforms
+// compose like matrices: (a * b) applies b first, then a.
+class Transform {
+public:
+    Transform() {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                m_[i][j] = i == j ? 1.0f : 0.0f;
+            }
+        }
+    }
+
+    static Transform translation(const Vec3 &offset);
+    static Transform scaling(const Vec3 &factors);
+    static Transform scaling(float factor) { return scaling(Vec3(factor, factor, factor)); }
+    // Counterclockwise by degrees around axis, looking down the axis towards the origin.
+    static Transform rotation(const Vec3 &axis, float degrees);
+    static Transform rotation_y(float degrees) { return rotation(Vec3(0, 1, 0), degrees); }
+
+    Transform operator*(const Transform &b) const;
+
+    // The inverse transform, computed in double; false if M is singular.
+    bool invert(Transform &inverse) const;
+
+    Point3 point(const Point3 &p) const {
+        return Point3(row(0, p) + m_[0][3], row(1, p) + m_[1][3], row(2, p) + m_[2][3]);
+    }
+    Vec3 vector(const Vec3 &v) const { return Vec3(row(0, v), row(1, v), row(2, v)); }
+    // Applies the transpose of M. With the inverse transform, this is how normals transform.
+    Vec3 transposed_vector(const Vec3 &v) const {
+        return Vec3(column(0, v), column(1, v), column(2, v));
+    }
+
+    // The smallest box around the transformed corners of box.
+    aabb box(const aabb &box) const;
+
+    float operator()(int i, int j) const { return m_[i][j]; }
+
+private:
+    float row(int i, const Vec3 &v) const {
+        return m_[i][0] * v[0] + m_[i][1] * v[1] + m_[i][2] * v[2];
+    }
+    float column(int j, const Vec3 &v) const {
+        return m_[0][j] * v[0] + m_[1][j] * v[1] + m_[2][j] * v[2];
+    }
+
+    float m_[3][4];
+};
+
+inline Transform Transform::translation(const Vec3 &offset) {
+    Transform result;
+    for (int i = 0; i < 3; ++i) {
+        result.m_[i][3] = offset[i];
+    }
+    return result;
+}
+
+inline Transform Transform::scaling(const Vec3 &factors) {
+    Transform result;
+    for (int i = 0; i < 3; ++i) {
+        result.m_[i][i] = factors[i];
+    }
+    return result;
+}
+
+inline Transform Transform::rotation(const Vec3 &axis, float degrees) {
+    // Rodrigues' formula: M = cos I + sin [a]x + (1 - cos) a a^T.
+    const Vec3 a = unit_vector(axis);
+    const double radians = degrees_to_radians(degrees);
+    const float c = static_cast<float>(std::cos(radians));
+    const float s = static_cast<float>(std::sin(radians));
+
+    Transform result;
+    result.m_[0][0] = c + (1 - c) * a.x() * a.x();
+    result.m_[0][1] = (1 - c) * a.x() * a.y() - s * a.z();
+    result.m_[0][2] = (1 - c) * a.x() * a.z() + s * a.y();
+    result.m_[1][0] = (1 - c) * a.y() * a.x() + s * a.z();
+    result.m_[1][1] = c + (1 - c) * a.y() * a.y();
+    result.m_[1][2] = (1 - c) * a.y() * a.z() - s * a.x();
+    result.m_[2][0] = (1 - c) * a.z() * a.x() - s * a.y();
+    result.m_[2][1] = (1 - c) * a.z() * a.y() + s * a.x();
+    result.m_[2][2] = c + (1 - c) * a.z() * a.z();
+    return result;
+}
+
+inline Transform Transform::operator*(const Transform &b) const {
+    Transform result;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            result.m_[i][j] = m_[i][0] * b.m_[0][j] + m_[i][1] * b.m_[1][j] + m_[i][2] * b.m_[2][j];
+        }
+        result.m_[i][3] += m_[i][3];
+    }
+    return result;
+}
+
+inline bool Transform::invert(Transform &inverse) const {
+    // The inverse of M from its cofactors; the translation becomes -M^-1 t.
+    double cofactor[3][3];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            const int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            const int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            cofactor[i][j] = static_cast<double>(m_[i1][j1]) * m_[i2][j2] -
+                             static_cast<double>(m_[i1][j2]) * m_[i2][j1];
+        }
+    }
+    const double determinant =
+        m_[0][0] * cofactor[0][0] + m_[0][1] * cofactor[0][1] + m_[0][2] * cofactor[0][2];
+    if (determinant == 0 || !std::isfinite(determinant))
+        return false;
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            inverse.m_[i][j] = static_cast<float>(cofactor[j][i] / determinant);
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        double t = 0;
+        for (int j = 0; j < 3; ++j) {
+            t -= cofactor[j][i] / determinant * m_[j][3];
+        }
+        inverse.m_[i][3] = static_cast<float>(t);
+    }
+    return true;
+}
+
+inline aabb Transform::box(const aabb &box) const {
+    // Per output axis, each input axis adds the smaller and the larger of its two products
+    // (Arvo), which gives the box of all eight transformed corners.
+    Point3 low, high;
+    for (int i = 0; i < 3; ++i) {
+        low[i] = high[i] = m_[i][3];
+        for (int j = 0; j < 3; ++j) {
+            const float a = m_[i][j] * box.aabb_min()[j];
+            const float b = m_[i][j] * box.aabb_max()[j];
+            low[i] += std::min(a, b);
+            high[i] += std::max(a, b);
+        }
+    }
+    return aabb(low, high);
+}
+
+#endif
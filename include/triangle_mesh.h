@@ -0,0 +1,422 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+
+#include "bvh_builder.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Vertex and index buffers of a triangle mesh. Normals and texture coordinates are optional;
+// when present there is one of each per position.
+struct MeshData {
+    std::vector<Point3> positions;
+    std::vector<Vec3> normals;
+    std::vector<float> uvs;         // u and v of each vertex
+    std::vector<uint32_t> indices;  // three vertex indices per triangle
+
+    size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// The same buffers, wherever they live: in a MeshData or in a mapped cache file.
+struct MeshView {
+    std::span<const Point3> positions;
+    std::span<const Vec3> normals;
+    std::span<const float> uvs;
+    std::span<const uint32_t> indices;
+
+    size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// Per-ray setup of the watertight ray/triangle test of Woop, Benthin and Wald: the ray is
+// made to run along +z by a permutation of the axes and a shear, so a triangle is tested by
+// the signs of three 2D edge functions. Two triangles that share an edge compute the edge
+// function of that edge identically, so no ray passes between them.
+struct WatertightRay {
+    explicit WatertightRay(const Ray &r);
+
+    Point3 origin;
+    int kx, ky, kz; // kz is the dominant axis of the direction
+    float sx, sy, sz;
+};
+
+// Many triangles sharing vertex buffers, with a BVH of their own. One object in a scene
+// however many triangles it has, so a mesh can be placed many times by Instance like any
+// other Hittable. All triangles share one material. A mesh read from a cache file
+// (see mesh_cache.h) uses the buffers and the BVH of the mapped file in place.
+class TriangleMesh : public Hittable {
+public:
+    TriangleMesh(MeshData mesh, shared_ptr<Material> material,
+                 const BvhBuildOptions &options = BvhBuildOptions());
+
+    // A mesh over buffers and a BVH that storage keeps alive, such as a mapped file. The
+    // indices must already be in the leaf order of nodes.
+    TriangleMesh(shared_ptr<const void> storage, const MeshView &view,
+                 std::span<const LinearBvhNode> nodes, const BvhStats &stats,
+                 shared_ptr<Material> material);
+
+    // The views point into the mesh itself.
+    TriangleMesh(const TriangleMesh &) = delete;
+    TriangleMesh &operator=(const TriangleMesh &) = delete;
+
+    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override;
+
+    // Fills in the shading normal, interpolated if the mesh has normals, and the texture
+    // coordinates, or the barycentric coordinates if it has none.
+    virtual void finalize_hit(const Ray &r, HitRecord &rec) const override;
+
+    size_t triangle_count() const { return view_.triangle_count(); }
+    const BvhStats &stats() const { return stats_; }
+    const MeshView &view() const { return view_; }
+    std::span<const LinearBvhNode> nodes() const { return nodes_; }
+
+private:
+    // Distance and barycentric coordinates of the second and third vertex, if the ray hits
+    // triangle within [t_min, t_max].
+    bool intersect(const WatertightRay &ray, uint32_t triangle, float t_min, float t_max,
+                   float &t, float &b1, float &b2) const;
+
+    // Calls visit(first, count) for the triangle range of every leaf whose box the ray enters
+    // within [t_min, t_max], nearer child first, until visit returns true. visit may lower
+    // t_max, which the following box tests then use.
+    template <typename Visit>
+    bool traverse(const Ray &r, float t_min, const float &t_max, Visit &&visit) const;
+
+    // Every tree comes from build_sah_bvh, directly or through a cache file, so no path in it
+    // is longer than bvh_max_depth nodes.
+    static constexpr int stack_size = bvh_max_depth;
+
+private:
+    // Indices are in leaf order, so every BVH leaf covers a contiguous range of triangles.
+    MeshView view_;
+    std::span<const LinearBvhNode> nodes_;
+    // What the views point into: the mesh's own buffers, or storage_.
+    MeshData mesh_;
+    std::vector<LinearBvhNode> node_storage_;
+    shared_ptr<const void> storage_;
+    shared_ptr<Material> material_;
+    BvhStats stats_;
+};
+
+inline WatertightRay::WatertightRay(const Ray &r) : origin(r.origin()) {
+    const Vec3 &d = r.direction();
+    const float ax = std::fabs(d.x()), ay = std::fabs(d.y()), az = std::fabs(d.z());
+    kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    kx = kz == 2 ? 0 : kz + 1;
+    ky = kx == 2 ? 0 : kx + 1;
+    // Keep the winding, so the sign of the determinant keeps its meaning.
+    if (d[kz] < 0)
+        std::swap(kx, ky);
+
+    sx = -d[kx] / d[kz];
+    sy = -d[ky] / d[kz];
+    sz = 1 / d[kz];
+}
+
+inline TriangleMesh::TriangleMesh(MeshData mesh, shared_ptr<Material> material,
+                                  const BvhBuildOptions &options)
+    : mesh_(std::move(mesh)), material_(material) {
+    const size_t count = mesh_.triangle_count();
+    mesh_.indices.resize(count * 3);
+    for (const uint32_t index : mesh_.indices) {
+        if (index >= mesh_.positions.size()) {
+            std::cerr << "TriangleMesh: vertex index " << index << " out of range; the mesh "
+                      << "is left empty.\n";
+            mesh_ = MeshData();
+            return;
+        }
+    }
+    if (!mesh_.normals.empty() && mesh_.normals.size() != mesh_.positions.size()) {
+        std::cerr << "TriangleMesh: normal count does not match the vertex count; ignoring "
+                  << "the normals.\n";
+        mesh_.normals.clear();
+    }
+    if (!mesh_.uvs.empty() && mesh_.uvs.size() != 2 * mesh_.positions.size()) {
+        std::cerr << "TriangleMesh: texture coordinate count does not match the vertex count; "
+                  << "ignoring them.\n";
+        mesh_.uvs.clear();
+    }
+
+    std::vector<aabb> boxes(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Point3 &p0 = mesh_.positions[mesh_.indices[3 * i + 0]];
+        const Point3 &p1 = mesh_.positions[mesh_.indices[3 * i + 1]];
+        const Point3 &p2 = mesh_.positions[mesh_.indices[3 * i + 2]];
+        boxes[i] = aabb(Point3(std::min({p0.x(), p1.x(), p2.x()}),
+                               std::min({p0.y(), p1.y(), p2.y()}),
+                               std::min({p0.z(), p1.z(), p2.z()})),
+                        Point3(std::max({p0.x(), p1.x(), p2.x()}),
+                               std::max({p0.y(), p1.y(), p2.y()}),
+                               std::max({p0.z(), p1.z(), p2.z()})));
+    }
+
+    const BvhBuild build = build_sah_bvh(boxes, options);
+    stats_ = build.stats;
+    boxes.clear();
+    boxes.shrink_to_fit();
+
+    // Put the triangles in leaf order, so a leaf is a range of the index buffer.
+    std::vector<uint32_t> indices(count * 3);
+    for (size_t slot = 0; slot < build.indices.size(); ++slot) {
+        const uint32_t triangle = build.indices[slot];
+        for (int k = 0; k < 3; ++k) {
+            indices[3 * slot + k] = mesh_.indices[3 * triangle + k];
+        }
+    }
+    mesh_.indices = std::move(indices);
+
+    node_storage_.resize(build.nodes.size());
+    for (size_t i = 0; i < build.nodes.size(); ++i) {
+        const BvhBuildNode &src = build.nodes[i];
+        LinearBvhNode &dst = node_storage_[i];
+        for (int a = 0; a < 3; ++a) {
+            dst.bounds_min[a] = src.box.aabb_min()[a];
+            dst.bounds_max[a] = src.box.aabb_max()[a];
+        }
+        dst.offset = src.offset;
+        dst.count = src.count;
+        dst.axis = src.axis;
+        dst.pad = 0;
+    }
+
+    view_ = MeshView{mesh_.positions, mesh_.normals, mesh_.uvs, mesh_.indices};
+    nodes_ = node_storage_;
+}
+
+inline TriangleMesh::TriangleMesh(shared_ptr<const void> storage, const MeshView &view,
+                                  std::span<const LinearBvhNode> nodes, const BvhStats &stats,
+                                  shared_ptr<Material> material)
+    : view_(view), nodes_(nodes), storage_(std::move(storage)), material_(material),
+      stats_(stats) {
+}
+
+inline bool TriangleMesh::intersect(const WatertightRay &ray, uint32_t triangle, float t_min,
+                                    float t_max, float &t, float &b1, float &b2) const {
+    const uint32_t *v = &view_.indices[3 * static_cast<size_t>(triangle)];
+    const Vec3 a = view_.positions[v[0]] - ray.origin;
+    const Vec3 b = view_.positions[v[1]] - ray.origin;
+    const Vec3 c = view_.positions[v[2]] - ray.origin;
+
+    const float ax = a[ray.kx] + ray.sx * a[ray.kz];
+    const float ay = a[ray.ky] + ray.sy * a[ray.kz];
+    const float bx = b[ray.kx] + ray.sx * b[ray.kz];
+    const float by = b[ray.ky] + ray.sy * b[ray.kz];
+    const float cx = c[ray.kx] + ray.sx * c[ray.kz];
+    const float cy = c[ray.ky] + ray.sy * c[ray.kz];
+
+    // Scaled barycentric coordinates of the first, second and third vertex. The products of
+    // two floats are exact in double, so each edge function is rounded once, whether or not
+    // the compiler fuses the multiply and subtract, and two triangles sharing an edge get
+    // exactly opposite values for it.
+    const auto edge = [](float px, float py, float qx, float qy) {
+        return static_cast<float>(static_cast<double>(px) * qy - static_cast<double>(py) * qx);
+    };
+    const float e0 = edge(cx, cy, bx, by);
+    const float e1 = edge(ax, ay, cx, cy);
+    const float e2 = edge(bx, by, ax, ay);
+
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
+        return false;
+    const float det = e0 + e1 + e2;
+    if (det == 0)
+        return false;
+
+    const float az = ray.sz * a[ray.kz];
+    const float bz = ray.sz * b[ray.kz];
+    const float cz = ray.sz * c[ray.kz];
+    const float inv_det = 1 / det;
+    t = (e0 * az + e1 * bz + e2 * cz) * inv_det;
+    // Also rejects a NaN distance.
+    if (!(t >= t_min && t <= t_max))
+        return false;
+
+    b1 = e1 * inv_det;
+    b2 = e2 * inv_det;
+    return true;
+}
+
+template <typename Visit>
+inline bool TriangleMesh::traverse(const Ray &r, float t_min, const float &t_max,
+                                   Visit &&visit) const {
+    if (nodes_.empty())
+        return false;
+
+    uint32_t stack[stack_size];
+    int stack_top = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const LinearBvhNode &node = nodes_[current];
+        RT_STAT(bvh_nodes);
+        RT_STAT(box_tests);
+
+        float t_near;
+        if (slab_test(node.bounds_min, node.bounds_max, r, t_min, t_max, t_near)) {
+            if (node.count > 0) {
+                if (visit(node.offset, node.count))
+                    return true;
+            } else if (r.sign(node.axis)) {
+                // Visit the child on the near side of the split first.
+                stack[stack_top++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stack_top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+        if (stack_top == 0)
+            break;
+        current = stack[--stack_top];
+    }
+    return false;
+}
+
+inline bool TriangleMesh::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    const WatertightRay ray(r);
+    uint32_t closest = 0;
+    bool hit_anything = false;
+
+    traverse(r, t_min, t_max, [&](uint32_t first, uint32_t count) {
+        RT_STAT_ADD(triangle_tests, count);
+        for (uint32_t i = first; i < first + count; ++i) {
+            float t, b1, b2;
+            if (intersect(ray, i, t_min, t_max, t, b1, b2)) {
+                hit_anything = true;
+                t_max = t;
+                closest = i;
+            }
+        }
+        return false;
+    });
+
+    if (!hit_anything)
+        return false;
+
+    rec.t = t_max;
+    rec.material_pointer = material_.get();
+    rec.object = this;
+    rec.primitive = closest;
+    return true;
+}
+
+inline bool TriangleMesh::occluded(const Ray &r, float t_min, float t_max) const {
+    const WatertightRay ray(r);
+    return traverse(r, t_min, t_max, [&](uint32_t first, uint32_t count) {
+        RT_STAT_ADD(triangle_tests, count);
+        for (uint32_t i = first; i < first + count; ++i) {
+            float t, b1, b2;
+            if (intersect(ray, i, t_min, t_max, t, b1, b2))
+                return true;
+        }
+        return false;
+    });
+}
+
+inline bool TriangleMesh::bounding_box(float time0, float time1, aabb &output_box) const {
+    if (nodes_.empty())
+        return false;
+
+    const LinearBvhNode &root = nodes_[0];
+    output_box = aabb(Point3(root.bounds_min[0], root.bounds_min[1], root.bounds_min[2]),
+                      Point3(root.bounds_max[0], root.bounds_max[1], root.bounds_max[2]));
+    return true;
+}
+
+inline void TriangleMesh::finalize_hit(const Ray &r, HitRecord &rec) const {
+    // The barycentric coordinates are cheaper to compute again than to carry in every record.
+    float t, b1, b2;
+    if (!intersect(WatertightRay(r), rec.primitive, -infinity, infinity, t, b1, b2)) {
+        b1 = 1.0f / 3;
+        b2 = 1.0f / 3;
+    }
+    const float b0 = 1 - b1 - b2;
+
+    const uint32_t *v = &view_.indices[3 * static_cast<size_t>(rec.primitive)];
+    const Point3 &p0 = view_.positions[v[0]];
+    const Point3 &p1 = view_.positions[v[1]];
+    const Point3 &p2 = view_.positions[v[2]];
+
+    rec.p = r.at(rec.t);
+    rec.set_face_normal(r, unit_vector(cross(p1 - p0, p2 - p0)));
+
+    if (!view_.normals.empty()) {
+        // The shading normal stays on the side of the surface the ray came from.
+        Vec3 shading_normal = unit_vector(b0 * view_.normals[v[0]] + b1 * view_.normals[v[1]] +
+                                          b2 * view_.normals[v[2]]);
+        if (dot(shading_normal, rec.normal) < 0)
+            shading_normal = -shading_normal;
+        rec.normal = shading_normal;
+    }
+
+    if (!view_.uvs.empty()) {
+        rec.u = b0 * view_.uvs[2 * v[0]] + b1 * view_.uvs[2 * v[1]] + b2 * view_.uvs[2 * v[2]];
+        rec.v = b0 * view_.uvs[2 * v[0] + 1] + b1 * view_.uvs[2 * v[1] + 1] +
+                b2 * view_.uvs[2 * v[2] + 1];
+    } else {
+        rec.u = b1;
+        rec.v = b2;
+    }
+}
+
+// A sphere of triangles made by subdividing an icosahedron, with normals pointing away from
+// center. Each subdivision makes four triangles of one: 20 * 4^subdivisions in all.
+inline MeshData make_icosphere(const Point3 &center, float radius, int subdivisions) {
+    const float g = (1 + std::sqrt(5.0f)) / 2;
+    std::vector<Vec3> directions = {
+        Vec3(-1, g, 0), Vec3(1, g, 0),  Vec3(-1, -g, 0), Vec3(1, -g, 0),
+        Vec3(0, -1, g), Vec3(0, 1, g),  Vec3(0, -1, -g), Vec3(0, 1, -g),
+        Vec3(g, 0, -1), Vec3(g, 0, 1),  Vec3(-g, 0, -1), Vec3(-g, 0, 1)};
+    std::vector<uint32_t> indices = {0, 11, 5,  0, 5,  1, 0, 1, 7, 0, 7,  10, 0, 10, 11,
+                                     1, 5,  9,  5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1,  8,
+                                     3, 9,  4,  3, 4,  2, 3, 2,  6, 3, 6,  8, 3, 8,  9,
+                                     4, 9,  5,  2, 4, 11, 6, 2,  10, 8, 6, 7, 9, 8,  1};
+    for (Vec3 &d : directions) {
+        d = unit_vector(d);
+    }
+
+    for (int level = 0; level < subdivisions; ++level) {
+        // Each edge is split once, at the vertex shared by the two triangles beside it.
+        std::unordered_map<uint64_t, uint32_t> midpoints;
+        const auto midpoint = [&](uint32_t a, uint32_t b) {
+            const uint64_t key = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+            const auto found = midpoints.try_emplace(key, static_cast<uint32_t>(directions.size()));
+            if (found.second)
+                directions.push_back(unit_vector(directions[a] + directions[b]));
+            return found.first->second;
+        };
+
+        std::vector<uint32_t> finer;
+        finer.reserve(4 * indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            const uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            finer.insert(finer.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        indices = std::move(finer);
+    }
+
+    MeshData mesh;
+    mesh.positions.reserve(directions.size());
+    for (const Vec3 &d : directions) {
+        mesh.positions.push_back(center + radius * d);
+    }
+    mesh.normals = std::move(directions);
+    mesh.indices = std::move(indices);
+    return mesh;
+}
+
+#endif
@@ -1,17 +1,15 @@
 #ifndef VEC3_H
 #define VEC3_H
 
+#include "rng.h"
 #include <cmath>
 #include <iostream>
-#include <random>
 
 using std::sqrt;
 
 inline float random_float() {
-    // Returns a random real in [0,1)
-    static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-    static std::mt19937 generator(std::random_device{}());
-    return distribution(generator);
+    // Returns a random real in [0,1) from the calling thread's generator
+    return thread_rng().next_float();
 }
 
 inline float random_float(float min, float max) {
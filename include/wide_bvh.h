@@ -0,0 +1,522 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "rtweekend.h"
+
+#include "bvh_builder.h"
+#include "hittable.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#define RT_WIDE_BVH_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_WIDE_BVH_SSE 1
+#endif
+
+#if defined(RT_WIDE_BVH_AVX) || defined(RT_WIDE_BVH_SSE)
+#include <immintrin.h>
+#endif
+
+// Widest node the target supports: 8 children with AVX, 4 with SSE. Other widths fall back to
+// a scalar loop that the compiler is free to auto-vectorize.
+#if defined(RT_WIDE_BVH_AVX)
+constexpr int default_bvh_width = 8;
+#else
+constexpr int default_bvh_width = 4;
+#endif
+
+// Bounds of Width children laid out so one slab test covers all of them:
+// bounds[0] holds the minimum corners, bounds[1] the maximum corners, one lane per child.
+template <int Width>
+struct alignas(64) WideBvhNode {
+    float bounds[2][3][Width];
+    int32_t child[Width];   // inner child: node index; leaf: first primitive; empty slot: -1
+    uint16_t count[Width];  // primitives in a leaf child, 0 for inner children and empty slots
+};
+
+// Tests the ray against every child of node at once, with the arithmetic of slab_test().
+// Returns a bit mask of the children whose box overlaps [t_min, t_max] and stores their entry
+// distances in t_near.
+template <int Width>
+inline int wide_slab_test(const WideBvhNode<Width> &node, const Ray &ray, float t_min,
+                          float t_max, float *t_near) {
+    int mask = 0;
+    for (int i = 0; i < Width; ++i) {
+        float lo = t_min;
+        float hi = t_max;
+        for (int a = 0; a < 3; ++a) {
+            const int sign = ray.sign(a);
+            const float t0 =
+                (node.bounds[sign][a][i] - ray.origin()[a]) * ray.inv_direction()[a];
+            const float t1 = (node.bounds[1 - sign][a][i] - ray.origin()[a]) *
+                             ray.inv_direction()[a] * slab_far_scale;
+            // Written so that a NaN slab distance leaves the interval unchanged.
+            lo = t0 > lo ? t0 : lo;
+            hi = t1 < hi ? t1 : hi;
+        }
+        t_near[i] = lo;
+        mask |= (lo <= hi) << i;
+    }
+    return mask;
+}
+
+#if defined(RT_WIDE_BVH_SSE)
+template <>
+inline int wide_slab_test<4>(const WideBvhNode<4> &node, const Ray &ray, float t_min,
+                             float t_max, float *t_near) {
+    __m128 lo = _mm_set1_ps(t_min);
+    __m128 hi = _mm_set1_ps(t_max);
+    for (int a = 0; a < 3; ++a) {
+        const __m128 origin = _mm_set1_ps(ray.origin()[a]);
+        const __m128 inv_dir = _mm_set1_ps(ray.inv_direction()[a]);
+        const __m128 near_plane = _mm_load_ps(node.bounds[ray.sign(a)][a]);
+        const __m128 far_plane = _mm_load_ps(node.bounds[1 - ray.sign(a)][a]);
+        const __m128 t0 = _mm_mul_ps(_mm_sub_ps(near_plane, origin), inv_dir);
+        const __m128 t1 = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(far_plane, origin), inv_dir),
+                                      _mm_set1_ps(slab_far_scale));
+        // maxps/minps return the second operand when either is NaN.
+        lo = _mm_max_ps(t0, lo);
+        hi = _mm_min_ps(t1, hi);
+    }
+    _mm_storeu_ps(t_near, lo);
+    return _mm_movemask_ps(_mm_cmple_ps(lo, hi));
+}
+#endif
+
+#if defined(RT_WIDE_BVH_AVX)
+template <>
+inline int wide_slab_test<8>(const WideBvhNode<8> &node, const Ray &ray, float t_min,
+                             float t_max, float *t_near) {
+    __m256 lo = _mm256_set1_ps(t_min);
+    __m256 hi = _mm256_set1_ps(t_max);
+    for (int a = 0; a < 3; ++a) {
+        const __m256 origin = _mm256_set1_ps(ray.origin()[a]);
+        const __m256 inv_dir = _mm256_set1_ps(ray.inv_direction()[a]);
+        const __m256 near_plane = _mm256_load_ps(node.bounds[ray.sign(a)][a]);
+        const __m256 far_plane = _mm256_load_ps(node.bounds[1 - ray.sign(a)][a]);
+        const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(near_plane, origin), inv_dir);
+        const __m256 t1 = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(far_plane, origin), inv_dir),
+                                      _mm256_set1_ps(slab_far_scale));
+        lo = _mm256_max_ps(t0, lo);
+        hi = _mm256_min_ps(t1, hi);
+    }
+    _mm256_storeu_ps(t_near, lo);
+    return _mm256_movemask_ps(_mm256_cmp_ps(lo, hi, _CMP_LE_OQ));
+}
+#endif
+
+// Tests every lane of packet in active against one box. Returns the lanes whose ray overlaps
+// the box within [t_min, t_max[lane]] and stores the smallest entry distance among them in
+// t_near.
+inline PacketMask packet_slab_test(const RayPacket &packet, const float box_min[3],
+                                   const float box_max[3], float t_min, PacketMask active,
+                                   float &t_near) {
+#if defined(RT_WIDE_BVH_SSE)
+    // Four lanes at a time; every supported packet width is a multiple of four.
+    const __m128 lane_bits = _mm_castsi128_ps(_mm_setr_epi32(1, 2, 4, 8));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 far_scale = _mm_set1_ps(slab_far_scale);
+    __m128 nearest = _mm_set1_ps(infinity);
+    PacketMask lanes = 0;
+    for (int c = 0; c < packet_width; c += 4) {
+        __m128 lo = _mm_set1_ps(t_min);
+        __m128 hi = _mm_load_ps(packet.t_max + c);
+        for (int a = 0; a < 3; ++a) {
+            const __m128 origin = _mm_load_ps(packet.origin[a] + c);
+            const __m128 inv_dir = _mm_load_ps(packet.inv_dir[a] + c);
+            const __m128 t_lo = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box_min[a]), origin), inv_dir);
+            const __m128 t_hi = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box_max[a]), origin), inv_dir);
+            // Lanes travelling towards -a enter through the maximum plane.
+            const __m128 negative = _mm_cmplt_ps(inv_dir, zero);
+            const __m128 t0 = _mm_or_ps(_mm_and_ps(negative, t_hi), _mm_andnot_ps(negative, t_lo));
+            const __m128 t1 =
+                _mm_mul_ps(_mm_or_ps(_mm_and_ps(negative, t_lo), _mm_andnot_ps(negative, t_hi)),
+                           far_scale);
+            lo = _mm_max_ps(t0, lo);
+            hi = _mm_min_ps(t1, hi);
+        }
+        const __m128i chunk_bits = _mm_set1_epi32(static_cast<int>((active >> c) & 0xfu));
+        const __m128 chunk_active = _mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_and_si128(chunk_bits, _mm_castps_si128(lane_bits)),
+                            _mm_castps_si128(lane_bits)));
+        const __m128 entered = _mm_and_ps(_mm_cmple_ps(lo, hi), chunk_active);
+        lanes |= static_cast<PacketMask>(_mm_movemask_ps(entered)) << c;
+        nearest = _mm_min_ps(nearest, _mm_or_ps(_mm_and_ps(entered, lo),
+                                                _mm_andnot_ps(entered, _mm_set1_ps(infinity))));
+    }
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+    t_near = _mm_cvtss_f32(nearest);
+    return lanes;
+#else
+    PacketMask lanes = 0;
+    t_near = infinity;
+    for_each_lane(active, [&](int l) {
+        float lo = t_min;
+        float hi = packet.t_max[l];
+        for (int a = 0; a < 3; ++a) {
+            const float inv_dir = packet.inv_dir[a][l];
+            const float t_lo = (box_min[a] - packet.origin[a][l]) * inv_dir;
+            const float t_hi = (box_max[a] - packet.origin[a][l]) * inv_dir;
+            const float t0 = inv_dir < 0 ? t_hi : t_lo;
+            const float t1 = (inv_dir < 0 ? t_lo : t_hi) * slab_far_scale;
+            lo = t0 > lo ? t0 : lo;
+            hi = t1 < hi ? t1 : hi;
+        }
+        if (lo <= hi) {
+            lanes |= 1u << l;
+            t_near = lo < t_near ? lo : t_near;
+        }
+    });
+    return lanes;
+#endif
+}
+
+// A BVH with Width children per node (QBVH for 4, OBVH for 8), made by collapsing the binary
+// SAH tree. One traversal step tests the ray against all children of a node with a single
+// vectorized slab test instead of one aabb::hit per child.
+template <int Width = default_bvh_width>
+class WideBvh : public Hittable {
+public:
+    static_assert(Width >= 2 && Width <= 16, "WideBvh supports 2 to 16 children per node");
+
+    WideBvh() {}
+
+    WideBvh(const HittableList &list, float time0, float time1,
+            const BvhBuildOptions &options = BvhBuildOptions());
+
+    virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+
+    virtual PacketMask hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                  HitRecord *recs) const override;
+
+    virtual bool bounding_box(float time0, float time1, aabb &output_box) const override {
+        output_box = box_;
+        return !nodes_.empty() || !primitives_.empty();
+    }
+
+    const BvhStats &stats() const { return stats_; }
+    size_t node_count() const { return nodes_.size(); }
+
+private:
+    struct StackEntry {
+        uint32_t child; // node index, or first primitive of a leaf
+        uint32_t count; // primitives in a leaf, 0 for inner nodes
+        float t_near;
+    };
+
+    struct PacketStackEntry {
+        uint32_t child;
+        uint32_t count;
+        PacketMask lanes; // lanes whose ray entered this child's box
+        float t_near;     // nearest entry distance over those lanes
+    };
+
+    uint32_t collapse(const BvhBuild &build, uint32_t binary_node);
+
+    // Collapsing never deepens the binary tree, which stays within bvh_max_depth, and every
+    // node on the current path leaves at most Width - 1 of its children on the stack.
+    static constexpr int stack_size = bvh_max_depth * (Width - 1);
+
+private:
+    std::vector<WideBvhNode<Width>> nodes_;
+    std::vector<shared_ptr<Hittable>> primitives_;
+    aabb box_;
+    BvhStats stats_;
+};
+
+template <int Width>
+inline WideBvh<Width>::WideBvh(const HittableList &list, float time0, float time1,
+                               const BvhBuildOptions &options) {
+    const auto &objects = list.objects;
+
+    std::vector<aabb> boxes(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        if (!objects[i]->bounding_box(time0, time1, boxes[i]))
+            std::cerr << "No bounding box in WideBvh constructor.\n";
+    }
+
+    const BvhBuild build = build_sah_bvh(boxes, options);
+    stats_ = build.stats;
+
+    primitives_.reserve(build.indices.size());
+    for (uint32_t index : build.indices) {
+        primitives_.push_back(objects[index]);
+    }
+
+    if (build.nodes.empty())
+        return;
+
+    box_ = build.nodes[0].box;
+    collapse(build, 0);
+}
+
+template <int Width>
+inline uint32_t WideBvh<Width>::collapse(const BvhBuild &build, uint32_t binary_node) {
+    // Pull up grandchildren until the node is full: always open the inner child with the
+    // largest surface area, since it is the one most likely to be visited.
+    uint32_t children[Width];
+    int child_count = 0;
+
+    const BvhBuildNode &root = build.nodes[binary_node];
+    if (root.count > 0) {
+        children[child_count++] = binary_node; // the whole tree is a single leaf
+    } else {
+        children[child_count++] = binary_node + 1;
+        children[child_count++] = root.offset;
+    }
+
+    while (child_count < Width) {
+        int best = -1;
+        float best_area = -1;
+        for (int i = 0; i < child_count; ++i) {
+            const BvhBuildNode &candidate = build.nodes[children[i]];
+            if (candidate.count == 0 && candidate.box.surface_area() > best_area) {
+                best = i;
+                best_area = candidate.box.surface_area();
+            }
+        }
+        if (best < 0)
+            break;
+
+        const uint32_t opened = children[best];
+        children[best] = opened + 1;
+        children[child_count++] = build.nodes[opened].offset;
+    }
+
+    const auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    for (int i = 0; i < Width; ++i) {
+        // Fill empty slots with an inverted box that no ray can enter.
+        float lo[3] = {infinity, infinity, infinity};
+        float hi[3] = {-infinity, -infinity, -infinity};
+        int32_t child = -1;
+        uint16_t count = 0;
+
+        if (i < child_count) {
+            const BvhBuildNode &src = build.nodes[children[i]];
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = src.box.aabb_min()[a];
+                hi[a] = src.box.aabb_max()[a];
+            }
+            if (src.count > 0) {
+                child = static_cast<int32_t>(src.offset);
+                count = src.count;
+            } else {
+                child = static_cast<int32_t>(collapse(build, children[i]));
+            }
+        }
+
+        // nodes_ may have grown in the recursive call, so index it afresh.
+        WideBvhNode<Width> &node = nodes_[index];
+        for (int a = 0; a < 3; ++a) {
+            node.bounds[0][a][i] = lo[a];
+            node.bounds[1][a][i] = hi[a];
+        }
+        node.child[i] = child;
+        node.count[i] = count;
+    }
+
+    return index;
+}
+
+template <int Width>
+inline bool WideBvh<Width>::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (nodes_.empty())
+        return false;
+
+    // Leaves and inner nodes share the stack, so everything is visited strictly front to
+    // back. Every visited node pushes at most Width - 1 entries more than it pops.
+    StackEntry stack[stack_size];
+    int stack_top = 0;
+    StackEntry current{0, 0, t_min};
+    bool hit_anything = false;
+
+    while (true) {
+        if (current.count > 0) {
+            for (uint32_t p = current.child; p < current.child + current.count; ++p) {
+                if (primitives_[p]->hit(r, t_min, t_max, rec)) {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            }
+        } else {
+            const WideBvhNode<Width> &node = nodes_[current.child];
+            RT_STAT(bvh_nodes);
+            RT_STAT_ADD(box_tests, Width);
+            float t_near[Width];
+            int mask = wide_slab_test(node, r, t_min, t_max, t_near);
+
+            if (mask != 0) {
+                // Order the hit children front to back.
+                int order[Width];
+                int hits = 0;
+                while (mask) {
+                    const int i = std::countr_zero(static_cast<unsigned>(mask));
+                    mask &= mask - 1;
+                    int j = hits++;
+                    for (; j > 0 && t_near[order[j - 1]] > t_near[i]; --j) {
+                        order[j] = order[j - 1];
+                    }
+                    order[j] = i;
+                }
+
+                // Continue with the nearest child; push the rest far to near.
+                for (int k = hits - 1; k > 0; --k) {
+                    const int i = order[k];
+                    stack[stack_top++] = StackEntry{static_cast<uint32_t>(node.child[i]),
+                                                    node.count[i], t_near[i]};
+                }
+                const int nearest = order[0];
+                current = StackEntry{static_cast<uint32_t>(node.child[nearest]),
+                                     node.count[nearest], t_near[nearest]};
+                continue;
+            }
+        }
+
+        // Pop the next entry that is not already behind the closest hit.
+        while (stack_top > 0 && stack[stack_top - 1].t_near > t_max) {
+            --stack_top;
+        }
+        if (stack_top == 0)
+            break;
+        current = stack[--stack_top];
+    }
+
+    return hit_anything;
+}
+
+template <int Width>
+inline bool WideBvh<Width>::occluded(const Ray &r, float t_min, float t_max) const {
+    if (nodes_.empty())
+        return false;
+
+    // Any hit will do, so the children of a node are visited in whatever order the mask gives
+    // them and the first primitive in the way ends the search.
+    StackEntry stack[stack_size];
+    int stack_top = 0;
+    StackEntry current{0, 0, t_min};
+
+    while (true) {
+        if (current.count > 0) {
+            for (uint32_t p = current.child; p < current.child + current.count; ++p) {
+                if (primitives_[p]->occluded(r, t_min, t_max))
+                    return true;
+            }
+        } else {
+            const WideBvhNode<Width> &node = nodes_[current.child];
+            RT_STAT(bvh_nodes);
+            RT_STAT_ADD(box_tests, Width);
+            float t_near[Width];
+            int mask = wide_slab_test(node, r, t_min, t_max, t_near);
+
+            if (mask != 0) {
+                const int first = std::countr_zero(static_cast<unsigned>(mask));
+                mask &= mask - 1;
+                while (mask) {
+                    const int i = std::countr_zero(static_cast<unsigned>(mask));
+                    mask &= mask - 1;
+                    stack[stack_top++] = StackEntry{static_cast<uint32_t>(node.child[i]),
+                                                    node.count[i], t_near[i]};
+                }
+                current = StackEntry{static_cast<uint32_t>(node.child[first]), node.count[first],
+                                     t_near[first]};
+                continue;
+            }
+        }
+
+        if (stack_top == 0)
+            break;
+        current = stack[--stack_top];
+    }
+
+    return false;
+}
+
+template <int Width>
+inline PacketMask WideBvh<Width>::hit_packet(RayPacket &packet, PacketMask mask, float t_min,
+                                             HitRecord *recs) const {
+    if (nodes_.empty() || mask == 0)
+        return 0;
+
+    // Every child of a node is tested against all lanes; a child is visited with the lanes
+    // that entered its box, and lanes that already hit something closer drop out.
+    PacketStackEntry stack[stack_size];
+    int stack_top = 0;
+    PacketStackEntry current{0, 0, mask, t_min};
+    PacketMask hits = 0;
+
+    while (true) {
+        if (current.count > 0) {
+            for (uint32_t p = current.child; p < current.child + current.count; ++p) {
+                hits |= primitives_[p]->hit_packet(packet, current.lanes, t_min, recs);
+            }
+        } else {
+            const WideBvhNode<Width> &node = nodes_[current.child];
+            RT_STAT(bvh_nodes);
+
+            PacketStackEntry children[Width];
+            int child_count = 0;
+
+            for (int i = 0; i < Width; ++i) {
+                if (node.child[i] < 0)
+                    continue;
+
+                const float box_min[3] = {node.bounds[0][0][i], node.bounds[0][1][i],
+                                          node.bounds[0][2][i]};
+                const float box_max[3] = {node.bounds[1][0][i], node.bounds[1][1][i],
+                                          node.bounds[1][2][i]};
+                RT_STAT_ADD(box_tests, std::popcount(current.lanes));
+                float nearest;
+                const PacketMask lanes =
+                    packet_slab_test(packet, box_min, box_max, t_min, current.lanes, nearest);
+
+                if (lanes == 0)
+                    continue;
+
+                // Insert in front-to-back order of the nearest entry over all lanes.
+                const PacketStackEntry entry{static_cast<uint32_t>(node.child[i]), node.count[i],
+                                             lanes, nearest};
+                int j = child_count++;
+                for (; j > 0 && children[j - 1].t_near > nearest; --j) {
+                    children[j] = children[j - 1];
+                }
+                children[j] = entry;
+            }
+
+            if (child_count > 0) {
+                for (int k = child_count - 1; k > 0; --k) {
+                    stack[stack_top++] = children[k];
+                }
+                current = children[0];
+                continue;
+            }
+        }
+
+        // Pop the next entry that some lane can still reach: t_near is the nearest entry over
+        // its lanes, so a lane whose closest hit is in front of it has nothing to find there.
+        current.lanes = 0;
+        while (current.lanes == 0 && stack_top > 0) {
+            current = stack[--stack_top];
+            for_each_lane(current.lanes, [&](int lane) {
+                if (current.t_near > packet.t_max[lane])
+                    current.lanes &= ~(1u << lane);
+            });
+        }
+        if (current.lanes == 0)
+            break;
+    }
+
+    return hits;
+}
+
+#endif
@@ -7,14 +7,20 @@
 #include "color.h"
 #include "constant_medium.h"
 #include "hittable_list.h"
+#include "instance.h"
+#include "wide_bvh.h"
 #include "material.h"
+#include "mesh_cache.h"
 #include "moving_sphere.h"
 #include "rtweekend.h"
+#include "scene_arena.h"
 #include "sphere.h"
+#include "sphere_batch.h"
+#include "triangle_mesh.h"
 
-inline HittableList final_scene() {
+inline HittableList final_scene(SceneArena &arena) {
     HittableList boxes1;
-    auto ground = make_shared<Lambertian>(Color(0.48, 0.83, 0.53));
+    auto ground = arena.make<Lambertian>(Color(0.48, 0.83, 0.53));
 
     const int boxes_per_side = 20;
     for (int i = 0; i < boxes_per_side; i++) {
@@ -27,151 +33,232 @@ inline HittableList final_scene() {
             auto y1 = random_float(1, 101);
             auto z1 = z0 + w;
 
-            boxes1.add(make_shared<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
+            boxes1.add(arena.make<Box>(Point3(x0, y0, z0), Point3(x1, y1, z1), ground));
         }
     }
 
     HittableList objects;
 
-    objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+    objects.add(arena.make<WideBvh<>>(boxes1, 0, 1));
 
-    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
-    objects.add(make_shared<XZRectangle>(123, 423, 147, 412, 554, light));
+    auto light = arena.make<DiffuseLight>(Color(7, 7, 7));
+    objects.add(arena.make<XZRectangle>(123, 423, 147, 412, 554, light));
 
     auto center1 = Point3(400, 400, 200);
     auto center2 = center1 + Vec3(30, 0, 0);
-    auto moving_sphere_material = make_shared<Lambertian>(Color(0.7, 0.3, 0.1));
-    objects.add(make_shared<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+    auto moving_sphere_material = arena.make<Lambertian>(Color(0.7, 0.3, 0.1));
+    objects.add(arena.make<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
 
-    objects.add(make_shared<Sphere>(Point3(260, 150, 45), 50, make_shared<Dielectric>(1.5)));
-    objects.add(make_shared<Sphere>(Point3(0, 150, 145), 50,
-                                    make_shared<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
+    objects.add(arena.make<Sphere>(Point3(260, 150, 45), 50, arena.make<Dielectric>(1.5)));
+    objects.add(arena.make<Sphere>(Point3(0, 150, 145), 50,
+                                   arena.make<Metal>(Color(0.8, 0.8, 0.9), 1.0)));
 
-    auto boundary = make_shared<Sphere>(Point3(360, 150, 145), 70, make_shared<Dielectric>(1.5));
+    auto boundary = arena.make<Sphere>(Point3(360, 150, 145), 70, arena.make<Dielectric>(1.5));
     objects.add(boundary);
-    objects.add(make_shared<ConstantMedium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
-    boundary = make_shared<Sphere>(Point3(0, 0, 0), 5000, make_shared<Dielectric>(1.5));
-    objects.add(make_shared<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
+    objects.add(arena.make<ConstantMedium>(boundary, 0.2, Color(0.2, 0.4, 0.9)));
+    boundary = arena.make<Sphere>(Point3(0, 0, 0), 5000, arena.make<Dielectric>(1.5));
+    objects.add(arena.make<ConstantMedium>(boundary, .0001, Color(1, 1, 1)));
 
-    auto emat = make_shared<Lambertian>(make_shared<ImageTexture>("earthmap.jpg"));
-    objects.add(make_shared<Sphere>(Point3(400, 200, 400), 100, emat));
-    auto pertext = make_shared<NoiseTexture>(0.1);
-    objects.add(make_shared<Sphere>(Point3(220, 280, 300), 80, make_shared<Lambertian>(pertext)));
+    auto emat = arena.make<Lambertian>(arena.make<ImageTexture>("earthmap.jpg"));
+    objects.add(arena.make<Sphere>(Point3(400, 200, 400), 100, emat));
+    auto pertext = arena.make<NoiseTexture>(0.1);
+    objects.add(arena.make<Sphere>(Point3(220, 280, 300), 80, arena.make<Lambertian>(pertext)));
 
-    HittableList boxes2;
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
+    SphereBatch boxes2;
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
     int ns = 1000;
     for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<Sphere>(Point3::random(0, 165), 10, white));
+        boxes2.add(Point3::random(0, 165), 10, white);
     }
 
-    objects.add(make_shared<translate>(
-        make_shared<RotateY>(make_shared<bvh_node>(boxes2, 0.0, 1.0), 15), Vec3(-100, 270, 395)));
+    objects.add(arena.make<Instance>(
+        arena.make<WideBvh<>>(make_sphere_batches(boxes2, 0.0, 1.0), 0.0, 1.0),
+        Transform::translation(Vec3(-100, 270, 395)) * Transform::rotation_y(15)));
 
     return objects;
 }
 
-inline HittableList cornell_smoke() {
+inline HittableList cornell_smoke(SceneArena &arena) {
     HittableList objects;
 
-    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto light = make_shared<DiffuseLight>(Color(7, 7, 7));
+    auto red = arena.make<Lambertian>(Color(.65, .05, .05));
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
+    auto green = arena.make<Lambertian>(Color(.12, .45, .15));
+    auto light = arena.make<DiffuseLight>(Color(7, 7, 7));
 
-    objects.add(make_shared<YZRectangle>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<YZRectangle>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<XZRectangle>(113, 443, 127, 432, 554, light));
-    objects.add(make_shared<XZRectangle>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<XZRectangle>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<XYRectangle>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 555, green));
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 0, red));
+    objects.add(arena.make<XZRectangle>(113, 443, 127, 432, 554, light));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 0, white));
+    objects.add(arena.make<XYRectangle>(0, 555, 0, 555, 555, white));
 
-    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = make_shared<RotateY>(box1, 15);
-    box1 = make_shared<translate>(box1, Vec3(265, 0, 295));
+    shared_ptr<Hittable> box1 = arena.make<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = arena.make<Instance>(
+        box1, Transform::translation(Vec3(265, 0, 295)) * Transform::rotation_y(15));
 
-    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = make_shared<RotateY>(box2, -18);
-    box2 = make_shared<translate>(box2, Vec3(130, 0, 65));
+    shared_ptr<Hittable> box2 = arena.make<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = arena.make<Instance>(
+        box2, Transform::translation(Vec3(130, 0, 65)) * Transform::rotation_y(-18));
 
-    objects.add(make_shared<ConstantMedium>(box1, 0.01, Color(0, 0, 0)));
-    objects.add(make_shared<ConstantMedium>(box2, 0.01, Color(1, 1, 1)));
+    objects.add(arena.make<ConstantMedium>(box1, 0.01, Color(0, 0, 0)));
+    objects.add(arena.make<ConstantMedium>(box2, 0.01, Color(1, 1, 1)));
 
     return objects;
 }
 
-inline HittableList cornell_box() {
+inline HittableList cornell_box(SceneArena &arena) {
     HittableList objects;
 
-    auto red = make_shared<Lambertian>(Color(.65, .05, .05));
-    auto white = make_shared<Lambertian>(Color(.73, .73, .73));
-    auto green = make_shared<Lambertian>(Color(.12, .45, .15));
-    auto light = make_shared<DiffuseLight>(Color(15, 15, 15));
-
-    objects.add(make_shared<YZRectangle>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<YZRectangle>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<XZRectangle>(213, 343, 227, 332, 554, light));
-    objects.add(make_shared<XZRectangle>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<XZRectangle>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<XYRectangle>(0, 555, 0, 555, 555, white));
-
-    shared_ptr<Hittable> box1 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
-    box1 = make_shared<RotateY>(box1, 15);
-    box1 = make_shared<translate>(box1, Vec3(265, 0, 295));
+    auto red = arena.make<Lambertian>(Color(.65, .05, .05));
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
+    auto green = arena.make<Lambertian>(Color(.12, .45, .15));
+    auto light = arena.make<DiffuseLight>(Color(15, 15, 15));
+
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 555, green));
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 0, red));
+    objects.add(arena.make<XZRectangle>(213, 343, 227, 332, 554, light));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 0, white));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<XYRectangle>(0, 555, 0, 555, 555, white));
+
+    shared_ptr<Hittable> box1 = arena.make<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = arena.make<Instance>(
+        box1, Transform::translation(Vec3(265, 0, 295)) * Transform::rotation_y(15));
     objects.add(box1);
 
-    shared_ptr<Hittable> box2 = make_shared<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
-    box2 = make_shared<RotateY>(box2, -18);
-    box2 = make_shared<translate>(box2, Vec3(130, 0, 65));
+    shared_ptr<Hittable> box2 = arena.make<Box>(Point3(0, 0, 0), Point3(165, 165, 165), white);
+    box2 = arena.make<Instance>(
+        box2, Transform::translation(Vec3(130, 0, 65)) * Transform::rotation_y(-18));
     objects.add(box2);
 
     return objects;
 }
 
-inline HittableList simple_light() {
+inline HittableList cornell_mesh(SceneArena &arena, const std::string &cache_dir) {
+    HittableList objects;
+
+    auto red = arena.make<Lambertian>(Color(.65, .05, .05));
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
+    auto green = arena.make<Lambertian>(Color(.12, .45, .15));
+    auto light = arena.make<DiffuseLight>(Color(15, 15, 15));
+
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 555, green));
+    objects.add(arena.make<YZRectangle>(0, 555, 0, 555, 0, red));
+    objects.add(arena.make<XZRectangle>(213, 343, 227, 332, 554, light));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 0, white));
+    objects.add(arena.make<XZRectangle>(0, 555, 0, 555, 555, white));
+    objects.add(arena.make<XYRectangle>(0, 555, 0, 555, 555, white));
+
+    shared_ptr<Hittable> box1 = arena.make<Box>(Point3(0, 0, 0), Point3(165, 330, 165), white);
+    box1 = arena.make<Instance>(
+        box1, Transform::translation(Vec3(265, 0, 295)) * Transform::rotation_y(15));
+    objects.add(box1);
+
+    // 20480 triangles in one object, with interpolated normals.
+    auto metal = arena.make<Metal>(Color(0.8, 0.85, 0.88), 0.05);
+    const Point3 center(190, 90, 190);
+    const float radius = 90;
+    const int subdivisions = 5;
+    const auto sphere = [=] { return make_icosphere(center, radius, subdivisions); };
+    if (cache_dir.empty()) {
+        objects.add(arena.make<TriangleMesh>(sphere(), metal));
+    } else {
+        // The key is made from the arguments, so changing any of them rebuilds the cache.
+        const char name[] = "icosphere";
+        uint64_t key = mesh_cache_hash(name, sizeof(name));
+        key = mesh_cache_hash(center.e, sizeof(center.e), key);
+        key = mesh_cache_hash(&radius, sizeof(radius), key);
+        key = mesh_cache_hash(&subdivisions, sizeof(subdivisions), key);
+        objects.add(cached_triangle_mesh(cache_dir + "/cornell_mesh.rtmesh", key, metal, sphere));
+    }
+
+    return objects;
+}
+
+// The sphere cluster of the final scene placed 4096 times, each copy turned and scaled on its
+// own. The copies are instances of a single WideBvh, so the scene holds 1000 spheres however
+// many copies there are; the renderer's top-level BVH is built over the instance boxes.
+inline HittableList instanced_clusters(SceneArena &arena) {
+    HittableList objects;
+
+    const auto checker = arena.make<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+    objects.add(
+        arena.make<Sphere>(Point3(0, -100000, 0), 100000, arena.make<Lambertian>(checker)));
+
+    SphereBatch spheres;
+    auto white = arena.make<Lambertian>(Color(.73, .73, .73));
+    for (int j = 0; j < 1000; j++) {
+        spheres.add(Point3::random(0, 165), 10, white);
+    }
+    const shared_ptr<Hittable> cluster =
+        arena.make<WideBvh<>>(make_sphere_batches(spheres, 0.0, 1.0), 0.0, 1.0);
+
+    // Centered on the origin, resting on the ground.
+    const Transform center = Transform::translation(Vec3(-82.5, -10, -82.5));
+    const int copies_per_side = 64;
+    const float spacing = 300;
+    for (int i = 0; i < copies_per_side; i++) {
+        for (int j = 0; j < copies_per_side; j++) {
+            const float scale = random_float(0.5, 1.2);
+            const Vec3 position((i - copies_per_side / 2) * spacing, 85 * scale,
+                                (j - copies_per_side / 2) * spacing);
+            objects.add(arena.make<Instance>(
+                cluster, Transform::translation(position) * Transform::scaling(scale) *
+                             Transform::rotation_y(random_float(0, 360)) * center));
+        }
+    }
+
+    return objects;
+}
+
+inline HittableList simple_light(SceneArena &arena) {
     HittableList world;
 
-    auto pertext = make_shared<NoiseTexture>(4);
-    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(pertext)));
-    world.add(make_shared<Sphere>(Point3(0, 2, 0), 2, make_shared<Lambertian>(pertext)));
+    auto pertext = arena.make<NoiseTexture>(4);
+    world.add(arena.make<Sphere>(Point3(0, -1000, 0), 1000, arena.make<Lambertian>(pertext)));
+    world.add(arena.make<Sphere>(Point3(0, 2, 0), 2, arena.make<Lambertian>(pertext)));
 
-    auto difflight = make_shared<DiffuseLight>(Color(4, 4, 4));
-    world.add(make_shared<XYRectangle>(3, 5, 1, 3, -2, difflight));
+    auto difflight = arena.make<DiffuseLight>(Color(4, 4, 4));
+    world.add(arena.make<XYRectangle>(3, 5, 1, 3, -2, difflight));
 
     return world;
 }
 
-inline HittableList mars() {
-    auto mars_texture = std::make_shared<ImageTexture>("MarsTopoMap.jpg");
-    auto mars_surface = make_shared<Lambertian>(mars_texture);
-    auto globe = make_shared<Sphere>(Point3(0, 0, 0), 2, mars_surface);
+inline HittableList mars(SceneArena &arena) {
+    auto mars_texture = arena.make<ImageTexture>("MarsTopoMap.jpg");
+    auto mars_surface = arena.make<Lambertian>(mars_texture);
+    auto globe = arena.make<Sphere>(Point3(0, 0, 0), 2, mars_surface);
 
     return HittableList(globe);
 }
 
-inline HittableList earth() {
-    auto earth_texture = std::make_shared<ImageTexture>("earthmap.jpg");
-    auto earth_surface = make_shared<Lambertian>(earth_texture);
-    auto globe = make_shared<Sphere>(Point3(0, 0, 0), 2, earth_surface);
+inline HittableList earth(SceneArena &arena) {
+    auto earth_texture = arena.make<ImageTexture>("earthmap.jpg");
+    auto earth_surface = arena.make<Lambertian>(earth_texture);
+    auto globe = arena.make<Sphere>(Point3(0, 0, 0), 2, earth_surface);
 
     return HittableList(globe);
 }
-inline HittableList two_perlin_spheres() {
+inline HittableList two_perlin_spheres(SceneArena &arena) {
     HittableList world;
 
-    auto perlin_texture = make_shared<NoiseTexture>(random_int(5, 10));
+    auto perlin_texture = arena.make<NoiseTexture>(random_int(5, 10));
     world.add(
-        make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(perlin_texture)));
-    world.add(make_shared<Sphere>(Point3(0, 2, 0), 2, make_shared<Lambertian>(perlin_texture)));
+        arena.make<Sphere>(Point3(0, -1000, 0), 1000, arena.make<Lambertian>(perlin_texture)));
+    world.add(arena.make<Sphere>(Point3(0, 2, 0), 2, arena.make<Lambertian>(perlin_texture)));
 
     return world;
 }
 
-inline HittableList random_scene() {
+inline HittableList random_scene(SceneArena &arena) {
     HittableList world;
 
-    const auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
-    world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, make_shared<Lambertian>(checker)));
+    const auto checker = arena.make<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+    world.add(arena.make<Sphere>(Point3(0, -1000, 0), 1000, arena.make<Lambertian>(checker)));
+
+    // The small spheres go into SIMD batches; the ground would only bloat their bounds.
+    SphereBatch spheres;
 
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
@@ -184,46 +271,167 @@ inline HittableList random_scene() {
                 if (choose_material < 0.6) {
                     // diffuse
                     auto albedo = Color::random() * Color::random();
-                    sphere_material = make_shared<Lambertian>(albedo);
+                    sphere_material = arena.make<Lambertian>(albedo);
                     auto center2 = sphere_center + Vec3(0, random_float(0, 0.5), 0);
-                    world.add(make_shared<moving_sphere>(sphere_center, center2, 0.0, 1.0, 0.2,
-                                                         sphere_material));
+                    spheres.add(sphere_center, center2, 0.0, 1.0, 0.2, sphere_material);
                 } else if (choose_material < 0.85) {
                     // metal
                     auto albedo = Color::random(0.5, 1);
                     auto fuzz = random_float(0, 0.5);
-                    sphere_material = make_shared<Metal>(albedo, fuzz);
-                    world.add(make_shared<Sphere>(sphere_center, 0.2, sphere_material));
+                    sphere_material = arena.make<Metal>(albedo, fuzz);
+                    spheres.add(sphere_center, 0.2, sphere_material);
                 } else {
                     // glass
-                    sphere_material = make_shared<Dielectric>(1.5);
-                    world.add(make_shared<Sphere>(sphere_center, 0.2, sphere_material));
+                    sphere_material = arena.make<Dielectric>(1.5);
+                    spheres.add(sphere_center, 0.2, sphere_material);
                 }
             }
         }
     }
 
     const auto material_front =
-        make_shared<Metal>(Color(198.0 / 255.0, 255.0 / 255.0, 221.0 / 255.0), 0.1);
-    world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0, material_front));
+        arena.make<Metal>(Color(198.0 / 255.0, 255.0 / 255.0, 221.0 / 255.0), 0.1);
+    spheres.add(Point3(4, 1, 0), 1.0, material_front);
 
-    const auto material_middle = make_shared<Dielectric>(1.5);
-    world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material_middle));
+    const auto material_middle = arena.make<Dielectric>(1.5);
+    spheres.add(Point3(0, 1, 0), 1.0, material_middle);
 
     const auto material_behind =
-        make_shared<Lambertian>(Color(247.0 / 255.0, 121.0 / 255.0, 125.0 / 255.0));
-    world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material_behind));
+        arena.make<Lambertian>(Color(247.0 / 255.0, 121.0 / 255.0, 125.0 / 255.0));
+    spheres.add(Point3(-4, 1, 0), 1.0, material_behind);
+
+    for (const auto &batch : make_sphere_batches(spheres, 0.0, 1.0).objects) {
+        world.add(batch);
+    }
 
     return world;
 }
 
-inline HittableList two_spheres() {
+inline HittableList two_spheres(SceneArena &arena) {
     HittableList world;
 
-    auto checker = make_shared<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
+    auto checker = arena.make<CheckerTexture>(Color(0.2, 0.3, 0.1), Color(0.9, 0.9, 0.9));
 
-    world.add(make_shared<Sphere>(Point3(0, -10, 0), 10, make_shared<Lambertian>(checker)));
-    world.add(make_shared<Sphere>(Point3(0, 10, 0), 10, make_shared<Lambertian>(checker)));
+    world.add(arena.make<Sphere>(Point3(0, -10, 0), 10, arena.make<Lambertian>(checker)));
+    world.add(arena.make<Sphere>(Point3(0, 10, 0), 10, arena.make<Lambertian>(checker)));
 
     return world;
-}
\ No newline at end of file
+}
+
+// A world together with the camera and background it is meant to be rendered with.
+struct Scene {
+    const char *name = "";
+    // Where the objects of world are placed.
+    SceneArena arena;
+    HittableList world;
+    Color background = Color(0, 0, 0);
+    Point3 look_from;
+    Point3 look_at;
+    float vertical_view_field = 40.0;
+    float aperture = 0.0;
+    float aspect_ratio = 1.0;
+};
+
+constexpr int scene_count = 11;
+
+// Scenes are numbered 1 to scene_count; any other id selects the final scene. Given a
+// cache_dir, scenes with triangle meshes keep them there with their BVHs (see mesh_cache.h).
+inline Scene make_scene(int id, const std::string &cache_dir = "") {
+    Scene scene;
+
+    switch (id) {
+    case 1:
+        scene.name = "random_scene";
+        scene.world = random_scene(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(13, 2, 3);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 20.0;
+        scene.aperture = 0.1;
+        break;
+
+    case 2:
+        scene.name = "two_spheres";
+        scene.world = two_spheres(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(13, 2, 3);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 20.0;
+        break;
+
+    case 3:
+        scene.name = "two_perlin_spheres";
+        scene.world = two_perlin_spheres(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(13, 2, 3);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 20.0;
+        break;
+
+    case 4:
+        scene.name = "mars";
+        scene.world = mars(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(13, 2, 3);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 20.0;
+        break;
+
+    case 5:
+        scene.name = "earth";
+        scene.world = earth(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(13, 2, 3);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 20.0;
+        break;
+
+    case 6:
+        scene.name = "simple_light";
+        scene.world = simple_light(scene.arena);
+        scene.look_from = Point3(26, 3, 6);
+        scene.look_at = Point3(0, 2, 0);
+        scene.vertical_view_field = 20.0;
+        break;
+
+    case 7:
+        scene.name = "cornell_box";
+        scene.world = cornell_box(scene.arena);
+        scene.look_from = Point3(278, 278, -800);
+        scene.look_at = Point3(278, 278, 0);
+        break;
+
+    case 8:
+        scene.name = "cornell_smoke";
+        scene.world = cornell_smoke(scene.arena);
+        scene.look_from = Point3(278, 278, -800);
+        scene.look_at = Point3(278, 278, 0);
+        break;
+
+    default:
+    case 9:
+        scene.name = "final_scene";
+        scene.world = final_scene(scene.arena);
+        scene.look_from = Point3(478, 278, -600);
+        scene.look_at = Point3(278, 278, 0);
+        break;
+
+    case 10:
+        scene.name = "cornell_mesh";
+        scene.world = cornell_mesh(scene.arena, cache_dir);
+        scene.look_from = Point3(278, 278, -800);
+        scene.look_at = Point3(278, 278, 0);
+        break;
+
+    case 11:
+        scene.name = "instanced_clusters";
+        scene.world = instanced_clusters(scene.arena);
+        scene.background = Color(0.70, 0.80, 1.00);
+        scene.look_from = Point3(-1800, 700, -2600);
+        scene.look_at = Point3(0, 0, 0);
+        scene.vertical_view_field = 30.0;
+        break;
+    }
+
+    return scene;
+}
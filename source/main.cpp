@@ -1,9 +1,8 @@
-#include <Windows.h>
 #include <fstream>
 #include <iomanip>
 #include <memory>
 #include <ostream>
-#include <thread>
+#include <string>
 
 
 #include "aarectangle.h"
@@ -12,10 +11,14 @@
 #include "color.h"
 #include "constant_medium.h"
 #include "hittable_list.h"
+#include "image_writer.h"
 #include "material.h"
 #include "moving_sphere.h"
+#include "progressive.h"
+#include "renderer.h"
 #include "rtweekend.h"
 #include "sphere.h"
+#include "timer.h"
 #include "world.h"
 
 
@@ -24,198 +27,83 @@ class Material;
 
 // Color(189.0 / 255.0, 195.0 / 255.0, 199.0 / 255.0)
 
-Color ray_color(const Ray& r, const Color& background, const Hittable& world, int depth) {
-	HitRecord record;
-
-	// If we've exceeded the ray bounce limit, no more light is gathered
-	if (depth <= 0)
-		return Color(0, 0, 0);
-
-	// If the ray hits nothing, return the background color.
-	if (!world.hit(r, 10e-3, infinity, record))
-		return background;
-
-	Ray scattered;
-	Color attenuation;
-	Color emitted = record.material_pointer->emitted(record.u, record.v, record.p);
-
-	if (!record.material_pointer->scatter(r, record, attenuation, scattered))
-		return emitted;
-
-	return emitted + attenuation * ray_color(scattered, background, world, depth - 1);
-}
-
-inline void test() {
+inline void test(AsyncImageWriter& image_writer) {
 
 	// Image
-	std::ofstream image_out("img.ppm");
-
-	float aspect_ratio = 1.0;
-	constexpr int image_width = 400;
-	int image_height = static_cast<int>(image_width / aspect_ratio);
-	int samples_per_pixel = 200;
-	int samples_max_depth = 64;
-
-	auto image_data = new Vec3[image_height][image_width];
-
-	// World
+	const std::string output_path = "img.ppm";
 
-	HittableList world;
-
-	Point3 look_from;
-	Point3 look_at;
-	float vertical_view_field = 40.0;
-	float aperture = 0.0;
-	Color background(0, 0, 0);
-
-	switch (0) {
-	case 1:
-		world = random_scene();
-		background = Color(0.70, 0.80, 1.00);
-		look_from = Point3(13, 2, 3);
-		look_at = Point3(0, 0, 0);
-		vertical_view_field = 20.0;
-		aperture = 0.1;
-		break;
-
-	case 2:
-		world = two_spheres();
-		background = Color(0.70, 0.80, 1.00);
-		look_from = Point3(13, 2, 3);
-		look_at = Point3(0, 0, 0);
-		vertical_view_field = 20.0;
-		break;
-
-	case 3:
-		world = two_perlin_spheres();
-		background = Color(0.70, 0.80, 1.00);
-		look_from = Point3(13, 2, 3);
-		look_at = Point3(0, 0, 0);
-		vertical_view_field = 20.0;
-		break;
-
-	case 4:
-		world = mars();
-		background = Color(0.70, 0.80, 1.00);
-		look_from = Point3(13, 2, 3);
-		look_at = Point3(0, 0, 0);
-		vertical_view_field = 20.0;
-		break;
-
-	case 5:
-		world = earth();
-		background = Color(0.70, 0.80, 1.00);
-		look_from = Point3(13, 2, 3);
-		look_at = Point3(0, 0, 0);
-		vertical_view_field = 20.0;
-		break;
-
-	case 6:
-		world = simple_light();
-		background = Color(0, 0, 0);
-		look_from = Point3(26, 3, 6);
-		look_at = Point3(0, 2, 0);
-		vertical_view_field = 20.0;
-		break;
-
-	case 7:
-		world = cornell_box();
-		aspect_ratio = 1.0;
-		background = Color(0, 0, 0);
-		look_from = Point3(278, 278, -800);
-		look_at = Point3(278, 278, 0);
-		vertical_view_field = 40.0;
-		break;
-
-	case 8:
-		world = cornell_smoke();
-		look_from = Point3(278, 278, -800);
-		look_at = Point3(278, 278, 0);
-		vertical_view_field = 40.0;
-		break;
-
-	default:
-	case 9:
-		world = final_scene();
-		background = Color(0, 0, 0);
-		look_from = Point3(478, 278, -600);
-		look_at = Point3(278, 278, 0);
-		vertical_view_field = 40.0;
-		break;
-	}
-
-	// Camera
+	RenderSettings settings;
+	settings.image_width = 400;
+	settings.samples_per_pixel = 200;
+	settings.max_depth = 64;
 
-	const Vec3 vertical_up(0, 1, 0);
-	constexpr float distance_to_focus = 10.0;
+	// Scrambled Sobol points instead of independent random numbers for the pixel, lens, time
+	// and scattering samples; the same noise level takes fewer samples.
+	settings.sampler = SamplerType::sobol;
 
-	Camera camera(look_from, look_at, vertical_up, vertical_view_field, aspect_ratio, aperture,
-		distance_to_focus, 0.0, 1.0);
+	// Diffuse bounces aim a shadow ray at the light as well, instead of waiting for a scattered
+	// ray to find it.
+	settings.sample_lights = true;
 
-	int n = image_height;
+	// Adaptive sampling stops pixels once their noise is below the threshold; the sample count
+	// above is then the upper limit.
+	settings.adaptive = false;
+	settings.error_threshold = 0.02f;
 
-	const int num_threads = std::thread::hardware_concurrency() - 1;
-	std::vector<std::thread> threads(num_threads);
+	// World
 
-	for (int i = 0; i < num_threads; ++i) {
-		int start_y = i * image_height / num_threads;
-		int end_y = (i + 1) * image_height / num_threads;
+	const Scene scene = make_scene(0);
 
-		threads[i] = std::thread([start_y, end_y, image_width, image_height, samples_per_pixel, &camera, &background, &world, samples_max_depth, &image_data, &n]() {
-			for (int y = end_y - 1; y >= start_y; --y) {
-				std::cerr << '\n' << n-- << std::flush;
+	// Render in small tiles handed out by a work-stealing scheduler, so threads that finish
+	// cheap regions early help out with the expensive ones.
+	settings.tile_size = 16;
+	settings.trace_packets = true;
 
-				for (int x = 0; x < image_width; ++x) {
-					Color pixel_color(0, 0, 0);
+	// Progressive rendering adds passes of a few samples per pixel to an accumulator, writes a
+	// preview now and then and checkpoints the accumulator, so an interrupted render resumes
+	// where it stopped and a finished one can be extended by raising samples_per_pixel.
+	const bool progressive = false;
+	ProgressiveSettings progressive_settings;
+	progressive_settings.pass_samples = 16;
+	progressive_settings.preview_path = "img_preview.ppm";
+	progressive_settings.checkpoint_path = "img.accum";
 
-					for (int s = 0; s < samples_per_pixel; ++s) {
-						float u = (x + random_float()) / (image_width - 1);
-						float v = (y + random_float()) / (image_height - 1);
-						Ray r = camera.get_ray(u, v);
-						pixel_color += ray_color(r, background, world, samples_max_depth);
-					}
+	RenderResult result = progressive
+		? render_progressive(scene, settings, progressive_settings, image_writer)
+		: render_scene(scene, settings);
 
-					image_data[y][x] = std::move(pixel_color);
-				}
-			}
-			});
-	}
+	// Encoding happens on the writer thread while the next frame renders.
+	image_writer.submit(std::move(result.image), output_path);
 
-	for (auto& thread : threads) {
-		thread.join();
-	}
+	// With RT_STATS, where the render spent its box and primitive tests. Progressive renders
+	// keep neither this nor the sample counts below.
+	if (render_stats_enabled && !progressive)
+		image_writer.submit(heatmap_image(result.cost), "img_cost.ppm");
 
-	image_out << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-	for (int y = image_height - 1; y >= 0; --y) {
-		for (int x = 0; x < image_width; ++x) {
-			write_color(image_out, std::move(image_data[y][x]), samples_per_pixel);
-		}
-	}
+	// Samples taken per pixel, red at the upper limit.
+	if (settings.adaptive && !progressive)
+		image_writer.submit(heatmap_image(result.sample_counts, settings.samples_per_pixel),
+			"img_samples.ppm");
 
 	std::cerr << "\nDone\n";
-
-	delete[] image_data;
-
-	image_out.close();
 }
 
 int main() {
 
-	LARGE_INTEGER time_start, time_end, tc;
-	QueryPerformanceFrequency(&tc);
-
 	float time = 0.0;
 	constexpr int max = 1;
 
+	AsyncImageWriter image_writer;
+
 	for (int i = 0; i < max; ++i) {
-		QueryPerformanceCounter(&time_start);
+		const Timer timer;
 
-		test();
+		test(image_writer);
 
-		QueryPerformanceCounter(&time_end);
-		time += static_cast<float>(time_end.QuadPart - time_start.QuadPart) /
-			static_cast<float>(tc.QuadPart);
+		time += static_cast<float>(timer.seconds());
 	}
 
 	std::cerr << "time = " << time / static_cast<float>(max) << std::endl;
+
+	image_writer.wait();
 }
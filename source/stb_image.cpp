@@ -0,0 +1,4 @@
+// Compiles the stb_image implementation once for the whole program.
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "rtw_stb_image.h"
@@ -0,0 +1,163 @@
+// The flattened and wide BVHs against bvh_node and a plain list, and the depth limit of the
+// builder that their fixed traversal stacks rely on.
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bvh.h"
+#include "bvh_builder.h"
+#include "check.h"
+#include "linear_bvh.h"
+#include "ray_packet.h"
+#include "rng.h"
+#include "scene_arena.h"
+#include "wide_bvh.h"
+#include "world.h"
+
+namespace {
+
+// Rays from random points around the scene in random directions, at random times.
+std::vector<Ray> random_rays(int count, float lo, float hi) {
+	std::vector<Ray> rays;
+	rays.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		rays.emplace_back(Vec3::random(lo, hi), random_unit_vector(), random_float());
+	}
+	return rays;
+}
+
+// Counts the rays on which a and b disagree about the closest hit or about occlusion. The
+// thread generator is reseeded per query, for the media of the final scene.
+int mismatches(const Hittable &a, const Hittable &b, const std::vector<Ray> &rays) {
+	int count = 0;
+	for (size_t i = 0; i < rays.size(); ++i) {
+		HitRecord rec_a, rec_b;
+		seed_thread_rng(i, 0);
+		const bool hit_a = a.hit(rays[i], 0.001f, infinity, rec_a);
+		seed_thread_rng(i, 0);
+		const bool hit_b = b.hit(rays[i], 0.001f, infinity, rec_b);
+		if (hit_a != hit_b || (hit_a && std::fabs(rec_a.t - rec_b.t) > 1e-4f * rec_a.t)) {
+			++count;
+			continue;
+		}
+
+		seed_thread_rng(i, 1);
+		const bool occluded_a = a.occluded(rays[i], 0.001f, 100.0f);
+		seed_thread_rng(i, 1);
+		if (occluded_a != b.occluded(rays[i], 0.001f, 100.0f))
+			++count;
+	}
+	return count;
+}
+
+// Every primitive index appears in exactly one leaf, and no leaf is over the limits.
+bool valid_build(const BvhBuild &build, size_t primitive_count, const BvhBuildOptions &options) {
+	std::vector<int> seen(primitive_count, 0);
+	for (const BvhBuildNode &node : build.nodes) {
+		if (node.count > options.max_leaf_size)
+			return false;
+		for (uint32_t i = node.offset; node.count > 0 && i < node.offset + node.count; ++i) {
+			seen[build.indices[i]] += 1;
+		}
+	}
+	return std::all_of(seen.begin(), seen.end(), [](int n) { return n == 1; }) &&
+		   build.stats.max_depth <= bvh_max_depth;
+}
+
+// Traces the rays in packets of neighbours that start together, with some lanes left out,
+// and counts the lanes whose hit differs from reference.hit().
+int packet_mismatches(const Hittable &reference, const Hittable &wide,
+					  const std::vector<Ray> &rays) {
+	int count = 0;
+	for (size_t first = 0; first + packet_width <= rays.size(); first += packet_width) {
+		RayPacket packet;
+		HitRecord recs[packet_width];
+		for (int lane = 0; lane < packet_width; ++lane) {
+			packet.set(lane, rays[first + lane], infinity);
+		}
+		const PacketMask mask = full_packet_mask & ~static_cast<PacketMask>(first / packet_width);
+		const PacketMask hits = wide.hit_packet(packet, mask, 0.001f, recs);
+		if ((hits & ~mask) != 0)
+			++count;
+
+		for_each_lane(mask, [&](int lane) {
+			HitRecord rec;
+			const bool hit = reference.hit(rays[first + lane], 0.001f, infinity, rec);
+			const bool packet_hit = (hits >> lane) & 1;
+			if (hit != packet_hit || (hit && std::fabs(rec.t - recs[lane].t) > 1e-4f * rec.t))
+				++count;
+		});
+	}
+	return count;
+}
+
+// Rays from a small region towards a cone of directions, like the primary rays of a tile.
+std::vector<Ray> coherent_rays(int count, const Point3 &from, const Point3 &towards,
+							   float spread) {
+	std::vector<Ray> rays;
+	rays.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		const Point3 target = towards + spread * Vec3::random(-1, 1);
+		const Point3 origin = from + 0.1f * Vec3::random(-1, 1);
+		rays.emplace_back(origin, target - origin, 0.0f);
+	}
+	return rays;
+}
+
+} // namespace
+
+TEST_CASE(bvh, linear_bvh_matches_bvh_node) {
+	// 100k rays in each of three scenes.
+	seed_thread_rng(4, 0, 1);
+	SceneArena arena;
+	const HittableList scenes[] = {random_scene(arena), cornell_box(arena), final_scene(arena)};
+	const float ranges[][2] = {{-15, 15}, {-100, 700}, {-100, 700}};
+	for (int s = 0; s < 3; ++s) {
+		const bvh_node reference(scenes[s], 0, 1);
+		const LinearBvh linear(scenes[s], 0, 1);
+		CHECK_EQ(mismatches(reference, linear, random_rays(100000, ranges[s][0], ranges[s][1])),
+				 0);
+	}
+}
+
+TEST_CASE(bvh, wide_bvh_matches_bvh_node) {
+	seed_thread_rng(6, 0, 1);
+	SceneArena arena;
+	const HittableList scene = random_scene(arena);
+	const bvh_node reference(scene, 0, 1);
+	const WideBvh<4> wide4(scene, 0, 1);
+	const WideBvh<8> wide8(scene, 0, 1);
+
+	const std::vector<Ray> rays = random_rays(50000, -15, 15);
+	CHECK_EQ(mismatches(reference, wide4, rays), 0);
+	CHECK_EQ(mismatches(reference, wide8, rays), 0);
+
+	const std::vector<Ray> packets =
+		coherent_rays(packet_width * 4096, Point3(13, 2, 3), Point3(0, 0, 0), 4.0f);
+	CHECK_EQ(packet_mismatches(reference, wide4, packets), 0);
+	CHECK_EQ(packet_mismatches(reference, wide8, packets), 0);
+}
+
+TEST_CASE(bvh, depth_limit_forces_median_splits) {
+	seed_thread_rng(5, 0, 1);
+	SceneArena arena;
+	const HittableList scene = random_scene(arena);
+
+	// The scene needs at least 1 + ceil(log2(n)) levels; ask for just that.
+	BvhBuildOptions options;
+	options.max_depth = 1;
+	std::vector<aabb> boxes(scene.objects.size());
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		scene.objects[i]->bounding_box(0, 1, boxes[i]);
+	}
+	const int needed = 1 + static_cast<int>(std::ceil(std::log2(boxes.size())));
+	CHECK(build_sah_bvh(boxes).stats.max_depth > needed);
+
+	const BvhBuild build = build_sah_bvh(boxes, options);
+	CHECK(valid_build(build, boxes.size(), options));
+	CHECK(build.stats.max_depth <= needed);
+
+	const LinearBvh limited(scene, 0, 1, options);
+	CHECK_EQ(mismatches(scene, limited, random_rays(20000, -15, 15)), 0);
+}
@@ -0,0 +1,65 @@
+// A minimal test harness for the tinyrt_tests program: TEST_CASE(suite, name) registers a
+// test, CHECK records a failed condition and carries on. The program runs the suites named on
+// its command line, or all of them; CMake registers one ctest test per suite.
+
+#ifndef TESTS_CHECK_H
+#define TESTS_CHECK_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace check {
+
+struct TestCase {
+	const char *suite;
+	const char *name;
+	void (*run)();
+};
+
+inline std::vector<TestCase> &registry() {
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+inline int &failures() {
+	static int count = 0;
+	return count;
+}
+
+inline bool add(const char *suite, const char *name, void (*run)()) {
+	registry().push_back({suite, name, run});
+	return true;
+}
+
+inline void fail(const char *file, int line, const std::string &what) {
+	++failures();
+	std::cerr << file << ":" << line << ": check failed: " << what << "\n";
+}
+
+} // namespace check
+
+#define TEST_CASE(suite, name)                                                             \
+	static void suite##_##name();                                                          \
+	static const bool suite##_##name##_registered =                                        \
+		check::add(#suite, #name, suite##_##name);                                         \
+	static void suite##_##name()
+
+#define CHECK(condition)                                                                   \
+	do {                                                                                   \
+		if (!(condition))                                                                  \
+			check::fail(__FILE__, __LINE__, #condition);                                   \
+	} while (0)
+
+// Fails with both values printed.
+#define CHECK_EQ(a, b)                                                                     \
+	do {                                                                                   \
+		const auto check_a_ = (a);                                                         \
+		const auto check_b_ = (b);                                                         \
+		if (!(check_a_ == check_b_))                                                       \
+			check::fail(__FILE__, __LINE__,                                                \
+						std::string(#a " == " #b " (") + std::to_string(check_a_) + " vs " + \
+							std::to_string(check_b_) + ")");                               \
+	} while (0)
+
+#endif
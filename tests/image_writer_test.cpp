@@ -0,0 +1,53 @@
+// The float map writer: the header must name the byte order the samples are written in.
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "check.h"
+#include "image.h"
+#include "image_writer.h"
+
+TEST_CASE(image_writer, pfm_scale_sign_matches_the_byte_order) {
+	Image image(3, 2);
+	for (int y = 0; y < image.height(); ++y) {
+		for (int x = 0; x < image.width(); ++x) {
+			image.at(x, y) = Color(x + 0.25f, y + 0.5f, 1e-3f * (x + 3 * y));
+		}
+	}
+
+	std::ostringstream out;
+	CHECK(PfmWriter().write(image, out));
+
+	std::istringstream in(out.str());
+	std::string magic;
+	int width = 0, height = 0;
+	float scale = 0;
+	in >> magic >> width >> height >> scale;
+	in.get();
+	CHECK(magic == "PF");
+	CHECK_EQ(width, 3);
+	CHECK_EQ(height, 2);
+	CHECK((scale < 0) == (std::endian::native == std::endian::little));
+
+	// Read back in the order the scale names.
+	const bool little = scale < 0;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			for (int c = 0; c < 3; ++c) {
+				unsigned char bytes[4];
+				in.read(reinterpret_cast<char *>(bytes), 4);
+				uint32_t bits = 0;
+				for (int i = 0; i < 4; ++i) {
+					bits |= static_cast<uint32_t>(bytes[little ? i : 3 - i]) << (8 * i);
+				}
+				float value;
+				std::memcpy(&value, &bits, sizeof(value));
+				CHECK_EQ(value, image.at(x, y)[c]);
+			}
+		}
+	}
+	CHECK(in.good() && in.peek() == std::char_traits<char>::eof());
+}
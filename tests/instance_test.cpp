@@ -0,0 +1,137 @@
+// Instances finalize their hits only once the search is over: the surface data still comes
+// out in world space, also through nested instances and the packet path, and a closer hit
+// found after an instance's takes the record over completely.
+
+#include <algorithm>
+#include <cmath>
+
+#include "check.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "ray_packet.h"
+#include "rng.h"
+#include "sphere.h"
+
+namespace {
+
+// Rays start up to 30 units away, so positions are good to about 1e-4.
+bool near(float a, float b) {
+	return std::fabs(a - b) < 1e-3f * std::max(1.0f, std::fabs(a));
+}
+
+bool near(const Vec3 &a, const Vec3 &b) {
+	return near(a.x(), b.x()) && near(a.y(), b.y()) && near(a.z(), b.z());
+}
+
+// A ray from around center towards a point near it, well inside a unit sphere moved there,
+// so no ray grazes it.
+Ray random_ray(const Point3 &center) {
+	const Point3 origin = center + random_float(10, 30) * random_unit_vector();
+	return Ray(origin, center + 0.5f * random_in_unit_shpere() - origin);
+}
+
+} // namespace
+
+TEST_CASE(instance, hits_are_finalized_in_world_space) {
+	// A unit sphere stretched along x and moved to (5, 0, 0): the ellipsoid
+	// ((x - 5) / 2)^2 + y^2 + z^2 = 1, whose normal is along ((x - 5) / 4, y, z).
+	const auto sphere = make_shared<Sphere>(Point3(0, 0, 0), 1, nullptr);
+	const Instance ellipsoid(sphere, Transform::translation(Vec3(5, 0, 0)) *
+										 Transform::scaling(Vec3(2, 1, 1)));
+
+	const Ray along_x(Point3(20, 0, 0), Vec3(-1, 0, 0));
+	HitRecord rec{};
+	CHECK(ellipsoid.hit(along_x, 0, infinity, rec));
+	CHECK(rec.object == &ellipsoid);
+	rec.finalize(along_x);
+	CHECK(rec.object == nullptr);
+	CHECK(near(rec.t, 13));
+	CHECK(near(rec.p, Point3(7, 0, 0)));
+	CHECK(near(rec.normal, Vec3(1, 0, 0)));
+	CHECK(rec.front_face);
+
+	seed_thread_rng(24, 0, 1);
+	int wrong = 0;
+	for (int n = 0; n < 10000; ++n) {
+		const Ray r(Point3(5, 0, 0) + random_float(3, 10) * random_unit_vector(),
+					random_unit_vector());
+		if (!ellipsoid.hit(r, 0, infinity, rec))
+			continue;
+		rec.finalize(r);
+		const Point3 &p = rec.p;
+		const float x = (p.x() - 5) / 2;
+		const Vec3 gradient = unit_vector(Vec3(x / 2, p.y(), p.z()));
+		wrong += !near(x * x + p.y() * p.y() + p.z() * p.z(), 1) || !near(p, r.at(rec.t)) ||
+				 !near(rec.normal, rec.front_face ? gradient : -gradient);
+	}
+	CHECK_EQ(wrong, 0);
+}
+
+TEST_CASE(instance, nested_instances_match_the_composed_transform) {
+	// The inner instance of a nested pair is finalized when the outer one takes its hit over;
+	// the result matches a single instance under the product of the two transforms, in the
+	// scalar and the packet path.
+	const auto sphere = make_shared<Sphere>(Point3(0, 0, 0), 1, nullptr);
+	const Transform inner = Transform::scaling(Vec3(1, 3, 1)) * Transform::rotation_y(20);
+	const Transform outer =
+		Transform::translation(Vec3(0, 1, -2)) * Transform::rotation(Vec3(1, 0, 1), 35);
+	const Instance nested(make_shared<Instance>(sphere, inner), outer);
+	const Instance composed(sphere, outer * inner);
+
+	seed_thread_rng(24, 1, 1);
+	int mismatches = 0;
+	for (int n = 0; n < 10000; ++n) {
+		const Ray r = random_ray(Point3(0, 1, -2));
+		HitRecord a{}, b{};
+		const bool hit_a = nested.hit(r, 0, infinity, a);
+		const bool hit_b = composed.hit(r, 0, infinity, b);
+		mismatches += hit_a != hit_b;
+		if (!hit_a || !hit_b)
+			continue;
+		a.finalize(r);
+		b.finalize(r);
+		mismatches += !near(a.t, b.t) || !near(a.p, b.p) || !near(a.normal, b.normal);
+	}
+
+	for (int n = 0; n < 1000; ++n) {
+		RayPacket packet;
+		Ray rays[packet_width];
+		for (int lane = 0; lane < packet_width; ++lane) {
+			rays[lane] = random_ray(Point3(0, 1, -2));
+			packet.set(lane, rays[lane], infinity);
+		}
+		HitRecord recs[packet_width] = {};
+		const PacketMask all = (1u << packet_width) - 1;
+		const PacketMask hits = nested.hit_packet(packet, all, 0, recs);
+		for (int lane = 0; lane < packet_width; ++lane) {
+			HitRecord rec{};
+			const bool hit = composed.hit(rays[lane], 0, infinity, rec);
+			const bool packet_hit = (hits >> lane) & 1u;
+			mismatches += hit != packet_hit;
+			if (!hit || !packet_hit)
+				continue;
+			recs[lane].finalize(rays[lane]);
+			rec.finalize(rays[lane]);
+			mismatches += !near(recs[lane].p, rec.p) || !near(recs[lane].normal, rec.normal);
+		}
+	}
+	CHECK_EQ(mismatches, 0);
+}
+
+TEST_CASE(instance, a_closer_hit_takes_the_record_over) {
+	// The instance is hit first and leaves its object in the record; the plain sphere in
+	// front of it must finalize as itself.
+	const auto sphere = make_shared<Sphere>(Point3(0, 0, 0), 1, nullptr);
+	HittableList list;
+	list.add(make_shared<Instance>(sphere, Transform::translation(Vec3(0, 0, -10))));
+	list.add(make_shared<Sphere>(Point3(0, 0, -3), 0.5f, nullptr));
+
+	const Ray r(Point3(0, 0.25f, 0), Vec3(0, 0, -1));
+	HitRecord rec{};
+	CHECK(list.hit(r, 0, infinity, rec));
+	CHECK(rec.object == list.objects[1].get());
+	rec.finalize(r);
+	const float z = std::sqrt(0.25f - 0.0625f);
+	CHECK(near(rec.p, Point3(0, 0.25f, -3 + z)));
+	CHECK(near(rec.normal, Vec3(0, 0.5f, 2 * z)));
+}
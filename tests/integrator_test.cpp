@@ -0,0 +1,76 @@
+// The path integrator with and without next-event estimation must converge to the same
+// radiance, including when an emitter that the lights cannot sample hides part of one that
+// they can.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "aarectangle.h"
+#include "check.h"
+#include "hittable_list.h"
+#include "integrator.h"
+#include "light_list.h"
+#include "material.h"
+#include "rng.h"
+
+namespace {
+
+struct Estimate {
+	double mean = 0;
+	double standard_error = 0;
+};
+
+// Average luminance of paths starting straight down onto the floor.
+Estimate estimate(const HittableList &world, const LightList *lights, int paths) {
+	IntegratorOptions options;
+	options.max_depth = 3;
+	const PathIntegrator integrator(world, Color(0, 0, 0), options, lights);
+	const Ray r(Point3(0.1f, 0.5f, 0.2f), Vec3(0, -1, 0));
+
+	double sum = 0, sum_squares = 0;
+	PathStats stats;
+	for (int i = 0; i < paths; ++i) {
+		seed_thread_rng(i, 0, 8);
+		const Color c = integrator.trace(r, stats);
+		const double value = (c.x() + c.y() + c.z()) / 3;
+		sum += value;
+		sum_squares += value * value;
+	}
+	Estimate result;
+	result.mean = sum / paths;
+	const double variance = sum_squares / paths - result.mean * result.mean;
+	result.standard_error = std::sqrt(std::max(variance, 0.0) / paths);
+	return result;
+}
+
+} // namespace
+
+TEST_CASE(integrator, light_sampling_agrees_with_plain_paths) {
+	// A floor, a large light overhead and, in a nested list the lights do not look into, a
+	// small emitter right below the light.
+	HittableList emitter;
+	emitter.add(
+		make_shared<XZRectangle>(-1, 1, -1, 1, 3, make_shared<DiffuseLight>(Color(2, 2, 2))));
+
+	HittableList world;
+	world.add(make_shared<XZRectangle>(-20, 20, -20, 20, 0,
+									   make_shared<Lambertian>(Color(0.5, 0.5, 0.5))));
+	world.add(
+		make_shared<XZRectangle>(-3, 3, -3, 3, 4, make_shared<DiffuseLight>(Color(4, 4, 4))));
+	world.add(make_shared<HittableList>(emitter));
+
+	const LightList lights(world);
+	CHECK_EQ(lights.size(), size_t{1});
+
+	const Estimate plain = estimate(world, nullptr, 400000);
+	const Estimate sampled = estimate(world, &lights, 400000);
+	const double tolerance =
+		5 * std::sqrt(plain.standard_error * plain.standard_error +
+					  sampled.standard_error * sampled.standard_error);
+	CHECK(plain.mean > 0.1);
+	CHECK(std::fabs(plain.mean - sampled.mean) < tolerance);
+	if (std::fabs(plain.mean - sampled.mean) >= tolerance)
+		std::cerr << "  plain " << plain.mean << " vs sampled " << sampled.mean << ", tolerance "
+				  << tolerance << "\n";
+}
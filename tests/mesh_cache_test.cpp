@@ -0,0 +1,143 @@
+// The mesh cache: a mesh written with write_mesh_cache and mapped back by open_mesh_cache
+// traces like the mesh it was written from, and a file under another key, cut short or
+// holding a tree deeper than the traversal stack is turned away.
+
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "mesh_cache.h"
+#include "rng.h"
+
+namespace {
+
+constexpr uint64_t test_key = 0x5eed;
+
+std::string cache_path(const std::string &name) {
+	return (std::filesystem::temp_directory_path() / ("tinyrt_" + name + ".rtmesh")).string();
+}
+
+std::string read_file(const std::string &path) {
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string &path, const std::string &contents) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out << contents;
+}
+
+// A copy of the cache at source with its header changed by edit.
+template <typename Edit>
+std::string edited_copy(const std::string &source, const std::string &name, Edit &&edit) {
+	std::string contents = read_file(source);
+	MeshCacheHeader header;
+	std::memcpy(&header, contents.data(), sizeof(header));
+	edit(header);
+	std::memcpy(contents.data(), &header, sizeof(header));
+	const std::string path = cache_path(name);
+	write_file(path, contents);
+	return path;
+}
+
+// Rays from around the sphere towards its middle whose hits differ between a and b in
+// distance, triangle or shading normal.
+int mismatches(const TriangleMesh &a, const TriangleMesh &b) {
+	seed_thread_rng(23, 0, 1);
+	int count = 0;
+	for (int n = 0; n < 20000; ++n) {
+		const Point3 origin = Point3(0, 0, 0) + random_float(5, 50) * random_unit_vector();
+		const Ray r(origin, random_float(0.5f, 2) * random_in_unit_shpere() - origin);
+		HitRecord rec_a{}, rec_b{};
+		const bool hit_a = a.hit(r, 0, infinity, rec_a);
+		const bool hit_b = b.hit(r, 0, infinity, rec_b);
+		if (hit_a != hit_b || a.occluded(r, 0, infinity) != b.occluded(r, 0, infinity)) {
+			++count;
+			continue;
+		}
+		if (!hit_a)
+			continue;
+		const uint32_t primitive_a = rec_a.primitive;
+		const uint32_t primitive_b = rec_b.primitive;
+		rec_a.finalize(r);
+		rec_b.finalize(r);
+		count += rec_a.t != rec_b.t || primitive_a != primitive_b ||
+				 rec_a.normal.x() != rec_b.normal.x() || rec_a.normal.y() != rec_b.normal.y() ||
+				 rec_a.normal.z() != rec_b.normal.z();
+	}
+	return count;
+}
+
+} // namespace
+
+TEST_CASE(mesh_cache, reopened_mesh_traces_like_the_original) {
+	const TriangleMesh mesh(make_icosphere(Point3(0, 0, 0), 3, 3), nullptr);
+	const std::string path = cache_path("roundtrip");
+	CHECK(write_mesh_cache(path, mesh, test_key));
+
+	const shared_ptr<TriangleMesh> cached = open_mesh_cache(path, test_key, nullptr);
+	CHECK(cached != nullptr);
+	if (!cached)
+		return;
+	CHECK_EQ(cached->triangle_count(), mesh.triangle_count());
+	CHECK_EQ(cached->nodes().size(), mesh.nodes().size());
+	CHECK_EQ(cached->stats().max_depth, mesh.stats().max_depth);
+	CHECK_EQ(cached->view().normals.size(), mesh.view().normals.size());
+	CHECK_EQ(mismatches(mesh, *cached), 0);
+}
+
+TEST_CASE(mesh_cache, wrong_key_truncated_file_and_deep_tree_are_rejected) {
+	const TriangleMesh mesh(make_icosphere(Point3(0, 0, 0), 3, 2), nullptr);
+	const std::string path = cache_path("rejected");
+	CHECK(write_mesh_cache(path, mesh, test_key));
+	CHECK(open_mesh_cache(path, test_key, nullptr) != nullptr);
+
+	CHECK(open_mesh_cache(path, test_key + 1, nullptr) == nullptr);
+	CHECK(open_mesh_cache(cache_path("missing"), test_key, nullptr) == nullptr);
+
+	// Cut off in the middle of the node array; the header alone still reads.
+	const std::string contents = read_file(path);
+	const std::string truncated = cache_path("truncated");
+	write_file(truncated, contents.substr(0, contents.size() - 100));
+	CHECK(open_mesh_cache(truncated, test_key, nullptr) == nullptr);
+	write_file(truncated, contents.substr(0, sizeof(MeshCacheHeader) / 2));
+	CHECK(open_mesh_cache(truncated, test_key, nullptr) == nullptr);
+
+	// A tree that would overflow the traversal stack, from a build without the depth limit.
+	const std::string deep = edited_copy(path, "deep", [](MeshCacheHeader &header) {
+		header.max_depth = bvh_max_depth + 1;
+	});
+	CHECK(open_mesh_cache(deep, test_key, nullptr) == nullptr);
+
+	const std::string versioned = edited_copy(path, "version", [](MeshCacheHeader &header) {
+		header.version = mesh_cache_version + 1;
+	});
+	CHECK(open_mesh_cache(versioned, test_key, nullptr) == nullptr);
+}
+
+TEST_CASE(mesh_cache, cached_mesh_is_built_once_per_key_and_options) {
+	const std::string path = cache_path("cached");
+	std::filesystem::remove(path);
+	int builds = 0;
+	const auto build = [&] {
+		++builds;
+		return make_icosphere(Point3(0, 0, 0), 3, 2);
+	};
+
+	CHECK(cached_triangle_mesh(path, test_key, nullptr, build) != nullptr);
+	CHECK(cached_triangle_mesh(path, test_key, nullptr, build) != nullptr);
+	CHECK_EQ(builds, 1);
+
+	// Other build options make another tree, so the key changes with them.
+	BvhBuildOptions options;
+	options.max_leaf_size = 1;
+	CHECK(cached_triangle_mesh(path, test_key, nullptr, build, options) != nullptr);
+	CHECK_EQ(builds, 2);
+	CHECK(cached_triangle_mesh(path, test_key, nullptr, build, options) != nullptr);
+	CHECK_EQ(builds, 2);
+}
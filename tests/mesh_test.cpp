@@ -0,0 +1,331 @@
+// The OBJ and PLY readers on small inline files: index forms, polygon fans, and the three PLY
+// encodings of one mesh. Then TriangleMesh itself: rays through the shared vertices and edges
+// of an icosphere, occluded() against hit(), and finalize_hit on a triangle worked by hand.
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "mesh_loader.h"
+#include "rng.h"
+#include "triangle_mesh.h"
+
+namespace {
+
+// Writes contents to a file in the temporary directory and returns its path.
+std::string write_fixture(const std::string &name, const std::string &contents) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / ("tinyrt_" + name);
+	std::ofstream out(path, std::ios::binary);
+	out << contents;
+	return path.string();
+}
+
+bool same_point(const Vec3 &a, const Vec3 &b) {
+	return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+bool same_mesh(const MeshData &a, const MeshData &b) {
+	if (a.positions.size() != b.positions.size() || a.normals.size() != b.normals.size() ||
+		a.uvs != b.uvs || a.indices != b.indices)
+		return false;
+	for (size_t i = 0; i < a.positions.size(); ++i) {
+		if (!same_point(a.positions[i], b.positions[i]))
+			return false;
+	}
+	for (size_t i = 0; i < a.normals.size(); ++i) {
+		if (!same_point(a.normals[i], b.normals[i]))
+			return false;
+	}
+	return true;
+}
+
+// Appends value in the given byte order.
+template <typename T>
+void put(std::string &out, T value, bool big_endian) {
+	char bytes[sizeof(T)];
+	std::memcpy(bytes, &value, sizeof(T));
+	if (big_endian != (std::endian::native == std::endian::big))
+		std::reverse(bytes, bytes + sizeof(T));
+	out.append(bytes, sizeof(T));
+}
+
+// A unit square as a quad and a triangle above it, with uvs and an unused double property,
+// followed by an element the reader has to skip.
+const char *const ply_header_body = "comment two faces\n"
+									"element vertex 5\n"
+									"property float x\n"
+									"property float y\n"
+									"property float z\n"
+									"property double confidence\n"
+									"property float u\n"
+									"property float v\n"
+									"element face 2\n"
+									"property list uchar uint vertex_indices\n"
+									"element edge 1\n"
+									"property int vertex1\n"
+									"property int vertex2\n"
+									"end_header\n";
+
+const float ply_vertices[5][5] = {{0, 0, 0, 0, 0},
+								   {1, 0, 0, 1, 0},
+								   {1, 1, 0, 1, 1},
+								   {0, 1, 0, 0, 1},
+								   {0.5f, 0.5f, 1, 0.5f, 0.5f}};
+
+std::string binary_ply(bool big_endian) {
+	std::string ply = std::string("ply\nformat ") +
+					  (big_endian ? "binary_big_endian" : "binary_little_endian") + " 1.0\n" +
+					  ply_header_body;
+	for (const auto &v : ply_vertices) {
+		put(ply, v[0], big_endian);
+		put(ply, v[1], big_endian);
+		put(ply, v[2], big_endian);
+		put(ply, 0.25, big_endian);
+		put(ply, v[3], big_endian);
+		put(ply, v[4], big_endian);
+	}
+	put(ply, static_cast<uint8_t>(4), big_endian);
+	for (const uint32_t index : {0u, 1u, 2u, 3u}) {
+		put(ply, index, big_endian);
+	}
+	put(ply, static_cast<uint8_t>(3), big_endian);
+	for (const uint32_t index : {0u, 1u, 4u}) {
+		put(ply, index, big_endian);
+	}
+	put(ply, int32_t{0}, big_endian);
+	put(ply, int32_t{1}, big_endian);
+	return ply;
+}
+
+bool near(float a, float b) {
+	return std::fabs(a - b) < 1e-5f;
+}
+
+bool near(const Vec3 &a, const Vec3 &b) {
+	return near(a.x(), b.x()) && near(a.y(), b.y()) && near(a.z(), b.z());
+}
+
+// An icosphere away from the origin with a radius that is not a power of two, so the vertex
+// coordinates and the edge functions are rounded.
+MeshData test_icosphere() {
+	return make_icosphere(Point3(190, 90, 190), 90, 3);
+}
+
+// One triangle in the z = 0 plane with a different normal at each corner.
+MeshData hand_triangle() {
+	MeshData mesh;
+	mesh.positions = {Point3(0, 0, 0), Point3(1, 0, 0), Point3(0, 1, 0)};
+	mesh.normals = {Vec3(0, 0, 1), Vec3(1, 0, 0), Vec3(0, 1, 0)};
+	mesh.indices = {0, 1, 2};
+	return mesh;
+}
+
+} // namespace
+
+TEST_CASE(mesh, obj_negative_indices_count_back_from_the_current_end) {
+	const std::string path = write_fixture("negative.obj", "v 0 0 0\n"
+														   "v 1 0 0\n"
+														   "v 0 1 0\n"
+														   "f -3 -2 -1\n"
+														   "v 0 0 1\n"
+														   "f 1 -1 -2\n");
+	MeshData mesh;
+	CHECK(load_obj(path, mesh));
+	CHECK_EQ(mesh.positions.size(), size_t{4});
+	CHECK(mesh.normals.empty() && mesh.uvs.empty());
+	CHECK((mesh.indices == std::vector<uint32_t>{0, 1, 2, 0, 3, 2}));
+
+	const std::string bad = write_fixture("bad_index.obj", "v 0 0 0\nv 1 0 0\nf 1 2 -3\n");
+	CHECK(!load_obj(bad, mesh));
+	CHECK(mesh.positions.empty() && mesh.indices.empty());
+}
+
+TEST_CASE(mesh, obj_normals_without_texture_coordinates) {
+	// v//vn: one vertex per distinct position and normal pair.
+	const std::string path = write_fixture("normals.obj", "v 0 0 0\n"
+														  "v 1 0 0\n"
+														  "v 0 1 0\n"
+														  "vn 0 0 1\n"
+														  "vn 0 0 -1\n"
+														  "f 1//1 2//1 3//1\n"
+														  "f 1//2 3//2 2//2\n"
+														  "f 2//1 3//1 1//1\n");
+	MeshData mesh;
+	CHECK(load_obj(path, mesh));
+	CHECK_EQ(mesh.positions.size(), size_t{6});
+	CHECK_EQ(mesh.normals.size(), size_t{6});
+	CHECK(mesh.uvs.empty());
+	CHECK_EQ(mesh.indices.size(), size_t{9});
+	CHECK((std::vector<uint32_t>(mesh.indices.begin() + 6, mesh.indices.end()) ==
+		   std::vector<uint32_t>{1, 2, 0}));
+
+	const Point3 corners[] = {Point3(0, 0, 0), Point3(1, 0, 0), Point3(0, 1, 0)};
+	const int face_corners[3][3] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}};
+	for (int face = 0; face < 3; ++face) {
+		const float z = face == 1 ? -1.0f : 1.0f;
+		for (int k = 0; k < 3; ++k) {
+			const uint32_t vertex = mesh.indices[3 * face + k];
+			CHECK(same_point(mesh.positions[vertex], corners[face_corners[face][k]]));
+			CHECK(same_point(mesh.normals[vertex], Vec3(0, 0, z)));
+		}
+	}
+}
+
+TEST_CASE(mesh, obj_polygons_become_fans) {
+	const std::string path =
+		write_fixture("pentagon.obj", "# a pentagon with uvs\n"
+									  "o pentagon\n"
+									  "v 0 0 0\nv 2 0 0\nv 3 1 0\nv 1 2 0\nv -1 1 0\n"
+									  "vt 0 0\nvt 1 0\nvt 1 1\nvt 0.5 1\nvt 0 1\n"
+									  "f 1/1 2/2 3/3 4/4 5/5\n");
+	MeshData mesh;
+	CHECK(load_obj(path, mesh));
+	CHECK((mesh.indices == std::vector<uint32_t>{0, 1, 2, 0, 2, 3, 0, 3, 4}));
+	CHECK_EQ(mesh.positions.size(), size_t{5});
+	CHECK_EQ(mesh.uvs.size(), size_t{10});
+	CHECK(mesh.normals.empty());
+	CHECK(same_point(mesh.positions[3], Point3(1, 2, 0)));
+	CHECK(mesh.uvs[6] == 0.5f && mesh.uvs[7] == 1.0f);
+
+	const std::string line = write_fixture("line.obj", "v 0 0 0\nv 1 0 0\nf 1 2\n");
+	CHECK(!load_obj(line, mesh));
+}
+
+TEST_CASE(mesh, ply_ascii_and_binary_read_alike) {
+	std::string ascii = std::string("ply\nformat ascii 1.0\n") + ply_header_body;
+	for (const auto &v : ply_vertices) {
+		ascii += std::to_string(v[0]) + " " + std::to_string(v[1]) + " " + std::to_string(v[2]) +
+				 " 0.25 " + std::to_string(v[3]) + " " + std::to_string(v[4]) + "\n";
+	}
+	ascii += "4 0 1 2 3\n3 0 1 4\n0 1\n";
+
+	MeshData expected;
+	for (const auto &v : ply_vertices) {
+		expected.positions.emplace_back(v[0], v[1], v[2]);
+		expected.uvs.push_back(v[3]);
+		expected.uvs.push_back(v[4]);
+	}
+	expected.indices = {0, 1, 2, 0, 2, 3, 0, 1, 4};
+
+	MeshData mesh;
+	CHECK(load_mesh(write_fixture("square_ascii.PLY", ascii), mesh));
+	CHECK(same_mesh(mesh, expected));
+
+	CHECK(load_ply(write_fixture("square_le.ply", binary_ply(false)), mesh));
+	CHECK(same_mesh(mesh, expected));
+
+	CHECK(load_ply(write_fixture("square_be.ply", binary_ply(true)), mesh));
+	CHECK(same_mesh(mesh, expected));
+
+	// Cut short in the middle of the faces.
+	const std::string truncated = binary_ply(false);
+	CHECK(!load_ply(write_fixture("truncated.ply", truncated.substr(0, truncated.size() - 20)),
+					mesh));
+	CHECK(mesh.indices.empty());
+}
+
+TEST_CASE(mesh, rays_through_shared_vertices_and_edges_hit_the_icosphere) {
+	// Every ray enters the closed sphere through a vertex, where five or six triangles meet,
+	// or through a point of an edge, so only the edge functions decide which triangle it hits
+	// and none may let it through. The hit must be at the target, t = 1, not on the far side
+	// of the sphere. The rays come in well away from the tangent plane: a ray grazing a
+	// convex mesh can touch it at a vertex alone, and rounding then decides.
+	seed_thread_rng(11, 0, 1);
+	const MeshData data = test_icosphere();
+	const TriangleMesh mesh(data, nullptr);
+	const size_t triangles = data.triangle_count();
+	int lost = 0;
+	for (int n = 0; n < 200000; ++n) {
+		const uint32_t *v = &data.indices[3 * (n % triangles)];
+		const Point3 &a = data.positions[v[n % 3]];
+		const Point3 &b = data.positions[v[(n + 1) % 3]];
+		Point3 target = a;
+		if (n % 3 == 1)
+			target = 0.5f * (a + b);
+		else if (n % 3 == 2)
+			target = a + random_float() * (b - a);
+		Vec3 away = random_unit_vector();
+		while (dot(away, unit_vector(target - Point3(190, 90, 190))) < 0.25f) {
+			away = random_unit_vector();
+		}
+		const Point3 origin = target + random_float(1, 1000) * away;
+		const Ray r(origin, target - origin);
+		HitRecord rec{};
+		lost += !mesh.hit(r, 0, infinity, rec) || rec.t > 1.001f;
+		lost += !mesh.occluded(r, 0, 1.001f);
+	}
+	CHECK_EQ(lost, 0);
+}
+
+TEST_CASE(mesh, occluded_agrees_with_hit) {
+	// Rays from inside and outside the sphere in every direction; about half of the outside
+	// ones miss.
+	seed_thread_rng(12, 0, 1);
+	const TriangleMesh mesh(test_icosphere(), nullptr);
+	int mismatches = 0;
+	int hits = 0;
+	for (int n = 0; n < 100000; ++n) {
+		const Point3 origin = Point3(190, 90, 190) + random_float(0, 300) * random_unit_vector();
+		const Ray r(origin, random_unit_vector());
+		HitRecord rec{};
+		const bool hit = mesh.hit(r, 0, infinity, rec);
+		hits += hit;
+		mismatches += hit != mesh.occluded(r, 0, infinity);
+		if (hit) {
+			// Nothing lies in front of the closest hit, and the hit itself counts.
+			mismatches += mesh.occluded(r, 0, rec.t * (1 - 1e-4f));
+			mismatches += !mesh.occluded(r, 0, rec.t);
+		}
+	}
+	CHECK_EQ(mismatches, 0);
+	CHECK(hits > 10000 && hits < 90000);
+}
+
+TEST_CASE(mesh, finalize_hit_interpolates_at_the_barycentric_coordinates) {
+	// (0.2, 0.3) has barycentric coordinates 0.5, 0.2 and 0.3, so the interpolated normal is
+	// unit (0.2, 0.3, 0.5); without uvs, u and v are the coordinates of the second and third
+	// vertex.
+	const TriangleMesh mesh(hand_triangle(), nullptr);
+	const Vec3 normal = unit_vector(Vec3(0.2f, 0.3f, 0.5f));
+
+	const Ray down(Point3(0.2f, 0.3f, 1), Vec3(0, 0, -1));
+	HitRecord rec;
+	CHECK(mesh.hit(down, 0, infinity, rec));
+	CHECK(rec.object == &mesh);
+	CHECK_EQ(rec.primitive, 0u);
+	rec.finalize(down);
+	CHECK(near(rec.t, 1));
+	CHECK(near(rec.p, Point3(0.2f, 0.3f, 0)));
+	CHECK(rec.front_face);
+	CHECK(near(rec.normal, normal));
+	CHECK(near(rec.u, 0.2f) && near(rec.v, 0.3f));
+
+	// From below the geometric normal is flipped, and the shading normal with it.
+	const Ray up(Point3(0.2f, 0.3f, -2), Vec3(0, 0, 1));
+	CHECK(mesh.hit(up, 0, infinity, rec));
+	rec.finalize(up);
+	CHECK(near(rec.t, 2));
+	CHECK(!rec.front_face);
+	CHECK(near(rec.normal, -normal));
+
+	// With uvs: u = 0.5 * 0.1 + 0.2 * 0.5 + 0.3 * 0.9, v = 0.5 * 0.9 + 0.2 * 0.5 + 0.3 * 0.1.
+	MeshData textured = hand_triangle();
+	textured.uvs = {0.1f, 0.9f, 0.5f, 0.5f, 0.9f, 0.1f};
+	const TriangleMesh textured_mesh(std::move(textured), nullptr);
+	CHECK(textured_mesh.hit(down, 0, infinity, rec));
+	rec.finalize(down);
+	CHECK(near(rec.u, 0.42f) && near(rec.v, 0.58f));
+
+	// Outside the triangle and beyond t_max nothing is hit.
+	CHECK(!mesh.hit(Ray(Point3(0.6f, 0.6f, 1), Vec3(0, 0, -1)), 0, infinity, rec));
+	CHECK(!mesh.occluded(Ray(Point3(0.6f, 0.6f, 1), Vec3(0, 0, -1)), 0, infinity));
+	CHECK(!mesh.hit(down, 0, 0.5f, rec));
+	CHECK(!mesh.occluded(down, 0, 0.5f));
+}
@@ -0,0 +1,100 @@
+// Progressive rendering: resuming from a checkpoint, and which checkpoints may be resumed.
+
+#include <filesystem>
+#include <string>
+
+#include "check.h"
+#include "image_writer.h"
+#include "progressive.h"
+#include "renderer.h"
+#include "world.h"
+
+namespace {
+
+std::string checkpoint_path(const std::string &name) {
+	const std::filesystem::path path =
+		std::filesystem::temp_directory_path() / ("tinyrt_" + name + ".accum");
+	std::filesystem::remove(path);
+	return path.string();
+}
+
+RenderSettings small_settings(int samples) {
+	RenderSettings settings;
+	settings.image_width = 32;
+	settings.samples_per_pixel = samples;
+	settings.max_depth = 8;
+	settings.num_threads = 1;
+	settings.verbose = false;
+	return settings;
+}
+
+bool same_image(const Image &a, const Image &b) {
+	for (int y = 0; y < a.height(); ++y) {
+		for (int x = 0; x < a.width(); ++x) {
+			for (int c = 0; c < 3; ++c) {
+				if (a.at(x, y)[c] != b.at(x, y)[c])
+					return false;
+			}
+		}
+	}
+	return a.width() == b.width() && a.height() == b.height();
+}
+
+} // namespace
+
+TEST_CASE(progressive, resumed_render_matches_an_uninterrupted_one) {
+	const Scene scene = make_scene(7);
+	AsyncImageWriter writer;
+	ProgressiveSettings progressive;
+	progressive.pass_samples = 4;
+
+	const RenderResult whole = render_progressive(scene, small_settings(12), progressive, writer);
+
+	// Stop after two passes, leaving a checkpoint twice over, then extend to 12 samples.
+	progressive.checkpoint_path = checkpoint_path("resume");
+	render_progressive(scene, small_settings(8), progressive, writer);
+	render_progressive(scene, small_settings(8), progressive, writer);
+	const RenderResult resumed =
+		render_progressive(scene, small_settings(12), progressive, writer);
+	CHECK(same_image(resumed.image, whole.image));
+	CHECK_EQ(resumed.path_stats.paths, whole.path_stats.paths / 3);
+}
+
+TEST_CASE(progressive, checkpoints_of_other_renders_are_refused) {
+	const Scene scene = make_scene(7);
+	const std::string path = checkpoint_path("mismatch");
+	Accumulator saved(32, 18);
+	const RenderSettings settings = small_settings(16);
+	CHECK(saved.save(path, scene, settings));
+
+	Accumulator accumulator(32, 18);
+	CHECK(accumulator.load(path, scene, settings));
+
+	RenderSettings other = settings;
+	other.sampler = SamplerType::halton;
+	CHECK(!accumulator.load(path, scene, other));
+	other = settings;
+	other.sample_lights = !settings.sample_lights;
+	CHECK(!accumulator.load(path, scene, other));
+	other = settings;
+	other.trace_packets = !settings.trace_packets;
+	CHECK(!accumulator.load(path, scene, other));
+	other = settings;
+	other.adaptive = true;
+	CHECK(!accumulator.load(path, scene, other));
+	other = settings;
+	other.seed = 1;
+	CHECK(!accumulator.load(path, scene, other));
+
+	// Sobol continues to any total; stratified only to the one its strata were made for.
+	other = settings;
+	other.samples_per_pixel = 64;
+	CHECK(accumulator.load(path, scene, other));
+
+	RenderSettings stratified = settings;
+	stratified.sampler = SamplerType::stratified;
+	CHECK(saved.save(path, scene, stratified));
+	CHECK(accumulator.load(path, scene, stratified));
+	stratified.samples_per_pixel = 64;
+	CHECK(!accumulator.load(path, scene, stratified));
+}
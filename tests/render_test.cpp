@@ -0,0 +1,71 @@
+// End-to-end checks on small renders: the packet path, the thread count and the tile size
+// must not change a single pixel, since every sample draws from a generator seeded by its
+// pixel and index.
+
+#include <cmath>
+
+#include "check.h"
+#include "renderer.h"
+#include "world.h"
+
+namespace {
+
+RenderSettings small_settings() {
+	RenderSettings settings;
+	settings.image_width = 48;
+	settings.samples_per_pixel = 4;
+	settings.max_depth = 8;
+	settings.num_threads = 1;
+	settings.verbose = false;
+	return settings;
+}
+
+bool same_image(const Image &a, const Image &b) {
+	if (a.width() != b.width() || a.height() != b.height())
+		return false;
+	for (int y = 0; y < a.height(); ++y) {
+		for (int x = 0; x < a.width(); ++x) {
+			for (int c = 0; c < 3; ++c) {
+				if (a.at(x, y)[c] != b.at(x, y)[c])
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool finite_image(const Image &image) {
+	for (int y = 0; y < image.height(); ++y) {
+		for (int x = 0; x < image.width(); ++x) {
+			for (int c = 0; c < 3; ++c) {
+				if (!std::isfinite(image.at(x, y)[c]) || image.at(x, y)[c] < 0)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+TEST_CASE(render, packets_threads_and_tiles_do_not_change_pixels) {
+	// Scenes 8 and 9 hold media, whose hits draw samples, so they take the scalar path for
+	// the first hit too.
+	for (int id : {1, 7, 8, 9, 10, 11}) {
+		seed_thread_rng(id, 0, 1);
+		const Scene scene = make_scene(id);
+
+		RenderSettings settings = small_settings();
+		const RenderResult reference = render_scene(scene, settings);
+		CHECK(reference.image.width() == settings.image_width);
+		CHECK(finite_image(reference.image));
+
+		settings.trace_packets = false;
+		CHECK(same_image(render_scene(scene, settings).image, reference.image));
+
+		settings = small_settings();
+		settings.num_threads = 3;
+		settings.tile_size = 7;
+		CHECK(same_image(render_scene(scene, settings).image, reference.image));
+	}
+}
@@ -0,0 +1,151 @@
+// The samplers on the samples of one pixel: the Sobol 2D samples are (0,2) nets wherever they
+// fall among the dimensions, the stratified ones fill their grid, and every sampler stays in
+// [0, 1), also past the dimensions its sequence covers.
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "check.h"
+#include "rng.h"
+#include "sampler.h"
+
+namespace {
+
+// The dimensions a camera sample asks for: 2 for a 2D sample, 1 for a 1D one. The pixel
+// position, the lens and the time, then a few bounces.
+const int sample_pattern[] = {2, 2, 1, 1, 2, 2, 1, 2, 1, 1, 2, 2};
+constexpr int pattern_length = sizeof(sample_pattern) / sizeof(sample_pattern[0]);
+
+// Every 1D and 2D sample of the samples of pixel, by the position in the pattern.
+struct PixelSamples {
+	std::vector<std::vector<float>> one;
+	std::vector<std::vector<Point2>> two;
+};
+
+PixelSamples pixel_samples(SamplerType type, int samples_per_pixel, uint64_t pixel) {
+	PixelSamples result;
+	result.one.resize(pattern_length);
+	result.two.resize(pattern_length);
+	Sampler sampler(type, samples_per_pixel);
+	for (int sample = 0; sample < samples_per_pixel; ++sample) {
+		seed_thread_rng(pixel, sample, 1);
+		sampler.start(pixel, sample, 1);
+		for (int i = 0; i < pattern_length; ++i) {
+			if (sample_pattern[i] == 2)
+				result.two[i].push_back(sampler.next_2d());
+			else
+				result.one[i].push_back(sampler.next_1d());
+		}
+	}
+	return result;
+}
+
+// Whether every cell of a columns by rows grid holds the same number of points.
+bool evenly_spread(const std::vector<Point2> &points, uint32_t columns, uint32_t rows) {
+	std::vector<uint32_t> counts(columns * rows, 0);
+	for (const Point2 &p : points) {
+		const auto x = static_cast<uint32_t>(p.x * columns);
+		const auto y = static_cast<uint32_t>(p.y * rows);
+		if (x >= columns || y >= rows)
+			return false;
+		++counts[y * columns + x];
+	}
+	for (const uint32_t count : counts) {
+		if (count * columns * rows != points.size())
+			return false;
+	}
+	return true;
+}
+
+bool evenly_spread(const std::vector<float> &values, uint32_t strata) {
+	std::vector<Point2> points;
+	for (const float value : values) {
+		points.push_back(Point2{value, 0});
+	}
+	return evenly_spread(points, strata, 1);
+}
+
+} // namespace
+
+TEST_CASE(sampler, sobol_2d_samples_are_02_nets) {
+	// 2^m points with one in every elementary interval of 2^a by 2^(m - a) cells, for every
+	// 2D sample of the pattern, whatever number of dimensions comes before it.
+	int failures = 0;
+	for (int m = 1; m <= 10; ++m) {
+		for (uint64_t pixel = 0; pixel < 8; ++pixel) {
+			const PixelSamples samples = pixel_samples(SamplerType::sobol, 1 << m, pixel);
+			for (int i = 0; i < pattern_length; ++i) {
+				if (sample_pattern[i] == 1) {
+					failures += !evenly_spread(samples.one[i], 1u << m);
+					continue;
+				}
+				for (int a = 0; a <= m; ++a) {
+					failures += !evenly_spread(samples.two[i], 1u << a, 1u << (m - a));
+				}
+			}
+		}
+	}
+	CHECK_EQ(failures, 0);
+}
+
+TEST_CASE(sampler, stratified_samples_fill_their_strata) {
+	// The 2D samples fill the largest square grid the samples of a pixel can, the 1D samples
+	// one stratum each; with a sample count that is not a square, the first k * k samples
+	// fill the grid.
+	int failures = 0;
+	for (const int spp : {4, 16, 20, 64}) {
+		const auto k = static_cast<uint32_t>(std::sqrt(spp));
+		for (uint64_t pixel = 0; pixel < 8; ++pixel) {
+			const PixelSamples samples = pixel_samples(SamplerType::stratified, spp, pixel);
+			for (int i = 0; i < pattern_length; ++i) {
+				if (sample_pattern[i] == 1) {
+					failures += !evenly_spread(samples.one[i], spp);
+					continue;
+				}
+				const std::vector<Point2> first(samples.two[i].begin(),
+												samples.two[i].begin() + k * k);
+				failures += !evenly_spread(first, k, k);
+			}
+		}
+	}
+	CHECK_EQ(failures, 0);
+}
+
+TEST_CASE(sampler, samples_stay_in_the_unit_interval) {
+	// Forty dimensions, past the sixteen Halton bases, with sample counts that are powers of
+	// two and ones that are not.
+	int outside = 0;
+	for (const SamplerType type : {SamplerType::independent, SamplerType::stratified,
+								   SamplerType::halton, SamplerType::sobol}) {
+		for (const int spp : {1, 3, 16, 100}) {
+			Sampler sampler(type, spp);
+			for (uint64_t pixel = 0; pixel < 16; ++pixel) {
+				for (int sample = 0; sample < spp; ++sample) {
+					seed_thread_rng(pixel, sample, 2);
+					sampler.start(pixel, sample, 2);
+					for (int d = 0; d < 40; d += 3) {
+						const float x = sampler.next_1d();
+						const Point2 p = sampler.next_2d();
+						outside += !(x >= 0 && x < 1) || !(p.x >= 0 && p.x < 1) ||
+								   !(p.y >= 0 && p.y < 1);
+					}
+				}
+			}
+		}
+	}
+	CHECK_EQ(outside, 0);
+
+	// The first Halton dimension is base 2: 2^m samples take one of 2^m strata each.
+	int failures = 0;
+	for (uint64_t pixel = 0; pixel < 8; ++pixel) {
+		Sampler sampler(SamplerType::halton, 64);
+		std::vector<float> values;
+		for (int sample = 0; sample < 64; ++sample) {
+			sampler.start(pixel, sample, 3);
+			values.push_back(sampler.next_1d());
+		}
+		failures += !evenly_spread(values, 64);
+	}
+	CHECK_EQ(failures, 0);
+}
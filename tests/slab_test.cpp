@@ -0,0 +1,160 @@
+// The slab test behind aabb::hit and the BVHs, and its packet form, at the places where
+// rounding and IEEE special values decide the answer: shared edges and corners, rays lying in
+// a slab plane, and infinite or NaN inverse directions.
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "aabb.h"
+#include "check.h"
+#include "ray_packet.h"
+#include "rng.h"
+#include "wide_bvh.h"
+
+namespace {
+
+constexpr float cell = 0.37f; // not a power of two, so the grid planes are rounded
+constexpr int cells = 4;
+
+std::vector<aabb> grid_boxes() {
+	std::vector<aabb> boxes;
+	for (int i = 0; i < cells; ++i) {
+		for (int j = 0; j < cells; ++j) {
+			for (int k = 0; k < cells; ++k) {
+				boxes.emplace_back(Point3(i * cell, j * cell, k * cell),
+								   Point3((i + 1) * cell, (j + 1) * cell, (k + 1) * cell));
+			}
+		}
+	}
+	return boxes;
+}
+
+bool hits_any(const std::vector<aabb> &boxes, const Ray &r) {
+	for (const aabb &box : boxes) {
+		if (box.hit(r, 0, infinity))
+			return true;
+	}
+	return false;
+}
+
+// slab_test on a single box, with the entry distance.
+bool slab(const aabb &box, const Ray &r, float t_min, float t_max, float &t_near) {
+	return slab_test(box.aabb_minimum.e, box.aabb_maximum.e, r, t_min, t_max, t_near);
+}
+
+// The packet test of one lane holding r, for comparison with slab_test.
+bool packet_slab(const aabb &box, const Ray &r, float t_min, float t_max) {
+	RayPacket packet;
+	for (int lane = 0; lane < packet_width; ++lane) {
+		packet.set(lane, r, t_max);
+	}
+	float nearest;
+	return packet_slab_test(packet, box.aabb_minimum.e, box.aabb_maximum.e, t_min, 1u,
+							nearest) != 0;
+}
+
+} // namespace
+
+TEST_CASE(slab, rays_through_grid_edges_and_corners_hit_a_box) {
+	// Every ray aims at a vertex or an edge point inside the grid, where up to eight boxes
+	// meet; rounding must not let it pass between all of them.
+	seed_thread_rng(7, 0, 1);
+	const std::vector<aabb> boxes = grid_boxes();
+	int lost = 0;
+	for (int n = 0; n < 100000; ++n) {
+		const int i = 1 + n % (cells - 1);
+		const int j = 1 + (n / 3) % (cells - 1);
+		const int k = 1 + (n / 9) % (cells - 1);
+		Point3 target(i * cell, j * cell, k * cell);
+		if (n % 2 == 1)
+			target[n % 3] = random_float(cell, (cells - 1) * cell);
+		const Point3 origin = target + random_float(1, 100) * random_unit_vector();
+		lost += !hits_any(boxes, Ray(origin, target - origin));
+	}
+	CHECK_EQ(lost, 0);
+}
+
+TEST_CASE(slab, axis_parallel_rays_along_grid_edges) {
+	// A ray running along an edge lies in two slab planes at once. Every edge of every box
+	// is hit, from both ends and with either sign of zero in the other components.
+	const std::vector<aabb> boxes = grid_boxes();
+	for (const aabb &box : boxes) {
+		for (int axis = 0; axis < 3; ++axis) {
+			const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			for (int corner = 0; corner < 4; ++corner) {
+				for (const float zero : {0.0f, -0.0f}) {
+					for (const float d : {1.0f, -1.0f}) {
+						Point3 origin;
+						origin[u] = (corner & 1 ? box.aabb_max() : box.aabb_min())[u];
+						origin[v] = (corner & 2 ? box.aabb_max() : box.aabb_min())[v];
+						origin[axis] = d > 0 ? -1.0f : cells * cell + 1;
+						Vec3 direction(zero, zero, zero);
+						direction[axis] = d;
+						const Ray r(origin, direction);
+						CHECK(box.hit(r, 0, infinity));
+						CHECK(packet_slab(box, r, 0, infinity));
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE(slab, rays_in_a_slab_plane_with_signed_zeros) {
+	const aabb box(Point3(0, 0, 0), Point3(1, 1, 1));
+	for (const float dz : {0.0f, -0.0f}) {
+		// In the plane of either face of the z slab, and inside it: a hit, entering at x = 0.
+		for (const float z : {0.0f, 1.0f, 0.5f}) {
+			const Ray r(Point3(-1, 0.5f, z), Vec3(1, 0, dz));
+			CHECK(std::isinf(r.inv_direction().z()));
+			CHECK_EQ(r.sign(2), std::signbit(dz) ? 1 : 0);
+
+			float t_near = -1;
+			CHECK(slab(box, r, 0, infinity, t_near));
+			CHECK_EQ(t_near, 1.0f);
+			CHECK(packet_slab(box, r, 0, infinity));
+			// The interval is still clipped by the x slab.
+			CHECK(!box.hit(r, 0, 0.5f));
+			CHECK(!box.hit(r, 2.5f, infinity));
+		}
+		// Just outside the z slab, on either side: a miss.
+		for (const float z : {-1e-6f, 1 + 1e-6f}) {
+			const Ray r(Point3(-1, 0.5f, z), Vec3(1, 0, dz));
+			CHECK(!box.hit(r, 0, infinity));
+			CHECK(!packet_slab(box, r, 0, infinity));
+		}
+	}
+}
+
+TEST_CASE(slab, nan_and_infinite_inverse_directions) {
+	const aabb box(Point3(0, 0, 0), Point3(1, 1, 1));
+	const float inf = std::numeric_limits<float>::infinity();
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	// An infinite inverse on an axis the origin is outside of rules the box out, whatever
+	// its sign.
+	for (const float inv : {inf, -inf}) {
+		const Vec3 direction(1, 0, 1 / inv);
+		const Ray outside(Point3(-1, 0.5f, 2), direction, Vec3(1, inv, inv), 0);
+		CHECK(!box.hit(outside, 0, infinity));
+		CHECK(!packet_slab(box, outside, 0, infinity));
+
+		const Ray inside(Point3(-1, 0.5f, 0.5f), direction, Vec3(1, inv, inv), 0);
+		CHECK(box.hit(inside, 0, infinity));
+		CHECK(packet_slab(box, inside, 0, infinity));
+	}
+
+	// A NaN slab distance leaves the interval to the other axes: the result and the entry
+	// distance are those of the x slab alone, never NaN.
+	const Ray nan_ray(Point3(-1, 0.5f, 0.5f), Vec3(1, 0, 0), Vec3(1, nan, nan), 0);
+	float t_near = -1;
+	CHECK(slab(box, nan_ray, 0, infinity, t_near));
+	CHECK_EQ(t_near, 1.0f);
+	CHECK(packet_slab(box, nan_ray, 0, infinity));
+	CHECK(!box.hit(nan_ray, 2.5f, infinity));
+
+	const Ray nan_miss(Point3(2, 0.5f, 0.5f), Vec3(1, 0, 0), Vec3(1, nan, nan), 0);
+	CHECK(!box.hit(nan_miss, 0, infinity));
+	CHECK(!packet_slab(box, nan_miss, 0, infinity));
+}
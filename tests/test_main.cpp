@@ -0,0 +1,34 @@
+// Runs the registered tests of the suites named on the command line, or of every suite, and
+// exits with 1 if any check failed.
+//
+//   tinyrt_tests [SUITE]...
+
+#include <cstring>
+#include <iostream>
+
+#include "check.h"
+
+int main(int argc, char **argv) {
+	int run = 0;
+	for (const check::TestCase &test : check::registry()) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i) {
+			selected = selected || std::strcmp(argv[i], test.suite) == 0;
+		}
+		if (!selected)
+			continue;
+
+		const int before = check::failures();
+		test.run();
+		std::cerr << (check::failures() == before ? "ok     " : "FAILED ") << test.suite << "."
+				  << test.name << "\n";
+		++run;
+	}
+
+	if (run == 0) {
+		std::cerr << "No tests selected.\n";
+		return 1;
+	}
+	std::cerr << run << " tests, " << check::failures() << " failed checks\n";
+	return check::failures() == 0 ? 0 : 1;
+}